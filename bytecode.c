@@ -0,0 +1,204 @@
+#include "bytecode.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jvm.h"
+#include "stats.h"
+
+/** The lengths of the fixed-size instructions, or 0 for variable-size ones */
+static const u1 INSTRUCTION_LENGTHS[256] = {
+    // 0x00-0x0f: nop, aconst_null, iconst_*, lconst_*, fconst_*, dconst_*
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    // 0x10-0x1f: bipush, sipush, ldc, ldc_w, ldc2_w, loads with an index, iload_*, lload_*
+    2, 3, 2, 3, 3, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1,
+    // 0x20-0x2f: lload_*, fload_*, dload_*, aload_*, iaload, laload
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    // 0x30-0x3f: array loads, stores with an index, istore_0
+    1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1,
+    // 0x40-0x4f: [lfda]store_*, iastore
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    // 0x50-0x5f: array stores, pop, dup, swap
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    // 0x60-0x7f: arithmetic
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    // 0x80-0x8f: ior, lor, ixor, lxor, iinc, conversions
+    1, 1, 1, 1, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    // 0x90-0x9f: conversions, comparisons, if<cond>, if_icmpeq
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 3, 3, 3, 3, 3, 3, 3,
+    // 0xa0-0xaf: if_icmp<cond>, if_acmp<cond>, goto, jsr, ret, switches, returns
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 2, 0, 0, 1, 1, 1, 1,
+    // 0xb0-0xbf: returns, field accesses, invokes, new, newarray, anewarray,
+    // arraylength, athrow
+    1, 1, 3, 3, 3, 3, 3, 3, 3, 5, 5, 3, 2, 3, 1, 1,
+    // 0xc0-0xcf: checkcast, instanceof, monitors, wide, multianewarray, ifnull,
+    // ifnonnull, goto_w, jsr_w, then TeenyJVM's invokenative, invokelibrary, ldc_string,
+    // concat and print_concat
+    3, 3, 1, 1, 0, 4, 3, 3, 5, 5, 1, 3, 3, 2, 5, 8,
+    // 0xd0-0xff: reserved, except TeenyJVM's new_builder, print_builder, new_object,
+    // getfield_*, putfield_*, invokevirtual_cached, invokeinterface_cached,
+    // getfield_double, putfield_double, array_literal, getfield_reference, prefetch,
+    // ldc_w_string and invokenative_virtual
+    3, 6, 3, 3, 3, 3, 3, 3, 3, 3, 3, 5, 3, 3, 3, 3,
+    4, 3, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+};
+
+static int32_t read_s4(const u1 *code, u4 pc) {
+    return (int32_t)((u4) code[pc] << 24 | (u4) code[pc + 1] << 16 |
+                     (u4) code[pc + 2] << 8 | code[pc + 3]);
+}
+
+u4 instruction_length(const u1 *code, u4 pc) {
+    u1 opcode = code[pc];
+    if (INSTRUCTION_LENGTHS[opcode] != 0) {
+        return INSTRUCTION_LENGTHS[opcode];
+    }
+
+    // Switch operands are aligned to a multiple of 4 bytes from the start of the code
+    u4 operands = (pc + 4) & ~3;
+    switch (opcode) {
+        case 0xaa: { // tableswitch: default, low, high, then high - low + 1 offsets
+            int32_t low = read_s4(code, operands + 4);
+            int32_t high = read_s4(code, operands + 8);
+            return operands - pc + 12 + 4 * (u4)(high - low + 1);
+        }
+        case 0xab: { // lookupswitch: default, npairs, then npairs (match, offset) pairs
+            int32_t pairs = read_s4(code, operands + 4);
+            return operands - pc + 8 + 8 * (u4) pairs;
+        }
+        default: // wide: iinc takes a 16-bit index and constant, the rest a 16-bit index
+            return code[pc + 1] == i_iinc ? 6 : 4;
+    }
+}
+
+bool can_relocate(const code_t *code) {
+    for (u4 pc = 0; pc < code->code_length; pc += instruction_length(code->code, pc)) {
+        u1 opcode = code->code[pc];
+        if ((0xa8 <= opcode && opcode <= 0xab) || opcode == 0xc4 || opcode == 0xc8 ||
+            opcode == 0xc9) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool insert_instruction(code_t *code, u4 at, const u1 *instruction, u4 length) {
+    u4 new_length = code->code_length + length;
+    if (new_length > UINT16_MAX) {
+        return false;
+    }
+    u1 *new_code = malloc(new_length);
+    assert(new_code != NULL && "Failed to allocate bytecode");
+    memcpy(new_code, code->code, at);
+    memcpy(new_code + at, instruction, length);
+    memcpy(new_code + at + length, code->code + at, code->code_length - at);
+    for (u4 pc = 0; pc < code->code_length; pc += instruction_length(code->code, pc)) {
+        if (!is_branch(code->code[pc])) {
+            continue;
+        }
+        // Branches to the insertion point now run the inserted instruction
+        u4 target = pc + branch_offset(code->code, pc);
+        u4 new_pc = pc < at ? pc : pc + length;
+        u4 new_target = target <= at ? target : target + length;
+        int32_t offset = (int32_t) new_target - (int32_t) new_pc;
+        if (offset < INT16_MIN || offset > INT16_MAX) {
+            free(new_code);
+            return false;
+        }
+        new_code[new_pc + 1] = (u1)((u2) offset >> 8);
+        new_code[new_pc + 2] = (u1) offset;
+    }
+    for (u2 i = 0; i < code->handler_count; i++) {
+        exception_handler_t *handler = &code->handlers[i];
+        handler->start_pc += handler->start_pc <= at ? 0 : length;
+        handler->end_pc += handler->end_pc <= at ? 0 : length;
+        handler->handler_pc += handler->handler_pc <= at ? 0 : length;
+    }
+    free(code->code);
+    code->code = new_code;
+    code->code_length = new_length;
+    stats_add_bytes(MEM_METHOD_BODIES, length);
+    return true;
+}
+
+u4 load_index(const u1 *code, u4 pc, u1 load, u1 load_0, u2 *index) {
+    if (code[pc] == load) {
+        *index = code[pc + 1];
+        return 2;
+    }
+    if (load_0 <= code[pc] && code[pc] <= load_0 + 3) {
+        *index = code[pc] - load_0;
+        return 1;
+    }
+    return 0;
+}
+
+bool writes_local(const u1 *code, u4 pc, u2 index) {
+    u1 opcode = code[pc];
+    if (opcode == i_iinc) {
+        return code[pc + 1] == index;
+    }
+    u2 first;
+    u1 type; // 0 to 4 for istore, lstore, fstore, dstore and astore
+    if (i_istore <= opcode && opcode <= i_astore) {
+        first = code[pc + 1];
+        type = opcode - i_istore;
+    }
+    else if (i_istore_0 <= opcode && opcode <= i_astore_3) {
+        first = (opcode - i_istore_0) % 4;
+        type = (opcode - i_istore_0) / 4;
+    }
+    else {
+        return false;
+    }
+    // Longs and doubles occupy two locals
+    bool wide = type == 1 || type == 3;
+    return first == index || (wide && first + 1 == index);
+}
+
+/** Checks whether a branch target lies in [start, end) */
+static bool in_range(u4 target, u4 start, u4 end) {
+    return start <= target && target < end;
+}
+
+bool has_branch_target(const u1 *code, u4 code_length, u4 start, u4 end) {
+    for (u4 pc = 0; pc < code_length; pc += instruction_length(code, pc)) {
+        u1 opcode = code[pc];
+        if ((i_ifeq <= opcode && opcode <= 0xa8) || opcode == 0xc6 || opcode == 0xc7) {
+            // ifs, goto, jsr, ifnull and ifnonnull
+            if (in_range(pc + branch_offset(code, pc), start, end)) {
+                return true;
+            }
+        }
+        else if (opcode == 0xc8 || opcode == 0xc9) {
+            // goto_w and jsr_w
+            if (in_range(pc + read_s4(code, pc + 1), start, end)) {
+                return true;
+            }
+        }
+        else if (opcode == 0xaa || opcode == 0xab) {
+            u4 operands = (pc + 4) & ~3;
+            u4 switch_end = pc + instruction_length(code, pc);
+            if (in_range(pc + read_s4(code, operands), start, end)) {
+                return true;
+            }
+            // After the default, tableswitch has low and high then offsets;
+            // lookupswitch has the number of pairs then (match, offset) pairs
+            u4 stride = opcode == 0xaa ? 4 : 8;
+            for (u4 offset = operands + 12; offset < switch_end; offset += stride) {
+                if (in_range(pc + read_s4(code, offset), start, end)) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+bool is_branch_target(const u1 *code, u4 code_length, u4 target) {
+    return has_branch_target(code, code_length, target, target + 1);
+}
@@ -0,0 +1,110 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <stdbool.h>
+
+#include "class_file.h"
+
+/**
+ * Gets the length of an instruction, including its operands.
+ * This handles every JVM instruction, not just the ones TeenyJVM executes.
+ *
+ * @param code the method's bytecode
+ * @param pc the offset of the instruction in the bytecode
+ * @return the number of bytes the instruction occupies
+ */
+u4 instruction_length(const u1 *code, u4 pc);
+
+/**
+ * Checks whether any branch or switch in a method can jump to an instruction.
+ * Instructions that are not branch targets are only reached from the
+ * previous instruction, so the two can be fused.
+ *
+ * @param code the method's bytecode
+ * @param code_length the number of bytes in the bytecode
+ * @param target the offset of the instruction
+ */
+bool is_branch_target(const u1 *code, u4 code_length, u4 target);
+
+/**
+ * Checks whether any branch or switch in a method can jump into a range of
+ * instructions, which is cheaper than checking each of them with is_branch_target().
+ *
+ * @param code the method's bytecode
+ * @param code_length the number of bytes in the bytecode
+ * @param start the offset of the first instruction in the range
+ * @param end the offset just past the range
+ */
+bool has_branch_target(const u1 *code, u4 code_length, u4 start, u4 end);
+
+/**
+ * Checks whether the offsets in a method's bytecode can be changed by inserting
+ * instructions. Switches (whose padding depends on their offset), jsr, ret,
+ * goto_w and wide are not relocated.
+ */
+bool can_relocate(const code_t *code);
+
+/**
+ * Inserts an instruction into a method's bytecode, moving the instructions from
+ * `at` on. Branches to `at` run the inserted instruction, and exception handlers
+ * that cover the instruction at `at` also cover it. The code must pass can_relocate().
+ *
+ * @param code the method's code
+ * @param at the offset to insert the instruction at
+ * @param instruction the instruction and its operands
+ * @param length the number of bytes of the instruction
+ * @return false if a branch offset would no longer fit in 16 bits,
+ *         in which case the code is unchanged
+ */
+bool insert_instruction(code_t *code, u4 at, const u1 *instruction, u4 length);
+
+/**
+ * Reads the local variable index of a load, e.g. an iload or iload_<n>.
+ *
+ * @param code the method's bytecode
+ * @param pc the offset of the instruction
+ * @param load the opcode of the load with an index operand
+ * @param load_0 the opcode of the load of local 0, followed by those of locals 1 to 3
+ * @param index set to the local variable index
+ * @return the length of the load, or 0 if the instruction is not one
+ */
+u4 load_index(const u1 *code, u4 pc, u1 load, u1 load_0, u2 *index);
+
+/**
+ * Checks whether an instruction stores to a local variable, including
+ * the second local of a long or double.
+ *
+ * @param code the method's bytecode
+ * @param pc the offset of the instruction
+ * @param index the local variable index
+ */
+bool writes_local(const u1 *code, u4 pc, u2 index);
+
+/** Checks whether an instruction is a branch with a 16-bit offset */
+static inline bool is_branch(u1 opcode) {
+    // ifs, if_icmps, if_acmps and goto, then ifnull and ifnonnull
+    return (0x99 <= opcode && opcode <= 0xa7) || opcode == 0xc6 || opcode == 0xc7;
+}
+
+/**
+ * Reads the signed 16-bit branch offset of a branch instruction.
+ *
+ * @param code the method's bytecode
+ * @param pc the offset of the branch instruction
+ * @return the offset of the branch target relative to `pc`
+ */
+static inline int16_t branch_offset(const u1 *code, u4 pc) {
+    return (int16_t)(code[pc + 1] << 8 | code[pc + 2]);
+}
+
+/**
+ * Reads the unsigned 16-bit operand of an instruction, e.g. a constant pool index.
+ *
+ * @param code the method's bytecode
+ * @param pc the offset of the instruction
+ */
+static inline u2 operand_index(const u1 *code, u4 pc) {
+    return (u2)(code[pc + 1] << 8 | code[pc + 2]);
+}
+
+#endif /* BYTECODE_H */
@@ -0,0 +1,266 @@
+#include "call_graph.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bytecode.h"
+#include "class_loader.h"
+#include "dispatch.h"
+#include "jvm.h"
+#include "native.h"
+#include "read_class.h"
+#include "stack_map.h"
+#include "stats.h"
+
+/** The side effects of the built-in native methods of each class */
+static const struct {
+    const char *class_name;
+    u1 effects;
+} NATIVE_EFFECTS[] = {
+    {"java/lang/Object", 0},
+    {"java/lang/Math", 0},
+    {"java/lang/Integer", EFFECT_READS_HEAP},
+    {"java/lang/String", EFFECT_READS_HEAP},
+    {"java/lang/StringBuilder", EFFECT_READS_HEAP | EFFECT_WRITES_HEAP},
+    {"java/lang/Throwable", EFFECT_READS_HEAP | EFFECT_WRITES_HEAP},
+    {"java/io/PrintStream", EFFECT_READS_HEAP | EFFECT_IO},
+    {"teeny/Stdin", EFFECT_WRITES_HEAP | EFFECT_IO},
+    {"teeny/MappedFile", EFFECT_WRITES_HEAP | EFFECT_IO},
+};
+
+/** Gets the side effects of a native method; library functions could do anything */
+static u1 native_effects(const native_method_t *native) {
+    if (native->library_function == NULL) {
+        for (size_t i = 0; i < sizeof(NATIVE_EFFECTS) / sizeof(NATIVE_EFFECTS[0]); i++) {
+            if (strcmp(NATIVE_EFFECTS[i].class_name, native->class_name) == 0) {
+                return NATIVE_EFFECTS[i].effects;
+            }
+        }
+    }
+    return EFFECT_READS_HEAP | EFFECT_WRITES_HEAP | EFFECT_IO;
+}
+
+/** Gets the side effects of an instruction, apart from the methods it calls */
+static u1 instruction_effects(const class_file_t *class, const u1 *code, u4 pc) {
+    switch (code[pc]) {
+        case i_iaload:
+        case i_faload:
+        case i_daload:
+        case i_aaload:
+        case i_arraylength:
+        case i_getfield_int:
+        case i_getfield_reference:
+        case i_getfield_short:
+        case i_getfield_char:
+        case i_getfield_byte:
+        case i_getfield_double:
+            return EFFECT_READS_HEAP;
+        case i_iastore:
+        case i_fastore:
+        case i_dastore:
+        case i_aastore:
+        case i_putfield_int:
+        case i_putfield_short:
+        case i_putfield_byte:
+        case i_putfield_double:
+        case i_array_literal:
+        case i_newarray:
+        case i_anewarray:
+        case i_multianewarray:
+        case i_new_object:
+        case i_new_builder:
+        case i_concat:
+            return EFFECT_WRITES_HEAP;
+        case i_print_concat:
+        case i_print_builder:
+            return EFFECT_READS_HEAP | EFFECT_IO;
+        case i_invokenative:
+        case i_invokenative_virtual:
+        case i_invokelibrary:
+            return native_effects(class->resolved_natives[operand_index(code, pc)]);
+        default:
+            return 0;
+    }
+}
+
+/** The methods found reachable so far, which are also the worklist */
+typedef struct {
+    method_t **methods;
+    size_t count;
+} reachable_t;
+
+/** A call from one reachable method to another */
+typedef struct {
+    method_t *caller;
+    method_t *callee;
+} call_t;
+
+/** The calls between reachable methods */
+typedef struct {
+    call_t *calls;
+    size_t count;
+} call_graph_t;
+
+/**
+ * Adds a call to the call graph, and the callee to the reachable methods if it is new.
+ * A NULL caller only makes the callee reachable; a NULL callee is a native method.
+ */
+static void add_call(reachable_t *reachable, call_graph_t *graph, method_t *caller,
+                     method_t *callee) {
+    if (callee == NULL) {
+        return;
+    }
+    if (!callee->reachable) {
+        callee->reachable = true;
+        reachable->methods =
+            realloc(reachable->methods, sizeof(method_t *[reachable->count + 1]));
+        assert(reachable->methods != NULL && "Failed to allocate reachable methods");
+        reachable->methods[reachable->count++] = callee;
+    }
+    if (caller == NULL) {
+        return;
+    }
+    graph->calls = realloc(graph->calls, sizeof(call_t[graph->count + 1]));
+    assert(graph->calls != NULL && "Failed to allocate call graph");
+    graph->calls[graph->count++] = (call_t){.caller = caller, .callee = callee};
+}
+
+/**
+ * Adds the methods a virtual or interface call can dispatch to: the method
+ * in the vtable or itable of every loaded class that can be the receiver.
+ */
+static void add_virtual_calls(reachable_t *reachable, call_graph_t *graph, method_t *caller,
+                              const method_t *named) {
+    for (u2 id = 0; id < loaded_class_count(); id++) {
+        class_file_t *receiver = loaded_class(id);
+        if ((receiver->access_flags & IS_INTERFACE) != 0) {
+            continue;
+        }
+        if (named->selector != 0) {
+            for (u2 i = 0; receiver->itable != NULL && i <= receiver->itable_mask; i++) {
+                if (receiver->itable[i].selector == named->selector) {
+                    add_call(reachable, graph, caller, receiver->itable[i].method);
+                }
+            }
+        }
+        else if (is_subclass(receiver, named->class)) {
+            add_call(reachable, graph, caller, receiver->vtable[named->vtable_index]);
+        }
+    }
+}
+
+/**
+ * Adds the methods of loaded classes that an overridable native can dispatch to,
+ * e.g. getMessage() in subclasses of RuntimeException.
+ */
+static void add_override_calls(reachable_t *reachable, call_graph_t *graph, method_t *caller,
+                               const native_method_t *native) {
+    for (u2 id = 0; id < loaded_class_count(); id++) {
+        add_call(reachable, graph, caller,
+                 find_override(loaded_class(id), native->name, native->descriptor));
+    }
+}
+
+/** Adds the calls a method makes and computes the side effects of its own instructions */
+static void scan_method(reachable_t *reachable, call_graph_t *graph, method_t *method) {
+    const class_file_t *class = method->class;
+    const u1 *code = method->code.code;
+    for (u4 pc = 0; pc < method->code.code_length; pc += instruction_length(code, pc)) {
+        method->effects |= instruction_effects(class, code, pc);
+        switch (code[pc]) {
+            case i_invokestatic:
+            case i_invokespecial:
+                add_call(reachable, graph, method,
+                         class->resolved_methods[operand_index(code, pc)]);
+                break;
+            case i_invokevirtual_cached:
+            case i_invokeinterface_cached:
+                add_virtual_calls(reachable, graph, method,
+                                  class->inline_caches[operand_index(code, pc)].method);
+                break;
+            case i_invokenative_virtual:
+                add_override_calls(reachable, graph, method,
+                                   class->resolved_natives[operand_index(code, pc)]);
+                break;
+        }
+    }
+}
+
+/** Frees the bytecode of a method that cannot be called */
+static void strip_method(method_t *method) {
+    code_t *code = &method->code;
+    stats_strip_method(code->code_length +
+                       code->stack_map_count * (sizeof(stack_map_t) + reference_map_bytes(code)) +
+                       sizeof(exception_handler_t[code->handler_count]));
+    free(code->code);
+    free(code->stack_maps);
+    free(code->reference_maps);
+    free(code->handlers);
+    code->code = NULL;
+    code->code_length = 0;
+    code->stack_maps = NULL;
+    code->reference_maps = NULL;
+    code->stack_map_count = 0;
+    code->handlers = NULL;
+    code->handler_count = 0;
+}
+
+void analyze_program(method_t *main_method) {
+    reachable_t reachable = {.methods = NULL, .count = 0};
+    call_graph_t graph = {.calls = NULL, .count = 0};
+    add_call(&reachable, &graph, NULL, main_method);
+    for (size_t i = 0; i < reachable.count; i++) {
+        scan_method(&reachable, &graph, reachable.methods[i]);
+    }
+
+    // A method has the side effects of every method it calls,
+    // which takes several passes when calls are recursive
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 0; i < graph.count; i++) {
+            method_t *caller = graph.calls[i].caller;
+            u1 effects = caller->effects | graph.calls[i].callee->effects;
+            if (effects != caller->effects) {
+                caller->effects = effects;
+                changed = true;
+            }
+        }
+    }
+    free(reachable.methods);
+    free(graph.calls);
+
+    for (u2 id = 0; id < loaded_class_count(); id++) {
+        for (method_t *method = loaded_class(id)->methods; method->name != NULL; method++) {
+            if (!method->reachable && method->code.code != NULL) {
+                strip_method(method);
+            }
+        }
+    }
+}
+
+void print_effects(FILE *out) {
+    for (u2 id = 0; id < loaded_class_count(); id++) {
+        const class_file_t *class = loaded_class(id);
+        for (const method_t *method = class->methods; method->name != NULL; method++) {
+            if (!method->reachable) {
+                continue;
+            }
+            fprintf(out, "%s.%s%s", class->name, method->name, method->descriptor);
+            if (method->effects == 0) {
+                fprintf(out, " pure");
+            }
+            if ((method->effects & EFFECT_READS_HEAP) != 0) {
+                fprintf(out, " reads");
+            }
+            if ((method->effects & EFFECT_WRITES_HEAP) != 0) {
+                fprintf(out, " writes");
+            }
+            if ((method->effects & EFFECT_IO) != 0) {
+                fprintf(out, " io");
+            }
+            fprintf(out, "\n");
+        }
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef CALL_GRAPH_H
+#define CALL_GRAPH_H
+
+#include <stdio.h>
+
+#include "class_file.h"
+
+/**
+ * The side effects a call to a method may have, including those of the
+ * methods it calls, as flags of method_t's `effects`. A method with none
+ * of them is pure. Throwing an exception does not count as a side effect.
+ */
+/** The method reads arrays or fields */
+#define EFFECT_READS_HEAP 1
+/** The method writes arrays or fields, or allocates */
+#define EFFECT_WRITES_HEAP 2
+/** The method reads input or writes output */
+#define EFFECT_IO 4
+
+/**
+ * Builds the static call graph of the linked program, starting from main().
+ * Virtual and interface calls may call the method of any loaded class that
+ * can be the receiver. Computes the side effects of every reachable method
+ * and frees the bytecode of the unreachable ones, which can then no longer be called.
+ *
+ * @param main_method the program's main() method
+ */
+void analyze_program(method_t *main_method);
+
+/**
+ * Prints each method reachable from main() with its side effects,
+ * e.g. "Main.sum([I)I reads".
+ *
+ * @param out the stream to print to
+ */
+void print_effects(FILE *out);
+
+#endif /* CALL_GRAPH_H */
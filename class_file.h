@@ -11,6 +11,7 @@
  */
 
 #include <inttypes.h>
+#include <stdbool.h>
 
 /* Integer type aliases used in the JVM documentation.
  * You may use these aliases or the corresponding inttypes.h types. */
@@ -42,6 +43,41 @@ typedef struct {
     u4 attribute_length;
 } attribute_info;
 
+/**
+ * What is known about a method's frame at a safepoint,
+ * i.e. a point where execution may stop for the VM (see safepoint.h).
+ */
+typedef struct {
+    /** The bytecode offset of the safepoint */
+    u4 pc;
+    /** The number of values on the operand stack at the safepoint */
+    u2 stack_depth;
+    /**
+     * A bitmap of the slots holding references: bit i (of byte i / 8) is set if
+     * local variable i, or operand stack slot i - max_locals, holds a reference
+     * (see stack_map_is_reference())
+     */
+    const u1 *references;
+} stack_map_t;
+
+struct class_file;
+
+/** An entry of a method's exception table */
+typedef struct {
+    /** The bytecode offsets the handler covers: start_pc up to, but not including, end_pc */
+    u2 start_pc;
+    u2 end_pc;
+    /** The bytecode offset of the handler */
+    u2 handler_pc;
+    /** The constant pool index of the class of exceptions caught, or 0 for any exception */
+    u2 catch_type;
+    /**
+     * The class of exceptions caught, resolved by link_class().
+     * NULL if catch_type is 0 or names a class that cannot be loaded.
+     */
+    struct class_file *catch_class;
+} exception_handler_t;
+
 /** The JVM's representation of a Java method's code */
 typedef struct {
     /** The maximum number of ints that will be on the operand stack */
@@ -55,8 +91,26 @@ typedef struct {
      * See the project01 spec for how to interpret these bytes.
      */
     u1 *code;
+    /** The stack maps of the method's safepoints, sorted by pc */
+    stack_map_t *stack_maps;
+    /** The number of stack maps */
+    u2 stack_map_count;
+    /** The reference bitmaps of the stack maps, which they point into */
+    u1 *reference_maps;
+    /**
+     * The exception table, in the order of the class file: an exception is
+     * caught by the first handler that covers its pc and matches its class.
+     * It is only consulted when an exception is thrown.
+     */
+    exception_handler_t *handlers;
+    u2 handler_count;
 } code_t;
 
+struct native_method;
+struct concat_recipe;
+struct inline_cache;
+struct itable_entry;
+
 /** A Java method */
 typedef struct {
     /**
@@ -73,21 +127,65 @@ typedef struct {
      * https://docs.oracle.com/javase/specs/jvms/se12/html/jvms-4.html#jvms-4.3.2.
      */
     char *descriptor;
-    /** The method's bytecode (see the comments for `code_t`) */
+    /** The number of slots the parameters take, determined from the descriptor */
+    u2 parameter_count;
+    /** The method's access flags, e.g. IS_STATIC */
+    u2 access_flags;
+    /**
+     * The method's bytecode (see the comments for `code_t`).
+     * Native and abstract methods have no bytecode, so their code_length is 0.
+     */
     code_t code;
+    /** For native methods, the implementation bound by link_class() */
+    struct native_method *native;
+    /** The class declaring the method */
+    struct class_file *class;
+    /** For virtual methods, the method's index in its class's vtable */
+    u2 vtable_index;
+    /** For methods of interfaces, the selector identifying the method in itables */
+    u2 selector;
+    /** Whether the method can be called from main(), as found by analyze_program() */
+    bool reachable;
+    /** The EFFECT_* flags of the method's side effects, computed by analyze_program() */
+    u1 effects;
 } method_t;
 
+/** A field of a Java class */
+typedef struct {
+    /** The field name, e.g. "x" */
+    char *name;
+    /** The field descriptor, e.g. "I" */
+    char *descriptor;
+    /** The field's access flags, e.g. IS_STATIC */
+    u2 access_flags;
+    /**
+     * For instance fields, the byte offset of the field in an object's fields,
+     * assigned when the class is loaded (see class_loader.h)
+     */
+    u2 offset;
+} field_t;
+
 /**
  * Magic numbers the JVM uses to identify the types of constant pool entry.
  * You will only need to handle the CONSTANT_Integer case.
  */
 typedef enum {
+    /** The entry after a long or double constant, which takes up two entries */
+    CONSTANT_Unusable = 0,
     CONSTANT_Utf8 = 1,
     CONSTANT_Integer = 3,
+    CONSTANT_Float = 4,
+    CONSTANT_Long = 5,
+    CONSTANT_Double = 6,
     CONSTANT_Class = 7,
+    CONSTANT_String = 8,
     CONSTANT_Fieldref = 9,
     CONSTANT_Methodref = 10,
-    CONSTANT_NameAndType = 12
+    CONSTANT_InterfaceMethodref = 11,
+    CONSTANT_NameAndType = 12,
+    CONSTANT_MethodHandle = 15,
+    CONSTANT_MethodType = 16,
+    CONSTANT_InvokeDynamic = 18
 } cp_tag_t;
 
 typedef struct {
@@ -99,16 +197,68 @@ typedef struct {
     u2 name_and_type_index;
 } CONSTANT_FieldOrMethodref_info;
 
-/** The representation of an int in a constant pool entry */
+/** A string constant, whose characters are in a Utf8 constant */
+typedef struct {
+    u2 string_index;
+} CONSTANT_String_info;
+
+/** The representation of an int in a constant pool entry, also used for a float's bits */
 typedef struct {
     int32_t bytes;
 } CONSTANT_Integer_info;
 
+/**
+ * The representation of a long in a constant pool entry, also used for a double's bits.
+ * These constants take up two entries; the second is CONSTANT_Unusable.
+ */
+typedef struct {
+    uint64_t bytes;
+} CONSTANT_Long_info;
+
 typedef struct {
     u2 name_index;
     u2 descriptor_index;
 } CONSTANT_NameAndType_info;
 
+typedef struct {
+    u1 reference_kind;
+    u2 reference_index;
+} CONSTANT_MethodHandle_info;
+
+typedef struct {
+    u2 descriptor_index;
+} CONSTANT_MethodType_info;
+
+typedef struct {
+    /** The index of the call site's bootstrap method in the BootstrapMethods attribute */
+    u2 bootstrap_method_attr_index;
+    u2 name_and_type_index;
+} CONSTANT_InvokeDynamic_info;
+
+/** An entry of the BootstrapMethods attribute, used by invokedynamic */
+typedef struct {
+    /** The index of the bootstrap method's MethodHandle constant */
+    u2 bootstrap_method_ref;
+    /** The constants passed to the bootstrap method */
+    u2 num_bootstrap_arguments;
+    u2 *bootstrap_arguments;
+} bootstrap_method_t;
+
+/**
+ * The constant elements of an array initializer, e.g. `{5, 1, 6}`,
+ * which link_class() extracts from its dup, index, value, store sequences
+ */
+typedef struct {
+    /** The number of bytes of bytecode the initializer replaces */
+    u4 code_length;
+    /** The number of elements, which are stored at indices 0 to element_count - 1 */
+    u4 element_count;
+    /** The element values, taking array_element_ints() ints each like in the array */
+    int32_t *values;
+    /** The array's `atype`, e.g. 10 for int */
+    u1 type;
+} array_literal_t;
+
 /** An entry in a class file's constant pool */
 typedef struct {
     /** The type of constant, which determines how to interpret `info` */
@@ -122,7 +272,16 @@ typedef struct {
 } cp_info;
 
 /** A class file, consisting of an array of constants and an array of methods */
-typedef struct {
+typedef struct class_file {
+    /** The internal name of the class, e.g. "Collatz" */
+    const char *name;
+    /** The internal name of the superclass, e.g. "java/lang/Object" */
+    const char *super_name;
+    /** The class's access flags, e.g. IS_INTERFACE */
+    u2 access_flags;
+    /** The internal names of the interfaces the class implements (or extends) */
+    const char **interface_names;
+    u2 interface_count;
     /**
      * The class's array of constants.
      * Note that this array is 0-indexed, but the bytecode refers to 1-indexed constants.
@@ -134,6 +293,67 @@ typedef struct {
      * The array is "null-terminated": `methods[length].name == NULL`.
      */
     method_t *methods;
+    /** The class's fields, in the order they are declared */
+    field_t *fields;
+    u2 field_count;
+    /** The class's bootstrap methods, for invokedynamic */
+    bootstrap_method_t *bootstrap_methods;
+    u2 bootstrap_method_count;
+    /**
+     * What each Methodref constant resolves to, indexed like the bytecode
+     * (1-indexed): a method of this class or a native method.
+     * Filled in by link_class(); unresolved or non-Methodref entries are NULL.
+     */
+    method_t **resolved_methods;
+    const struct native_method **resolved_natives;
+    /**
+     * The string object of each String constant, indexed like the bytecode.
+     * Each is interned by the first ldc of the constant (see string_intern());
+     * until then it is 0.
+     */
+    int32_t *resolved_strings;
+    /**
+     * The recipe of each InvokeDynamic constant for string concatenation,
+     * indexed like the bytecode. Filled in by link_class().
+     */
+    struct concat_recipe **resolved_concats;
+    /**
+     * The fields below are filled in by the class loader (see class_loader.h).
+     * The loaded superclass, or NULL if it is java/lang/Object.
+     */
+    struct class_file *super_class;
+    /** The class's index in the table of loaded classes, stored in its objects */
+    u2 id;
+    /** The number of bytes of instance fields in an object, including inherited ones */
+    u2 instance_size;
+    /** The offsets of the instance fields holding references, including inherited ones */
+    u2 *reference_offsets;
+    u2 reference_count;
+    /** The loaded interfaces the class implements, like `interface_names` */
+    struct class_file **interfaces;
+    /** The virtual methods objects of the class dispatch to, by vtable index */
+    method_t **vtable;
+    u2 vtable_length;
+    /**
+     * The methods objects of the class dispatch to for each interface method,
+     * as a hash table of itable_mask + 1 entries keyed by selector (see dispatch.h)
+     */
+    struct itable_entry *itable;
+    u2 itable_mask;
+    /**
+     * The inline caches of the class's invokevirtual call sites,
+     * indexed by the operand of the quickened instruction. Filled in by link_class().
+     */
+    struct inline_cache *inline_caches;
+    u2 inline_cache_count;
+    /**
+     * The constant array initializers of the class's methods, indexed by the
+     * operand of array_literal. Filled in by link_class().
+     */
+    array_literal_t *array_literals;
+    u2 array_literal_count;
+    /** Whether link_class() has run on the class */
+    bool linked;
 } class_file_t;
 
 #endif /* CLASS_FILE_H */
@@ -0,0 +1,318 @@
+#include "class_loader.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dispatch.h"
+#include "image.h"
+#include "link.h"
+#include "native.h"
+#include "read_class.h"
+#include "stats.h"
+
+/** The loaded classes, indexed by id */
+static class_file_t **classes = NULL;
+static u2 class_count = 0;
+
+/** The directory that class names are relative to, e.g. "dir/" */
+static char *class_path = NULL;
+/** The path of the main class's file, which may not be named after the class */
+static const char *main_class_path = NULL;
+
+/**
+ * The classes of exceptions built into the VM, with their superclasses.
+ * Superclasses come first, so loading a class only loads earlier ones.
+ */
+static const char *const BUILTIN_CLASSES[][2] = {
+    {"java/lang/Throwable", "java/lang/Object"},
+    {"java/lang/Exception", "java/lang/Throwable"},
+    {"java/lang/Error", "java/lang/Throwable"},
+    {"java/lang/LinkageError", "java/lang/Error"},
+    {"java/lang/IncompatibleClassChangeError", "java/lang/LinkageError"},
+    {"java/lang/NoSuchMethodError", "java/lang/IncompatibleClassChangeError"},
+    {"java/lang/UnsatisfiedLinkError", "java/lang/LinkageError"},
+    {"java/lang/RuntimeException", "java/lang/Exception"},
+    {"java/lang/ArithmeticException", "java/lang/RuntimeException"},
+    {"java/lang/IllegalArgumentException", "java/lang/RuntimeException"},
+    {"java/lang/NumberFormatException", "java/lang/IllegalArgumentException"},
+    {"java/lang/IllegalStateException", "java/lang/RuntimeException"},
+    {"java/lang/IndexOutOfBoundsException", "java/lang/RuntimeException"},
+    {"java/lang/ArrayIndexOutOfBoundsException", "java/lang/IndexOutOfBoundsException"},
+    {"java/lang/StringIndexOutOfBoundsException", "java/lang/IndexOutOfBoundsException"},
+    {"java/lang/NegativeArraySizeException", "java/lang/RuntimeException"},
+    {"java/lang/NullPointerException", "java/lang/RuntimeException"},
+    {"java/lang/UnsupportedOperationException", "java/lang/RuntimeException"},
+    {"java/nio/ReadOnlyBufferException", "java/lang/UnsupportedOperationException"},
+    {"java/util/NoSuchElementException", "java/lang/RuntimeException"},
+    {"java/util/InputMismatchException", "java/util/NoSuchElementException"},
+};
+
+/** The only field of Throwable, and so the first field of every exception */
+static const field_t THROWABLE_FIELDS[] = {
+    {.name = "message", .descriptor = "Ljava/lang/String;", .access_flags = 0, .offset = 0},
+};
+
+/**
+ * Creates a built-in class, which has no methods of its own: its constructors
+ * and methods are native methods of Throwable (see native.c).
+ *
+ * @return the class, or NULL if there is no built-in class with the name
+ */
+static class_file_t *builtin_class(const char *name) {
+    size_t index = 0;
+    size_t count = sizeof(BUILTIN_CLASSES) / sizeof(BUILTIN_CLASSES[0]);
+    while (index < count && strcmp(BUILTIN_CLASSES[index][0], name) != 0) {
+        index++;
+    }
+    if (index == count) {
+        return NULL;
+    }
+    class_file_t *class = calloc(1, sizeof(*class));
+    assert(class != NULL && "Failed to allocate class");
+    class->name = BUILTIN_CLASSES[index][0];
+    class->super_name = BUILTIN_CLASSES[index][1];
+    class->access_flags = 0;
+    // An empty constant pool and method list, each with its terminator
+    class->constant_pool = calloc(1, sizeof(cp_info));
+    class->methods = calloc(1, sizeof(method_t));
+    class->interface_names = malloc(sizeof(char *));
+    class->field_count = index == 0;
+    class->fields = malloc(sizeof(THROWABLE_FIELDS));
+    assert(class->constant_pool != NULL && class->methods != NULL &&
+           class->interface_names != NULL && class->fields != NULL &&
+           "Failed to allocate built-in class");
+    memcpy(class->fields, THROWABLE_FIELDS, sizeof(THROWABLE_FIELDS));
+    return class;
+}
+
+/** The number of bytes a field of a type occupies in an object */
+static u2 field_size(const char *descriptor) {
+    switch (descriptor[0]) {
+        case 'J':
+        case 'D':
+            return 8;
+        case 'S':
+        case 'C':
+            return 2;
+        case 'B':
+        case 'Z':
+            return 1;
+        default:
+            // int, float and references
+            return 4;
+    }
+}
+
+/**
+ * Assigns each instance field an offset after the superclass's fields.
+ * The widest fields come first, so each field is aligned to its size
+ * without padding between fields.
+ */
+static void layout_fields(class_file_t *class) {
+    const class_file_t *super = class->super_class;
+    size_t offset = super != NULL ? super->instance_size : 0;
+    u2 reference_count = super != NULL ? super->reference_count : 0;
+    for (u2 i = 0; i < class->field_count; i++) {
+        const field_t *field = &class->fields[i];
+        if ((field->access_flags & IS_STATIC) == 0 &&
+            (field->descriptor[0] == 'L' || field->descriptor[0] == '[')) {
+            reference_count++;
+        }
+    }
+    class->reference_offsets = malloc(sizeof(u2[reference_count + 1]));
+    assert(class->reference_offsets != NULL && "Failed to allocate reference offsets");
+    stats_add_bytes(MEM_CODE_CACHE, sizeof(u2[reference_count + 1]));
+    if (super != NULL) {
+        memcpy(class->reference_offsets, super->reference_offsets,
+               sizeof(u2[super->reference_count]));
+        class->reference_count = super->reference_count;
+    }
+
+    for (u2 size = 8; size > 0; size /= 2) {
+        for (u2 i = 0; i < class->field_count; i++) {
+            field_t *field = &class->fields[i];
+            if ((field->access_flags & IS_STATIC) != 0 || field_size(field->descriptor) != size) {
+                continue;
+            }
+            // Only the first field can need padding after the superclass's fields
+            offset = (offset + size - 1) & ~(size_t) (size - 1);
+            field->offset = offset;
+            if (field->descriptor[0] == 'L' || field->descriptor[0] == '[') {
+                class->reference_offsets[class->reference_count++] = offset;
+            }
+            offset += size;
+        }
+    }
+    assert(offset <= UINT16_MAX && "Too many instance fields");
+    class->instance_size = offset;
+}
+
+/** Adds a parsed class to the loaded classes and prepares it for linking */
+static class_file_t *add_class(class_file_t *class) {
+    classes = realloc(classes, sizeof(class_file_t *[class_count + 1]));
+    assert(classes != NULL && "Failed to allocate loaded classes");
+    class->id = class_count;
+    classes[class_count++] = class;
+    // The superclass's fields come first in an object
+    if (class->super_name != NULL) {
+        class->super_class = load_class(class->super_name);
+    }
+    class->interfaces = malloc(sizeof(class_file_t *[class->interface_count + 1]));
+    assert(class->interfaces != NULL && "Failed to allocate interfaces");
+    for (u2 i = 0; i < class->interface_count; i++) {
+        class->interfaces[i] = load_class(class->interface_names[i]);
+    }
+    layout_fields(class);
+    if ((class->access_flags & IS_INTERFACE) != 0) {
+        assign_selectors(class);
+    }
+    else {
+        build_vtable(class);
+        build_itable(class);
+    }
+    // Bind the class's native methods before calls to them are resolved
+    for (method_t *method = class->methods; method->name != NULL; method++) {
+        if ((method->access_flags & IS_NATIVE) != 0) {
+            method->native = bind_library_method(class, method);
+        }
+    }
+    return class;
+}
+
+/**
+ * Opens the class file of a class: the class file embedded in the application
+ * image, or else the one under the class path.
+ *
+ * @return the open file, or NULL if the class has no class file
+ */
+static FILE *open_class_file(const char *name) {
+    if (image_embedded()) {
+        const image_class_t *embedded = image_find_class(name);
+        // The stream only reads the bytes, though fmemopen() takes a mutable buffer
+        return embedded != NULL ? fmemopen((void *) embedded->bytes, embedded->length, "r")
+                                : NULL;
+    }
+    char path[strlen(class_path) + strlen(name) + sizeof(".class")];
+    sprintf(path, "%s%s.class", class_path, name);
+    return fopen(path, "r");
+}
+
+class_file_t *load_main_class(const char *path) {
+    main_class_path = path;
+    FILE *class_file = fopen(path, "r");
+    if (class_file == NULL) {
+        fprintf(stderr, "Failed to open %s\n", path);
+        exit(1);
+    }
+    class_file_t *class = get_class(class_file);
+    int error = fclose(class_file);
+    assert(error == 0 && "Failed to close file");
+
+    // The class path is the path without the class's name, e.g. "dir/" for
+    // "dir/pkg/Main.class" containing pkg/Main
+    size_t path_length = strlen(path);
+    size_t name_length = strlen(class->name) + strlen(".class");
+    size_t root_length = path_length;
+    if (path_length >= name_length &&
+        strncmp(path + path_length - name_length, class->name, strlen(class->name)) == 0) {
+        root_length = path_length - name_length;
+    }
+    else {
+        // The file is named differently, so look for classes in its directory
+        const char *slash = strrchr(path, '/');
+        root_length = slash != NULL ? (size_t) (slash - path + 1) : 0;
+    }
+    class_path = malloc(root_length + 1);
+    assert(class_path != NULL && "Failed to allocate class path");
+    memcpy(class_path, path, root_length);
+    class_path[root_length] = '\0';
+
+    return add_class(class);
+}
+
+class_file_t *load_class(const char *name) {
+    for (u2 id = 0; id < class_count; id++) {
+        if (strcmp(classes[id]->name, name) == 0) {
+            return classes[id];
+        }
+    }
+
+    FILE *class_file = open_class_file(name);
+    if (class_file == NULL) {
+        class_file_t *builtin = builtin_class(name);
+        return builtin != NULL ? add_class(builtin) : NULL;
+    }
+    class_file_t *class = get_class(class_file);
+    int error = fclose(class_file);
+    assert(error == 0 && "Failed to close file");
+    assert(strcmp(class->name, name) == 0 && "Class file contains the wrong class");
+    return add_class(class);
+}
+
+void link_classes(void) {
+    // The exceptions the VM throws itself are loaded before any code runs
+    load_class("java/lang/ArithmeticException");
+    load_class("java/lang/ArrayIndexOutOfBoundsException");
+    load_class("java/lang/NegativeArraySizeException");
+    // Linking may load more classes, which are linked in turn
+    for (u2 id = 0; id < class_count; id++) {
+        if (!classes[id]->linked) {
+            classes[id]->linked = true;
+            link_class(classes[id]);
+        }
+    }
+}
+
+class_file_t *loaded_class(u2 id) {
+    assert(id < class_count && "Invalid class id");
+    return classes[id];
+}
+
+u2 loaded_class_count(void) {
+    return class_count;
+}
+
+FILE *open_loaded_class_file(u2 id) {
+    assert(id < class_count && "Invalid class id");
+    if (id == 0 && main_class_path != NULL) {
+        return fopen(main_class_path, "r");
+    }
+    return open_class_file(classes[id]->name);
+}
+
+bool is_subclass(const class_file_t *class, const class_file_t *super) {
+    for (; class != NULL; class = class->super_class) {
+        if (class == super) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const field_t *find_field(const class_file_t *class, const char *name,
+                          const char *descriptor) {
+    for (; class != NULL; class = class->super_class) {
+        for (u2 i = 0; i < class->field_count; i++) {
+            const field_t *field = &class->fields[i];
+            if (strcmp(field->name, name) == 0 && strcmp(field->descriptor, descriptor) == 0) {
+                return field;
+            }
+        }
+    }
+    return NULL;
+}
+
+void free_classes(void) {
+    for (u2 id = 0; id < class_count; id++) {
+        free_class(classes[id]);
+    }
+    free(classes);
+    free(class_path);
+    free_selectors();
+    classes = NULL;
+    class_count = 0;
+    class_path = NULL;
+    main_class_path = NULL;
+}
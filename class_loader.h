@@ -0,0 +1,83 @@
+#ifndef CLASS_LOADER_H
+#define CLASS_LOADER_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "class_file.h"
+
+/**
+ * Loads the class file the program starts with. Other classes are loaded
+ * from the same class path root, e.g. "dir/Main$Point.class" for "dir/Main.class".
+ * Exits with an error if the file cannot be opened.
+ *
+ * @param path the path of the class file
+ * @return the class, which is not linked yet (see link_classes())
+ */
+class_file_t *load_main_class(const char *path);
+
+/**
+ * Loads a class by name, along with its superclasses and interfaces, lays out
+ * its instance fields and builds its vtable and itable (see dispatch.h).
+ * Loading a class that is already loaded returns it again.
+ *
+ * @param name the internal name of the class, e.g. "Main$Point"
+ * Classes without a class file may be built into the VM, like the common
+ * exceptions of java/lang and java/util (e.g. java/lang/ArithmeticException).
+ * An application image only loads the class files embedded in it (see image.h).
+ *
+ * @return the class, or NULL if there is no such class (e.g. java/lang/Object)
+ */
+class_file_t *load_class(const char *name);
+
+/**
+ * Links every loaded class that is not linked yet, including the classes
+ * loaded while linking.
+ */
+void link_classes(void);
+
+/**
+ * Gets a loaded class by its id, e.g. the class of an object.
+ */
+class_file_t *loaded_class(u2 id);
+
+/**
+ * Gets the number of loaded classes. Their ids are 0 to the count - 1,
+ * with the main class's id being 0.
+ */
+u2 loaded_class_count(void);
+
+/**
+ * Opens the class file a loaded class was read from, e.g. to embed it in an image.
+ *
+ * @return the open file, or NULL if the class is built into the VM
+ */
+FILE *open_loaded_class_file(u2 id);
+
+/**
+ * Checks whether a class is a subclass of another class or the class itself.
+ */
+bool is_subclass(const class_file_t *class, const class_file_t *super);
+
+/**
+ * Finds a field declared by a class or one of its superclasses.
+ *
+ * @return the field, or NULL if there is no such field
+ */
+const field_t *find_field(const class_file_t *class, const char *name, const char *descriptor);
+
+/**
+ * Gets the number of bytes an object of a class occupies: a one-int header
+ * holding the class's id, followed by the instance fields.
+ */
+static inline size_t object_bytes(const class_file_t *class) {
+    size_t field_ints = (class->instance_size + sizeof(int32_t) - 1) / sizeof(int32_t);
+    return sizeof(int32_t[1 + field_ints]);
+}
+
+/**
+ * Frees every loaded class.
+ */
+void free_classes(void);
+
+#endif /* CLASS_LOADER_H */
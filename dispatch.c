@@ -0,0 +1,241 @@
+#include "dispatch.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "class_loader.h"
+#include "read_class.h"
+
+/** The signature of each selector, indexed by selector - 1 */
+typedef struct {
+    const char *name;
+    const char *descriptor;
+} selector_t;
+
+static selector_t *selectors = NULL;
+static u2 selector_count = 0;
+
+bool is_virtual(const method_t *method) {
+    return (method->access_flags & (IS_STATIC | IS_PRIVATE)) == 0 &&
+           strcmp(method->name, "<init>") != 0;
+}
+
+void build_vtable(class_file_t *class) {
+    const class_file_t *super = class->super_class;
+    u2 method_count = 0;
+    for (const method_t *method = class->methods; method->name != NULL; method++) {
+        method_count++;
+    }
+    u2 super_length = super != NULL ? super->vtable_length : 0;
+    class->vtable = malloc(sizeof(method_t *[super_length + method_count + 1]));
+    assert(class->vtable != NULL && "Failed to allocate vtable");
+    stats_add_bytes(MEM_CODE_CACHE, sizeof(method_t *[super_length + method_count + 1]));
+    if (super != NULL) {
+        memcpy(class->vtable, super->vtable, sizeof(method_t *[super_length]));
+    }
+    class->vtable_length = super_length;
+
+    for (method_t *method = class->methods; method->name != NULL; method++) {
+        if (!is_virtual(method)) {
+            continue;
+        }
+        // An overriding method takes the overridden method's index
+        u2 index = 0;
+        while (index < super_length &&
+               (strcmp(class->vtable[index]->name, method->name) != 0 ||
+                strcmp(class->vtable[index]->descriptor, method->descriptor) != 0)) {
+            index++;
+        }
+        if (index == super_length) {
+            index = class->vtable_length++;
+        }
+        method->vtable_index = index;
+        class->vtable[index] = method;
+    }
+}
+
+method_t *find_override(const class_file_t *class, const char *name,
+                        const char *descriptor) {
+    // Built-in classes have empty vtables, so only a class file's methods are found
+    for (u2 i = 0; i < class->vtable_length; i++) {
+        if (strcmp(class->vtable[i]->name, name) == 0 &&
+            strcmp(class->vtable[i]->descriptor, descriptor) == 0) {
+            return class->vtable[i];
+        }
+    }
+    return NULL;
+}
+
+void assign_selectors(class_file_t *interface) {
+    for (method_t *method = interface->methods; method->name != NULL; method++) {
+        if ((method->access_flags & IS_STATIC) != 0) {
+            continue;
+        }
+        u2 index = 0;
+        while (index < selector_count &&
+               (strcmp(selectors[index].name, method->name) != 0 ||
+                strcmp(selectors[index].descriptor, method->descriptor) != 0)) {
+            index++;
+        }
+        if (index == selector_count) {
+            selectors = realloc(selectors, sizeof(selector_t[selector_count + 1]));
+            assert(selectors != NULL && "Failed to allocate selectors");
+            stats_add_bytes(MEM_CODE_CACHE, sizeof(selector_t));
+            selectors[selector_count++] =
+                (selector_t){.name = method->name, .descriptor = method->descriptor};
+        }
+        method->selector = index + 1;
+    }
+}
+
+/**
+ * Adds the selectors of an interface's methods and its superinterfaces'
+ * methods to a list, if they are not in it yet.
+ */
+static void collect_selectors(const class_file_t *interface, u2 **list, u2 *count) {
+    for (const method_t *method = interface->methods; method->name != NULL; method++) {
+        if (method->selector == 0) {
+            continue;
+        }
+        u2 i = 0;
+        while (i < *count && (*list)[i] != method->selector) {
+            i++;
+        }
+        if (i == *count) {
+            *list = realloc(*list, sizeof(u2[*count + 1]));
+            assert(*list != NULL && "Failed to allocate selectors");
+            (*list)[(*count)++] = method->selector;
+        }
+    }
+    for (u2 i = 0; i < interface->interface_count; i++) {
+        if (interface->interfaces[i] != NULL) {
+            collect_selectors(interface->interfaces[i], list, count);
+        }
+    }
+}
+
+/** Finds a default method with a selector in an interface or its superinterfaces */
+static method_t *find_default_method(const class_file_t *interface, u2 selector) {
+    for (method_t *method = interface->methods; method->name != NULL; method++) {
+        if (method->selector == selector && (method->access_flags & IS_ABSTRACT) == 0) {
+            return method;
+        }
+    }
+    for (u2 i = 0; i < interface->interface_count; i++) {
+        if (interface->interfaces[i] != NULL) {
+            method_t *method = find_default_method(interface->interfaces[i], selector);
+            if (method != NULL) {
+                return method;
+            }
+        }
+    }
+    return NULL;
+}
+
+/** Finds the method a class dispatches an interface method to */
+static method_t *implement_selector(const class_file_t *class, u2 selector) {
+    const selector_t *signature = &selectors[selector - 1];
+    for (u2 i = 0; i < class->vtable_length; i++) {
+        method_t *method = class->vtable[i];
+        if (strcmp(method->name, signature->name) == 0 &&
+            strcmp(method->descriptor, signature->descriptor) == 0) {
+            return method;
+        }
+    }
+    for (const class_file_t *super = class; super != NULL; super = super->super_class) {
+        for (u2 i = 0; i < super->interface_count; i++) {
+            if (super->interfaces[i] != NULL) {
+                method_t *method = find_default_method(super->interfaces[i], selector);
+                if (method != NULL) {
+                    return method;
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+void build_itable(class_file_t *class) {
+    u2 *list = NULL;
+    u2 count = 0;
+    for (const class_file_t *super = class; super != NULL; super = super->super_class) {
+        for (u2 i = 0; i < super->interface_count; i++) {
+            if (super->interfaces[i] != NULL) {
+                collect_selectors(super->interfaces[i], &list, &count);
+            }
+        }
+    }
+
+    // Keep the table at most half full, so probes are short and end at an empty entry
+    size_t size = 1;
+    while (size < 2 * (size_t) count + 1) {
+        size *= 2;
+    }
+    assert(size <= UINT16_MAX && "Too many interface methods");
+    class->itable = calloc(size, sizeof(itable_entry_t));
+    assert(class->itable != NULL && "Failed to allocate itable");
+    stats_add_bytes(MEM_CODE_CACHE, sizeof(itable_entry_t[size]));
+    class->itable_mask = size - 1;
+    for (u2 i = 0; i < count; i++) {
+        u2 slot = list[i] & class->itable_mask;
+        while (class->itable[slot].selector != 0) {
+            slot = (slot + 1) & class->itable_mask;
+        }
+        class->itable[slot] =
+            (itable_entry_t){.selector = list[i], .method = implement_selector(class, list[i])};
+    }
+    free(list);
+}
+
+void free_selectors(void) {
+    free(selectors);
+    selectors = NULL;
+    selector_count = 0;
+}
+
+/** Finds the method a class dispatches an interface method to in its itable */
+static method_t *itable_lookup(const class_file_t *class, u2 selector) {
+    for (u2 slot = selector & class->itable_mask;; slot = (slot + 1) & class->itable_mask) {
+        const itable_entry_t *entry = &class->itable[slot];
+        if (entry->selector == selector) {
+            return entry->method;
+        }
+        assert(entry->selector != 0 && "Receiver does not implement the interface");
+    }
+}
+
+method_t *inline_cache_miss(inline_cache_t *cache, u2 receiver_class) {
+    for (u2 i = 1; i < cache->entry_count; i++) {
+        if (cache->receiver_classes[i] == receiver_class) {
+            stats_count_dispatch(DISPATCH_POLYMORPHIC_HIT);
+            return cache->targets[i];
+        }
+    }
+
+    const class_file_t *class = loaded_class(receiver_class);
+    method_t *target;
+    if (cache->method->selector != 0) {
+        target = itable_lookup(class, cache->method->selector);
+    }
+    else {
+        assert(cache->method->vtable_index < class->vtable_length &&
+               "Receiver does not have the called method");
+        target = class->vtable[cache->method->vtable_index];
+    }
+    if (target == NULL || (target->access_flags & IS_ABSTRACT) != 0) {
+        fprintf(stderr, "AbstractMethodError: %s.%s%s\n", class->name, cache->method->name,
+                cache->method->descriptor);
+        exit(1);
+    }
+    if (cache->entry_count == INLINE_CACHE_ENTRIES) {
+        stats_count_dispatch(DISPATCH_MEGAMORPHIC);
+        return target;
+    }
+    stats_count_dispatch(DISPATCH_MISS);
+    cache->receiver_classes[cache->entry_count] = receiver_class;
+    cache->targets[cache->entry_count] = target;
+    cache->entry_count++;
+    return target;
+}
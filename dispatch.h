@@ -0,0 +1,111 @@
+#ifndef DISPATCH_H
+#define DISPATCH_H
+
+#include "class_file.h"
+#include "stats.h"
+
+/** The number of receiver classes an inline cache remembers before it is megamorphic */
+#define INLINE_CACHE_ENTRIES 4
+
+/**
+ * An entry of an itable: the method objects of a class dispatch to for an
+ * interface method. Itables are hash tables with linear probing, keyed by
+ * the interface method's selector; every signature of an interface method
+ * has its own selector, numbered from 1.
+ */
+typedef struct itable_entry {
+    /** The interface method's selector, or 0 for an empty entry */
+    u2 selector;
+    /** The implementing method, or NULL if the class does not implement it */
+    method_t *method;
+} itable_entry_t;
+
+/**
+ * The inline cache of an invokevirtual or invokeinterface call site: the receiver classes seen at
+ * the site and the methods they dispatched to, in the order they were seen.
+ */
+typedef struct inline_cache {
+    /**
+     * The method named by the call site, which gives the arity and either the
+     * vtable index or, for methods of interfaces, the selector
+     */
+    method_t *method;
+    /** The number of cached receiver classes */
+    u2 entry_count;
+    /** The ids of the cached receiver classes */
+    u2 receiver_classes[INLINE_CACHE_ENTRIES];
+    /** The method each cached receiver class dispatches to */
+    method_t *targets[INLINE_CACHE_ENTRIES];
+} inline_cache_t;
+
+/**
+ * Checks whether a method is dispatched through vtables: an instance method
+ * that is not private and not a constructor.
+ */
+bool is_virtual(const method_t *method);
+
+/**
+ * Builds a class's vtable: its superclass's vtable, with the methods the
+ * class overrides replaced and its other virtual methods appended.
+ * The superclass's vtable must already be built.
+ */
+void build_vtable(class_file_t *class);
+
+/**
+ * Finds the method a class loaded from a class file declares or inherits to override
+ * a virtual native method of a built-in superclass, e.g. a subclass of RuntimeException
+ * overriding Throwable.getMessage().
+ *
+ * @return the overriding method, or NULL if the class inherits the native method
+ */
+method_t *find_override(const class_file_t *class, const char *name,
+                        const char *descriptor);
+
+/**
+ * Gives each instance method of an interface the selector of its name and
+ * descriptor, so that methods with the same signature share a selector.
+ */
+void assign_selectors(class_file_t *interface);
+
+/**
+ * Builds a class's itable from the interfaces it and its superclasses
+ * implement, directly or through other interfaces. Each interface method
+ * dispatches to the class's virtual method with the same signature, or
+ * else to a default method of an interface.
+ * The class's vtable must already be built.
+ */
+void build_itable(class_file_t *class);
+
+/**
+ * Frees the selectors assigned by assign_selectors().
+ */
+void free_selectors(void);
+
+/**
+ * Finds the method a virtual or interface call dispatches to when the receiver's class
+ * is not the first one cached at the call site, updating the cache.
+ *
+ * @param cache the call site's inline cache
+ * @param receiver_class the id of the receiver's class
+ * @return the method to invoke
+ */
+method_t *inline_cache_miss(inline_cache_t *cache, u2 receiver_class);
+
+/**
+ * Finds the method a virtual call dispatches to. The common case, a call
+ * site that has only seen one receiver class, takes one comparison.
+ *
+ * @param cache the call site's inline cache
+ * @param receiver_class the id of the receiver's class
+ * @return the method to invoke
+ */
+static inline method_t *inline_cache_lookup(inline_cache_t *cache, u2 receiver_class) {
+    if (__builtin_expect(cache->entry_count > 0 && cache->receiver_classes[0] == receiver_class,
+                         1)) {
+        stats_count_dispatch(DISPATCH_MONOMORPHIC_HIT);
+        return cache->targets[0];
+    }
+    return inline_cache_miss(cache, receiver_class);
+}
+
+#endif /* DISPATCH_H */
@@ -0,0 +1,8 @@
+#include "image.h"
+
+/** The plain VM loads every class from its class file */
+const image_class_t IMAGE_CLASSES[] = {
+    {.name = NULL},
+};
+
+const char *const IMAGE_STRIPPED_METHODS[] = {NULL};
@@ -0,0 +1,70 @@
+#include "exception.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "class_loader.h"
+#include "frame.h"
+#include "java_string.h"
+#include "metrics.h"
+#include "output.h"
+#include "quota.h"
+#include "stats.h"
+
+/** Gets the class of an exception from the id in its header */
+static const class_file_t *exception_class(heap_t *heap, int32_t exception) {
+    return loaded_class(heap_get(heap, exception)[0]);
+}
+
+int32_t exception_new(heap_t *heap, const char *class_name, const char *message) {
+    const class_file_t *class = load_class(class_name);
+    assert(class != NULL && "Missing built-in exception class");
+    size_t bytes = object_bytes(class);
+    quota_charge_heap(bytes, current_frame);
+    stats_add_bytes(MEM_HEAP_ARRAYS, bytes);
+    metrics_add(&thread_metrics->allocations, 1);
+    metrics_add(&thread_metrics->allocated_bytes, bytes);
+    int32_t *object = calloc(1, bytes);
+    assert(object != NULL && "Failed to allocate exception");
+    object[0] = class->id;
+    int32_t exception =
+        heap_add(heap, object, T_OBJECT, current_frame->method, current_frame->pc);
+    // The message is Throwable's only field. The heap may grow, moving `object`.
+    if (message != NULL) {
+        int32_t string = string_from_utf8(heap, message, strlen(message));
+        heap_get(heap, exception)[1] = string;
+    }
+    return exception;
+}
+
+int32_t exception_find_handler(const code_t *code, u4 pc, heap_t *heap, int32_t exception) {
+    const class_file_t *class = exception_class(heap, exception);
+    // Handlers are tried in the order of the table, which lists inner try blocks first
+    for (u2 i = 0; i < code->handler_count; i++) {
+        const exception_handler_t *handler = &code->handlers[i];
+        if (handler->start_pc <= pc && pc < handler->end_pc &&
+            (handler->catch_type == 0 || is_subclass(class, handler->catch_class))) {
+            return handler->handler_pc;
+        }
+    }
+    return -1;
+}
+
+void exception_uncaught(heap_t *heap, int32_t exception) {
+    const char *prefix = "Exception in thread \"main\" ";
+    output_write(STDERR_REFERENCE, prefix, strlen(prefix));
+    // Class names are printed with dots, e.g. java.lang.ArithmeticException
+    const char *name = exception_class(heap, exception)->name;
+    for (const char *c = name; *c != '\0'; c++) {
+        output_write(STDERR_REFERENCE, *c == '/' ? "." : c, 1);
+    }
+    int32_t message = heap_get(heap, exception)[1];
+    if (message != NULL_REFERENCE) {
+        output_write(STDERR_REFERENCE, ": ", 2);
+        string_print(STDERR_REFERENCE, heap, message);
+    }
+    output_write(STDERR_REFERENCE, "\n", 1);
+    output_flush();
+    exit(1);
+}
@@ -0,0 +1,37 @@
+#ifndef EXCEPTION_H
+#define EXCEPTION_H
+
+#include <inttypes.h>
+
+#include "class_file.h"
+#include "heap.h"
+
+/**
+ * Creates an exception thrown by the VM itself, e.g. on division by zero.
+ * The exception and its message are allocated by the current frame.
+ *
+ * @param class_name the exception's built-in class, e.g. "java/lang/ArithmeticException"
+ * @param message the exception's message, encoded as UTF-8, or NULL for none
+ * @return a reference to the exception
+ */
+int32_t exception_new(heap_t *heap, const char *class_name, const char *message);
+
+/**
+ * Finds the handler in a method that catches an exception thrown by an instruction.
+ * The exception table is only searched when an exception is thrown,
+ * so try blocks cost nothing while no exception is thrown.
+ *
+ * @param code the method's code, with its exception table
+ * @param pc the bytecode offset of the instruction throwing the exception
+ * @param exception a reference to the exception
+ * @return the bytecode offset of the handler, or -1 if the exception propagates to the caller
+ */
+int32_t exception_find_handler(const code_t *code, u4 pc, heap_t *heap, int32_t exception);
+
+/**
+ * Reports an exception that main() did not catch and exits with status 1,
+ * e.g. `Exception in thread "main" java.lang.ArithmeticException: / by zero`.
+ */
+void exception_uncaught(heap_t *heap, int32_t exception) __attribute__((noreturn));
+
+#endif /* EXCEPTION_H */
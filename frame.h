@@ -0,0 +1,62 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stddef.h>
+#include <string.h>
+
+#include "class_file.h"
+
+/**
+ * The state of a method invocation. Frames are linked from the innermost
+ * call to main() so tools like the heap dumper can walk the Java stack.
+ */
+typedef struct frame {
+    /** The method being run */
+    method_t *method;
+    /** The method's local variables */
+    int32_t *locals;
+    /** The method's operand stack */
+    int32_t *stack;
+    /**
+     * The bytecode offset of the current instruction. This is only updated
+     * at safepoints; the method's stack map for the pc gives the stack depth.
+     */
+    size_t pc;
+    /** The number of frames on the stack, including this one */
+    size_t depth;
+    /** The frame of the calling method, or NULL for main() */
+    struct frame *caller;
+} frame_t;
+
+/** The innermost running frame, or NULL outside of execute() */
+extern frame_t *current_frame;
+
+/*
+ * Locals and operand stack entries are 32-bit slots. A float is stored as its
+ * bits in one slot; a double is stored as one 64-bit value spanning two slots,
+ * so it keeps the JVM's two-slot indexing.
+ */
+
+static inline float get_float(int32_t slot) {
+    float value;
+    memcpy(&value, &slot, sizeof(value));
+    return value;
+}
+
+static inline int32_t float_slot(float value) {
+    int32_t slot;
+    memcpy(&slot, &value, sizeof(slot));
+    return slot;
+}
+
+static inline double get_double(const int32_t *slots) {
+    double value;
+    memcpy(&value, slots, sizeof(value));
+    return value;
+}
+
+static inline void put_double(int32_t *slots, double value) {
+    memcpy(slots, &value, sizeof(value));
+}
+
+#endif /* FRAME_H */
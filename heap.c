@@ -2,37 +2,77 @@
 
 #include <stdlib.h>
 
+#include "mapped_file.h"
+#include "stats.h"
+
 typedef struct heap {
-    /** Generic array of pointers. */
-    int32_t **ptr;
-    /** How many pointers there are currently in the array. */
+    /** Generic array of entries. */
+    heap_entry_t *entries;
+    /** How many entries there are currently in the array. */
     int32_t count;
 } heap_t;
 
 heap_t *heap_init() {
-    // The heap array is initially allocated to hold zero elements.
+    // Reference 0 is reserved for null, so it is the only entry initially.
     heap_t *heap = malloc(sizeof(heap_t));
-    heap->ptr = NULL;
-    heap->count = 0;
+    heap->entries = calloc(1, sizeof(heap_entry_t));
+    heap->count = 1;
     return heap;
 }
 
-int32_t heap_add(heap_t *heap, int32_t *ptr) {
-    heap->ptr = realloc(heap->ptr, (heap->count + 1) * sizeof(int32_t *));
-    heap->ptr[heap->count] = ptr;
+int32_t heap_add(heap_t *heap, int32_t *ptr, u1 type, const method_t *site_method,
+                 u4 site_pc) {
+    heap->entries = realloc(heap->entries, (heap->count + 1) * sizeof(heap_entry_t));
+    stats_add_bytes(MEM_HANDLE_TABLE, sizeof(heap_entry_t));
+    heap->entries[heap->count] = (heap_entry_t){
+        .ptr = ptr, .type = type, .site_method = site_method, .site_pc = site_pc};
     int32_t temp = heap->count;
-    heap->count += 1;
+    // The metrics server reads the count from its own thread
+    __atomic_store_n(&heap->count, temp + 1, __ATOMIC_RELAXED);
     return temp;
 }
 
+int32_t heap_add_mapped(heap_t *heap, int32_t *ptr, bool read_only,
+                        const method_t *site_method, u4 site_pc) {
+    // Mapped files are only int arrays
+    int32_t ref = heap_add(heap, ptr, 10, site_method, site_pc);
+    heap->entries[ref].mapped = true;
+    heap->entries[ref].read_only = read_only;
+    return ref;
+}
+
+int32_t heap_add_view(heap_t *heap, int32_t *ptr, u1 type, const method_t *site_method,
+                      u4 site_pc) {
+    int32_t ref = heap_add(heap, ptr, type, site_method, site_pc);
+    heap->entries[ref].view = true;
+    return ref;
+}
+
+void heap_set(heap_t *heap, int32_t ref, int32_t *ptr) {
+    heap->entries[ref].ptr = ptr;
+}
+
 int32_t *heap_get(heap_t *heap, int32_t ref) {
-    return heap->ptr[ref];
+    return heap->entries[ref].ptr;
+}
+
+int32_t heap_count(const heap_t *heap) {
+    return __atomic_load_n(&heap->count, __ATOMIC_RELAXED);
+}
+
+const heap_entry_t *heap_entry(const heap_t *heap, int32_t ref) {
+    return &heap->entries[ref];
 }
 
 void heap_free(heap_t *heap) {
     for (int32_t i = 0; i < heap->count; i++) {
-        free(heap->ptr[i]);
+        if (heap->entries[i].mapped) {
+            mapped_file_unmap(heap->entries[i].ptr);
+        }
+        else if (!heap->entries[i].view) {
+            free(heap->entries[i].ptr);
+        }
     }
-    free(heap->ptr);
+    free(heap->entries);
     free(heap);
-}
\ No newline at end of file
+}
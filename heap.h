@@ -2,6 +2,10 @@
 #define HEAP_H
 
 #include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "class_file.h"
 
 /**
  * Represents the array of pointers to heap-allocated int32_t arrays.
@@ -9,7 +13,48 @@
 typedef struct heap heap_t;
 
 /**
- * Initializes a heap. The capacity of this heap is initially zero.
+ * An array in the heap, along with where it was allocated.
+ */
+typedef struct {
+    /** The array: element 0 holds the length, followed by the elements */
+    int32_t *ptr;
+    /** The element type, using the `atype` codes of the newarray instruction */
+    u1 type;
+    /** The method that allocated the array */
+    const method_t *site_method;
+    /** The bytecode offset of the instruction that allocated the array */
+    u4 site_pc;
+    /** Whether the array is a mapped file (see mapped_file.h) rather than malloc()ed */
+    bool mapped;
+    /** Whether the array lies inside another array's allocation (see heap_add_view()) */
+    bool view;
+    /** Whether storing to the array throws, as for a file mapped read-only */
+    bool read_only;
+} heap_entry_t;
+
+/** The reference that does not refer to any array */
+#define NULL_REFERENCE 0
+
+/**
+ * The number of ints each element of an array takes: 2 for the doubles and longs
+ * of arrays with `atype` 7 and 11, stored like two-slot locals (see frame.h).
+ */
+static inline size_t array_element_ints(u1 type) {
+    return type == 7 || type == 11 ? 2 : 1;
+}
+
+/** The type of arrays of references, beyond the `atype` codes of newarray */
+#define T_REFERENCE 12
+
+/**
+ * The type of objects. Element 0 of an object holds its class's id instead of
+ * a length, followed by its fields (see class_loader.h).
+ */
+#define T_OBJECT 13
+
+/**
+ * Initializes a heap. The heap initially holds no arrays;
+ * only NULL_REFERENCE is in use.
  */
 heap_t *heap_init();
 
@@ -18,9 +63,48 @@ heap_t *heap_init();
  * reference is an index into a generic heap-allocated array.
  *
  * @param ptr Pointer of an int32_t array to add to the heap.
+ * @param type the `atype` of the array's elements
+ * @param site_method the method allocating the array
+ * @param site_pc the bytecode offset of the allocating instruction
  * @returns A "reference" to the pointer.
  */
-int32_t heap_add(heap_t *heap, int32_t *ptr);
+int32_t heap_add(heap_t *heap, int32_t *ptr, u1 type, const method_t *site_method,
+                 u4 site_pc);
+
+/**
+ * Add an int[] returned by mapped_file_map() to the heap and get a reference.
+ * The file is unmapped when the heap is freed.
+ *
+ * @param ptr the mapped array
+ * @param read_only whether the array is mapped read-only, so stores to it must throw
+ * @param site_method the method mapping the array
+ * @param site_pc the bytecode offset of the call mapping the array
+ * @returns A "reference" to the pointer.
+ */
+int32_t heap_add_mapped(heap_t *heap, int32_t *ptr, bool read_only,
+                        const method_t *site_method, u4 site_pc);
+
+/**
+ * Add an array that lies inside another array's allocation, e.g. a row of an
+ * int[][] allocated as one block, and get a reference.
+ * The array is freed along with the array that owns the allocation.
+ *
+ * @param ptr the array, inside an allocation already in the heap
+ * @param type the `atype` of the array's elements
+ * @param site_method the method allocating the array
+ * @param site_pc the bytecode offset of the allocating instruction
+ * @returns A "reference" to the pointer.
+ */
+int32_t heap_add_view(heap_t *heap, int32_t *ptr, u1 type, const method_t *site_method,
+                      u4 site_pc);
+
+/**
+ * Replace the pointer a reference refers to, e.g. after growing an object.
+ *
+ * @param ref A "reference".
+ * @param ptr The new pointer.
+ */
+void heap_set(heap_t *heap, int32_t ref, int32_t *ptr);
 
 /**
  * Retrieve a pointer from the heap.
@@ -30,6 +114,20 @@ int32_t heap_add(heap_t *heap, int32_t *ptr);
  */
 int32_t *heap_get(heap_t *heap, int32_t ref);
 
+/**
+ * Gets the number of references that have been handed out, including
+ * NULL_REFERENCE. Valid references are 1 through heap_count() - 1.
+ */
+int32_t heap_count(const heap_t *heap);
+
+/**
+ * Retrieve an array along with its allocation information.
+ *
+ * @param ref A "reference".
+ * @returns the heap entry for the reference
+ */
+const heap_entry_t *heap_entry(const heap_t *heap, int32_t ref);
+
 /**
  * Frees elements of the heap-allocated int32_t arrays.
  *
@@ -37,4 +135,4 @@ int32_t *heap_get(heap_t *heap, int32_t ref);
  */
 void heap_free(heap_t *heap);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,546 @@
+#include "heap_dump.h"
+
+#include <assert.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "class_loader.h"
+#include "java_string.h"
+#include "read_class.h"
+#include "safepoint.h"
+#include "stack_map.h"
+
+/*
+ * Heap dump file format. Integers are big-endian, like in class files.
+ *
+ *   u4 magic, u2 version
+ *   u2 method count, then per method: u2 length, name and descriptor bytes
+ *   u4 array count, then per array:
+ *       u4 reference, u4 length, u1 type, u2 allocating method, u4 allocating pc
+ *   u2 frame count, then per frame (innermost first): u2 method, u4 pc
+ *   u4 root count, then per root: u2 frame, u1 kind, u2 slot, u4 reference
+ *   u4 edge count, then per edge: u4 from reference, u4 to reference
+ *
+ * Edges are the references held by arrays of references, objects and StringBuilders.
+ * The length of an object is the number of bytes of its fields.
+ */
+const u4 HEAP_DUMP_MAGIC = 0x544A4844; // "TJHD"
+const u2 HEAP_DUMP_VERSION = 1;
+
+/** Kinds of frame roots */
+typedef enum { ROOT_LOCAL = 0, ROOT_STACK = 1 } root_kind_t;
+
+/** How many of the largest arrays the analyzer lists */
+const size_t LARGEST_ARRAYS = 10;
+
+/** The file written by heap dumps requested with SIGUSR1 */
+static const char *heap_dump_path;
+
+static void request_heap_dump(int signal) {
+    (void) signal;
+    safepoint_request_operation(SAFEPOINT_HEAP_DUMP);
+}
+
+static void dump_heap_at_safepoint(frame_t *top, void *heap) {
+    heap_dump_write(heap_dump_path, heap, top);
+}
+
+void heap_dump_enable(const char *path, const heap_t *heap) {
+    heap_dump_path = path;
+    safepoint_register_operation(SAFEPOINT_HEAP_DUMP, dump_heap_at_safepoint,
+                                 (void *) heap);
+    struct sigaction action = {.sa_handler = request_heap_dump};
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    int error = sigaction(SIGUSR1, &action, NULL);
+    assert(error == 0 && "Failed to install SIGUSR1 handler");
+}
+
+static void write_u1(FILE *file, u1 value) {
+    fputc(value, file);
+}
+static void write_u2(FILE *file, u2 value) {
+    write_u1(file, value >> 8);
+    write_u1(file, value);
+}
+static void write_u4(FILE *file, u4 value) {
+    write_u2(file, value >> 16);
+    write_u2(file, value);
+}
+
+/**
+ * Finds a method in the table of dumped methods, adding it if necessary.
+ *
+ * @return the method's index in the table
+ */
+static u2 method_index(const method_t ***methods, u2 *count, const method_t *method) {
+    for (u2 i = 0; i < *count; i++) {
+        if ((*methods)[i] == method) {
+            return i;
+        }
+    }
+    *methods = realloc(*methods, (*count + 1) * sizeof(method_t *));
+    assert(*methods != NULL && "Failed to allocate method table");
+    (*methods)[*count] = method;
+    return (*count)++;
+}
+
+/**
+ * Writes the roots among `count` slots starting at `slots`. With a stack map,
+ * only the slots it marks as references are roots; without one, any slot
+ * holding a valid reference might be one.
+ *
+ * @param first_slot the index of the first slot in the stack map's reference bitmap
+ */
+static void write_roots(FILE *file, const heap_t *heap, u2 frame, root_kind_t kind,
+                        const int32_t *slots, size_t count, const stack_map_t *stack_map,
+                        size_t first_slot, u4 *root_count) {
+    for (size_t slot = 0; slot < count; slot++) {
+        if (stack_map != NULL && !stack_map_is_reference(stack_map, first_slot + slot)) {
+            continue;
+        }
+        if (NULL_REFERENCE < slots[slot] && slots[slot] < heap_count(heap)) {
+            write_u2(file, frame);
+            write_u1(file, kind);
+            write_u2(file, slot);
+            write_u4(file, slots[slot]);
+            *root_count += 1;
+        }
+    }
+}
+
+/** Writes an edge from an array to the array `to` refers to, if any */
+static void write_edge(FILE *file, const heap_t *heap, int32_t from, int32_t to,
+                       u4 *edge_count) {
+    if (NULL_REFERENCE < to && to < heap_count(heap)) {
+        write_u4(file, from);
+        write_u4(file, to);
+        *edge_count += 1;
+    }
+}
+
+void heap_dump_write(const char *path, const heap_t *heap, const frame_t *top) {
+    FILE *file = fopen(path, "wb");
+    assert(file != NULL && "Failed to open heap dump file");
+
+    // Collect the methods named by allocation sites and frames
+    const method_t **methods = NULL;
+    u2 method_count = 0;
+    int32_t array_count = heap_count(heap);
+    u2 *site_methods = malloc(sizeof(u2[array_count + 1]));
+    assert(site_methods != NULL && "Failed to allocate site table");
+    for (int32_t ref = NULL_REFERENCE + 1; ref < array_count; ref++) {
+        site_methods[ref] =
+            method_index(&methods, &method_count, heap_entry(heap, ref)->site_method);
+    }
+    u2 frame_count = 0;
+    for (const frame_t *frame = top; frame != NULL; frame = frame->caller) {
+        method_index(&methods, &method_count, frame->method);
+        frame_count++;
+    }
+
+    write_u4(file, HEAP_DUMP_MAGIC);
+    write_u2(file, HEAP_DUMP_VERSION);
+    write_u2(file, method_count);
+    for (u2 i = 0; i < method_count; i++) {
+        size_t name_length = strlen(methods[i]->name);
+        size_t descriptor_length = strlen(methods[i]->descriptor);
+        write_u2(file, name_length + descriptor_length);
+        fwrite(methods[i]->name, 1, name_length, file);
+        fwrite(methods[i]->descriptor, 1, descriptor_length, file);
+    }
+
+    write_u4(file, array_count - 1);
+    for (int32_t ref = NULL_REFERENCE + 1; ref < array_count; ref++) {
+        const heap_entry_t *entry = heap_entry(heap, ref);
+        write_u4(file, ref);
+        // An object's length is the size of its fields
+        write_u4(file, entry->type == T_OBJECT ? loaded_class(entry->ptr[0])->instance_size
+                                               : (u4) entry->ptr[0]);
+        write_u1(file, entry->type);
+        write_u2(file, site_methods[ref]);
+        write_u4(file, entry->site_pc);
+    }
+
+    write_u2(file, frame_count);
+    for (const frame_t *frame = top; frame != NULL; frame = frame->caller) {
+        write_u2(file, method_index(&methods, &method_count, frame->method));
+        write_u4(file, frame->pc);
+    }
+
+    // The root count is only known after scanning, so patch it in afterwards
+    long root_count_offset = ftell(file);
+    write_u4(file, 0);
+    u4 root_count = 0;
+    u2 frame_number = 0;
+    for (const frame_t *frame = top; frame != NULL; frame = frame->caller) {
+        const code_t *code = &frame->method->code;
+        // Without a stack map, the whole operand stack has to be scanned
+        const stack_map_t *stack_map = find_stack_map(code, frame->pc);
+        size_t stack_depth = stack_map != NULL ? stack_map->stack_depth : code->max_stack;
+        write_roots(file, heap, frame_number, ROOT_LOCAL, frame->locals, code->max_locals,
+                    stack_map, 0, &root_count);
+        write_roots(file, heap, frame_number, ROOT_STACK, frame->stack, stack_depth, stack_map,
+                    code->max_locals, &root_count);
+        frame_number++;
+    }
+
+    // The edge count is patched in the same way
+    long edge_count_offset = ftell(file);
+    write_u4(file, 0);
+    u4 edge_count = 0;
+    for (int32_t ref = NULL_REFERENCE + 1; ref < array_count; ref++) {
+        const heap_entry_t *entry = heap_entry(heap, ref);
+        if (entry->type == T_REFERENCE) {
+            for (int32_t i = 1; i <= entry->ptr[0]; i++) {
+                write_edge(file, heap, ref, entry->ptr[i], &edge_count);
+            }
+        }
+        else if (entry->type == T_OBJECT) {
+            const class_file_t *class = loaded_class(entry->ptr[0]);
+            const u1 *fields = (const u1 *) &entry->ptr[1];
+            for (u2 i = 0; i < class->reference_count; i++) {
+                const int32_t *field = (const int32_t *) (fields + class->reference_offsets[i]);
+                write_edge(file, heap, ref, *field, &edge_count);
+            }
+        }
+        else if (entry->type == T_STRING_BUILDER) {
+            const string_part_t *parts = (const string_part_t *) &entry->ptr[BUILDER_HEADER];
+            for (int32_t i = 0; i < entry->ptr[0]; i++) {
+                if (parts[i].kind == PART_STRING) {
+                    write_edge(file, heap, ref, parts[i].value, &edge_count);
+                }
+            }
+        }
+    }
+    fseek(file, root_count_offset, SEEK_SET);
+    write_u4(file, root_count);
+    fseek(file, edge_count_offset, SEEK_SET);
+    write_u4(file, edge_count);
+
+    int error = fclose(file);
+    assert(error == 0 && "Failed to write heap dump");
+    free(site_methods);
+    free(methods);
+}
+
+/** An array read back from a heap dump */
+typedef struct {
+    u4 reference;
+    u4 length;
+    u1 type;
+    u2 site_method;
+    u4 site_pc;
+} dumped_array_t;
+
+/** An allocation site's totals */
+typedef struct {
+    u2 method;
+    u4 pc;
+    size_t arrays;
+    size_t bytes;
+} site_total_t;
+
+/** The bytes an array or string occupies, including its length */
+static size_t array_bytes(const dumped_array_t *array) {
+    if (is_string_type(array->type)) {
+        return string_bytes(array->type, array->length);
+    }
+    if (array->type == T_STRING_BUILDER) {
+        // The length of a builder is its number of parts
+        return sizeof(int32_t[BUILDER_HEADER]) + (size_t) array->length * sizeof(string_part_t);
+    }
+    if (array->type == T_OBJECT) {
+        // The fields follow a one-int header, padded to a whole number of ints
+        return sizeof(int32_t) + ((size_t) array->length + sizeof(int32_t) - 1) /
+                                     sizeof(int32_t) * sizeof(int32_t);
+    }
+    return ((size_t) array->length * array_element_ints(array->type) + 1) * sizeof(int32_t);
+}
+
+static const char *type_name(u1 type) {
+    switch (type) {
+        case 4:
+            return "boolean";
+        case 5:
+            return "char";
+        case 6:
+            return "float";
+        case 7:
+            return "double";
+        case 8:
+            return "byte";
+        case 9:
+            return "short";
+        case 10:
+            return "int";
+        case 11:
+            return "long";
+        case T_REFERENCE:
+            return "Object";
+        case T_OBJECT:
+            return "object";
+        case T_STRING_ASCII:
+        case T_STRING_LATIN1:
+        case T_STRING_UTF16:
+            return "String";
+        case T_STRING_BUILDER:
+            return "StringBuilder";
+        default:
+            return "?";
+    }
+}
+
+/** Orders allocation sites from most to fewest bytes */
+static int compare_sites_by_size(const void *a, const void *b) {
+    size_t size_a = ((const site_total_t *) a)->bytes;
+    size_t size_b = ((const site_total_t *) b)->bytes;
+    return (size_a < size_b) - (size_a > size_b);
+}
+
+/** The arrays of the dump being analyzed, used by compare_largest() */
+static const dumped_array_t *sorting_arrays;
+
+/** Orders references to arrays from largest to smallest */
+static int compare_largest(const void *a, const void *b) {
+    size_t size_a = array_bytes(&sorting_arrays[*(const u4 *) a]);
+    size_t size_b = array_bytes(&sorting_arrays[*(const u4 *) b]);
+    return (size_a < size_b) - (size_a > size_b);
+}
+
+/** Reads a reference from a heap dump and finds the index of its array */
+static u4 read_array_index(FILE *file, const u4 *array_indices, u4 max_reference) {
+    u4 ref = read_u4(file);
+    assert(ref <= max_reference && array_indices[ref] != UINT32_MAX &&
+           "Heap dump refers to a missing array");
+    return array_indices[ref];
+}
+
+/**
+ * Marks every array reachable from the array at `index` along the dumped edges,
+ * walking them with an explicit worklist so long chains do not exhaust the C stack.
+ * Arrays are visited once per `stamp`, so each root's walk costs only what it reaches
+ * rather than a pass over every array to clear the marks.
+ *
+ * @param visited the stamp of the last walk that reached each array
+ * @param stamp a value not yet stored in `visited`, unique to this walk
+ * @param retained set for every array reached
+ * @param edge_offsets the edges from the array at index i are the targets at
+ *   edge_offsets[i] up to edge_offsets[i + 1]
+ * @param edge_targets the indices of the arrays the edges refer to
+ * @param worklist room for one index per array
+ * @return the number of bytes newly marked
+ */
+static size_t retain(u4 index, u4 *visited, u4 stamp, bool *retained,
+                     const dumped_array_t *arrays, const u4 *edge_offsets,
+                     const u4 *edge_targets, u4 *worklist) {
+    if (visited[index] == stamp) {
+        return 0;
+    }
+    visited[index] = stamp;
+    size_t bytes = 0;
+    // Arrays are stamped when they are queued, so each is queued at most once
+    u4 pending = 0;
+    worklist[pending++] = index;
+    while (pending > 0) {
+        u4 from = worklist[--pending];
+        retained[from] = true;
+        bytes += array_bytes(&arrays[from]);
+        for (u4 edge = edge_offsets[from]; edge < edge_offsets[from + 1]; edge++) {
+            u4 to = edge_targets[edge];
+            if (visited[to] != stamp) {
+                visited[to] = stamp;
+                worklist[pending++] = to;
+            }
+        }
+    }
+    return bytes;
+}
+
+void heap_dump_analyze(const char *path, FILE *out) {
+    FILE *file = fopen(path, "rb");
+    assert(file != NULL && "Failed to open heap dump file");
+    u4 magic = read_u4(file);
+    assert(magic == HEAP_DUMP_MAGIC && "Not a heap dump");
+    u2 version = read_u2(file);
+    assert(version == HEAP_DUMP_VERSION && "Unsupported heap dump version");
+
+    u2 method_count = read_u2(file);
+    char **methods = malloc(sizeof(char *[method_count + 1]));
+    assert(methods != NULL && "Failed to allocate method table");
+    for (u2 i = 0; i < method_count; i++) {
+        u2 length = read_u2(file);
+        methods[i] = malloc(length + 1);
+        assert(methods[i] != NULL && "Failed to allocate method name");
+        size_t bytes_read = fread(methods[i], 1, length, file);
+        assert(bytes_read == length && "Failed to read method name");
+        methods[i][length] = '\0';
+    }
+
+    u4 array_count = read_u4(file);
+    dumped_array_t *arrays = malloc(sizeof(dumped_array_t[array_count + 1]));
+    assert(arrays != NULL && "Failed to allocate arrays");
+    size_t total_bytes = 0;
+    u4 max_reference = 0;
+    for (u4 ref = 0; ref < array_count; ref++) {
+        arrays[ref].reference = read_u4(file);
+        if (arrays[ref].reference > max_reference) {
+            max_reference = arrays[ref].reference;
+        }
+        arrays[ref].length = read_u4(file);
+        arrays[ref].type = read_u1(file);
+        arrays[ref].site_method = read_u2(file);
+        arrays[ref].site_pc = read_u4(file);
+        total_bytes += array_bytes(&arrays[ref]);
+    }
+
+    // Roots and edges name arrays by reference; map references to array indices
+    u4 *array_indices = malloc(sizeof(u4[max_reference + 1]));
+    assert(array_indices != NULL && "Failed to allocate reference map");
+    memset(array_indices, 0xFF, sizeof(u4[max_reference + 1]));
+    for (u4 i = 0; i < array_count; i++) {
+        array_indices[arrays[i].reference] = i;
+    }
+
+    u2 frame_count = read_u2(file);
+    u2 *frame_methods = malloc(sizeof(u2[frame_count + 1]));
+    u4 *frame_pcs = malloc(sizeof(u4[frame_count + 1]));
+    assert(frame_methods != NULL && frame_pcs != NULL && "Failed to allocate frames");
+    for (u2 i = 0; i < frame_count; i++) {
+        frame_methods[i] = read_u2(file);
+        frame_pcs[i] = read_u4(file);
+    }
+
+    fprintf(out, "%" PRIu32 " arrays, %zu bytes\n", array_count, total_bytes);
+
+    // Largest arrays
+    u4 *order = malloc(sizeof(u4[array_count + 1]));
+    assert(order != NULL && "Failed to allocate array order");
+    for (u4 ref = 0; ref < array_count; ref++) {
+        order[ref] = ref;
+    }
+    sorting_arrays = arrays;
+    qsort(order, array_count, sizeof(u4), compare_largest);
+    fprintf(out, "\nLargest arrays:\n");
+    for (u4 i = 0; i < array_count && i < LARGEST_ARRAYS; i++) {
+        dumped_array_t *array = &arrays[order[i]];
+        fprintf(out, "  #%" PRIu32 " %s[%" PRIu32 "] %zu bytes, allocated at %s:%" PRIu32 "\n",
+                array->reference, type_name(array->type), array->length, array_bytes(array),
+                methods[array->site_method], array->site_pc);
+    }
+    free(order);
+
+    // Totals by allocation site
+    site_total_t *sites = NULL;
+    size_t site_count = 0;
+    for (u4 ref = 0; ref < array_count; ref++) {
+        site_total_t *site = sites;
+        while (site < sites + site_count &&
+               (site->method != arrays[ref].site_method || site->pc != arrays[ref].site_pc)) {
+            site++;
+        }
+        if (site == sites + site_count) {
+            sites = realloc(sites, (site_count + 1) * sizeof(site_total_t));
+            assert(sites != NULL && "Failed to allocate sites");
+            site = &sites[site_count++];
+            *site = (site_total_t){
+                .method = arrays[ref].site_method, .pc = arrays[ref].site_pc};
+        }
+        site->arrays++;
+        site->bytes += array_bytes(&arrays[ref]);
+    }
+    qsort(sites, site_count, sizeof(site_total_t), compare_sites_by_size);
+    fprintf(out, "\nBy allocation site:\n");
+    for (size_t i = 0; i < site_count; i++) {
+        fprintf(out, "  %s:%" PRIu32 " %zu arrays, %zu bytes\n", methods[sites[i].method],
+                sites[i].pc, sites[i].arrays, sites[i].bytes);
+    }
+    free(sites);
+
+    // Retention graph: read the roots and edges, then walk from each root
+    u4 root_count = read_u4(file);
+    u4 (*roots)[4] = malloc(sizeof(u4[root_count + 1][4]));
+    assert(roots != NULL && "Failed to allocate roots");
+    for (u4 i = 0; i < root_count; i++) {
+        roots[i][0] = read_u2(file);
+        roots[i][1] = read_u1(file);
+        roots[i][2] = read_u2(file);
+        roots[i][3] = read_array_index(file, array_indices, max_reference);
+    }
+    u4 edge_count = read_u4(file);
+    u4 (*edges)[2] = malloc(sizeof(u4[edge_count + 1][2]));
+    assert(edges != NULL && "Failed to allocate edges");
+    for (u4 i = 0; i < edge_count; i++) {
+        edges[i][0] = read_array_index(file, array_indices, max_reference);
+        edges[i][1] = read_array_index(file, array_indices, max_reference);
+    }
+    fclose(file);
+
+    // Group the edges by the array they start from (compressed sparse rows),
+    // so walking an array's edges does not scan all of them
+    u4 *edge_offsets = calloc(array_count + 2, sizeof(u4));
+    u4 *edge_targets = malloc(sizeof(u4[edge_count + 1]));
+    u4 *worklist = malloc(sizeof(u4[array_count + 1]));
+    assert(edge_offsets != NULL && edge_targets != NULL && worklist != NULL &&
+           "Failed to allocate retention graph");
+    for (u4 i = 0; i < edge_count; i++) {
+        edge_offsets[edges[i][0] + 2]++;
+    }
+    for (u4 i = 2; i < array_count + 2; i++) {
+        edge_offsets[i] += edge_offsets[i - 1];
+    }
+    // edge_offsets[from + 1] counts the edges placed so far, ending at the next row's start
+    for (u4 i = 0; i < edge_count; i++) {
+        edge_targets[edge_offsets[edges[i][0] + 1]++] = edges[i][1];
+    }
+    free(edges);
+
+    bool *retained = calloc(array_count + 1, sizeof(bool));
+    // Stamps start at 1, so no array has been visited yet
+    u4 *visited = calloc(array_count + 1, sizeof(u4));
+    assert(retained != NULL && visited != NULL && "Failed to allocate marks");
+    fprintf(out, "\nRetention from frame roots:\n");
+    for (u2 frame = 0; frame < frame_count; frame++) {
+        fprintf(out, "  frame %" PRIu16 ": %s pc %" PRIu32 "\n", frame,
+                methods[frame_methods[frame]], frame_pcs[frame]);
+        for (u4 i = 0; i < root_count; i++) {
+            if (roots[i][0] != frame) {
+                continue;
+            }
+            u4 index = roots[i][3];
+            size_t bytes = retain(index, visited, i + 1, retained, arrays, edge_offsets,
+                                  edge_targets, worklist);
+            fprintf(out, "    %s %" PRIu32 " -> #%" PRIu32 " %s[%" PRIu32 "], retains %zu bytes\n",
+                    roots[i][1] == ROOT_LOCAL ? "local" : "stack", roots[i][2],
+                    arrays[index].reference, type_name(arrays[index].type),
+                    arrays[index].length, bytes);
+        }
+    }
+    size_t unreachable_arrays = 0;
+    size_t unreachable_bytes = 0;
+    for (u4 ref = 0; ref < array_count; ref++) {
+        if (!retained[ref]) {
+            unreachable_arrays++;
+            unreachable_bytes += array_bytes(&arrays[ref]);
+        }
+    }
+    fprintf(out, "  unreachable: %zu arrays, %zu bytes\n", unreachable_arrays,
+            unreachable_bytes);
+
+    free(visited);
+    free(retained);
+    free(worklist);
+    free(edge_targets);
+    free(edge_offsets);
+    free(roots);
+    free(frame_pcs);
+    free(frame_methods);
+    free(array_indices);
+    free(arrays);
+    for (u2 i = 0; i < method_count; i++) {
+        free(methods[i]);
+    }
+    free(methods);
+}
@@ -0,0 +1,40 @@
+#ifndef HEAP_DUMP_H
+#define HEAP_DUMP_H
+
+#include <stdio.h>
+
+#include "frame.h"
+#include "heap.h"
+
+/**
+ * Makes SIGUSR1 write a heap dump at the next safepoint.
+ *
+ * @param path the file to write dumps to (overwritten by each dump)
+ * @param heap the heap to dump
+ */
+void heap_dump_enable(const char *path, const heap_t *heap);
+
+/**
+ * Writes a heap dump: every array in the heap, with its type, length
+ * and allocation site, and the frame slots that refer to arrays.
+ * The frames must be stopped at safepoints, so their stack maps apply:
+ * a slot is a root only if its map says it holds a reference. Methods without
+ * stack maps are scanned conservatively, treating any slot holding a valid
+ * reference as a root.
+ *
+ * @param path the file to write
+ * @param heap the heap to dump
+ * @param top the innermost frame, or NULL if no method is running
+ */
+void heap_dump_write(const char *path, const heap_t *heap, const frame_t *top);
+
+/**
+ * Reads a heap dump and reports the largest arrays, the totals by allocation
+ * site and which arrays each frame root retains.
+ *
+ * @param path the heap dump file to read
+ * @param out the stream to write the report to
+ */
+void heap_dump_analyze(const char *path, FILE *out);
+
+#endif /* HEAP_DUMP_H */
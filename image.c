@@ -0,0 +1,98 @@
+#include "image.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "class_loader.h"
+#include "read_class.h"
+
+/** The number of bytes written on each line of an embedded class file */
+#define BYTES_PER_LINE 12
+
+const image_class_t *image_find_class(const char *name) {
+    for (const image_class_t *class = IMAGE_CLASSES; class->name != NULL; class++) {
+        if (strcmp(class->name, name) == 0) {
+            return class;
+        }
+    }
+    return NULL;
+}
+
+/** Checks whether a string starts with a prefix, and if so skips past it */
+static bool skip_prefix(const char **string, const char *prefix) {
+    size_t length = strlen(prefix);
+    if (strncmp(*string, prefix, length) != 0) {
+        return false;
+    }
+    *string += length;
+    return true;
+}
+
+bool image_method_stripped(const char *class_name, const char *name, const char *descriptor) {
+    for (const char *const *stripped = IMAGE_STRIPPED_METHODS; *stripped != NULL; stripped++) {
+        const char *method = *stripped;
+        if (skip_prefix(&method, class_name) && skip_prefix(&method, ".") &&
+            skip_prefix(&method, name) && strcmp(method, descriptor) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void image_write(const char *path) {
+    FILE *image = fopen(path, "w");
+    if (image == NULL) {
+        fprintf(stderr, "Failed to open %s\n", path);
+        exit(1);
+    }
+    fprintf(image, "/* An application image generated by TeenyJVM */\n\n#include \"image.h\"\n");
+
+    // Each class file becomes a constant array, which is put in read-only data
+    u2 class_count = loaded_class_count();
+    bool embedded[class_count];
+    for (u2 id = 0; id < class_count; id++) {
+        FILE *class_file = open_loaded_class_file(id);
+        embedded[id] = class_file != NULL;
+        if (class_file == NULL) {
+            continue;
+        }
+        fprintf(image, "\nstatic const u1 CLASS_%" PRIu16 "[] = {", id);
+        size_t length = 0;
+        for (int byte = fgetc(class_file); byte != EOF; byte = fgetc(class_file)) {
+            fprintf(image, length++ % BYTES_PER_LINE == 0 ? "\n    0x%02x," : " 0x%02x,", byte);
+        }
+        fprintf(image, "\n};\n");
+        int error = fclose(class_file);
+        assert(error == 0 && "Failed to close file");
+    }
+
+    fprintf(image, "\nconst image_class_t IMAGE_CLASSES[] = {\n");
+    for (u2 id = 0; id < class_count; id++) {
+        if (embedded[id]) {
+            fprintf(image,
+                    "    {.name = \"%s\", .bytes = CLASS_%" PRIu16
+                    ", .length = sizeof(CLASS_%" PRIu16 ")},\n",
+                    loaded_class(id)->name, id, id);
+        }
+    }
+    fprintf(image, "    {.name = NULL},\n};\n");
+
+    fprintf(image, "\nconst char *const IMAGE_STRIPPED_METHODS[] = {\n");
+    for (u2 id = 0; id < class_count; id++) {
+        const class_file_t *class = loaded_class(id);
+        for (const method_t *method = class->methods; embedded[id] && method->name != NULL;
+             method++) {
+            if (!method->reachable && (method->access_flags & (IS_NATIVE | IS_ABSTRACT)) == 0) {
+                fprintf(image, "    \"%s.%s%s\",\n", class->name, method->name,
+                        method->descriptor);
+            }
+        }
+    }
+    fprintf(image, "    NULL,\n};\n");
+    if (fclose(image) != 0) {
+        fprintf(stderr, "Failed to write %s\n", path);
+        exit(1);
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "class_file.h"
+
+/**
+ * An application image is a single executable holding the VM and the class
+ * files of an application, which it loads from memory instead of the file system.
+ * `jvm -Ximage:Main-image.c Main.class` writes the class files that Main loads
+ * as C source, which is linked with the VM instead of empty_image.c
+ * (see `make <class>-image`).
+ */
+
+/** A class file embedded in an application image */
+typedef struct {
+    /** The internal name of the class, e.g. "Main$Point" */
+    const char *name;
+    /** The contents of the class file */
+    const u1 *bytes;
+    size_t length;
+} image_class_t;
+
+/**
+ * The classes embedded in the executable, starting with the main class.
+ * The array is "null-terminated": the last class has a NULL name.
+ * The plain VM embeds no classes.
+ */
+extern const image_class_t IMAGE_CLASSES[];
+
+/**
+ * The methods an application image leaves out the code of, because they cannot be
+ * called from main(), as "<class>.<name><descriptor>", e.g. "Main.unused()V".
+ * The array is "null-terminated". The plain VM strips no methods when loading.
+ */
+extern const char *const IMAGE_STRIPPED_METHODS[];
+
+/**
+ * Checks whether the executable is an application image.
+ * Images start the embedded main class, passing all their arguments to main().
+ */
+static inline bool image_embedded(void) {
+    return IMAGE_CLASSES[0].name != NULL;
+}
+
+/**
+ * Finds a class embedded in the executable.
+ *
+ * @param name the internal name of the class
+ * @return the class, or NULL if it is not embedded
+ */
+const image_class_t *image_find_class(const char *name);
+
+/**
+ * Checks whether an application image leaves out the code of a method.
+ *
+ * @param class_name the internal name of the method's class
+ * @param name the method's name
+ * @param descriptor the method's descriptor
+ */
+bool image_method_stripped(const char *class_name, const char *name, const char *descriptor);
+
+/**
+ * Writes the C source of an application image holding every loaded class
+ * that was read from a class file, with the main class first, and the methods
+ * analyze_program() found unreachable (see call_graph.h).
+ * Exits with an error if the file cannot be written.
+ *
+ * @param path the path of the C source file
+ */
+void image_write(const char *path);
+
+#endif /* IMAGE_H */
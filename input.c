@@ -0,0 +1,280 @@
+#include "input.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+/** The size of the standard input buffer */
+#define INPUT_BUFFER_SIZE (1 << 20)
+
+/**
+ * An int is only parsed once this many bytes are buffered (or the input has
+ * ended), so ints are not split by the end of the buffer
+ */
+#define MAX_INT_BYTES 32
+
+/** Repeats a byte across a 64-bit word */
+#define BYTES(byte) (0x0101010101010101ULL * (byte))
+
+/**
+ * The buffered input is buffer[position, limit). The buffer is followed by
+ * a word of zeros so 8 bytes can always be loaded at once.
+ */
+static char buffer[INPUT_BUFFER_SIZE + sizeof(uint64_t)];
+static size_t position = 0;
+static size_t limit = 0;
+static bool end_of_input = false;
+
+/**
+ * Reads more input, keeping the bytes that have not been consumed.
+ *
+ * @return whether any bytes were read
+ */
+static bool refill(void) {
+    if (end_of_input) {
+        return false;
+    }
+    memmove(buffer, buffer + position, limit - position);
+    limit -= position;
+    position = 0;
+    ssize_t count;
+    do {
+        count = read(STDIN_FILENO, buffer + limit, INPUT_BUFFER_SIZE - limit);
+    } while (count < 0 && errno == EINTR);
+    assert(count >= 0 && "Failed to read input");
+    limit += count;
+    memset(buffer + limit, 0, sizeof(uint64_t));
+    end_of_input = count == 0;
+    return count > 0;
+}
+
+/** Loads 8 bytes, with the first byte in the lowest bits */
+static inline uint64_t load_word(const char *bytes) {
+    uint64_t word;
+    memcpy(&word, bytes, sizeof(word));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+}
+
+/**
+ * Finds the first byte of a word that isn't selected by a mask.
+ *
+ * @param selected a mask with the high bit of each selected byte set
+ * @return the index of the first byte whose high bit is clear in `selected`, or 8
+ */
+static inline size_t first_unselected(uint64_t selected) {
+    uint64_t unselected = ~selected & BYTES(0x80);
+    return unselected == 0 ? 8 : (size_t) __builtin_ctzll(unselected) / 8;
+}
+
+/**
+ * Selects the bytes of a word that are at least `low`, which must be at
+ * most 128. Adding 128 - low to the low 7 bits of each byte carries into its
+ * high bit exactly when the byte is at least `low`, and never into the next
+ * byte; bytes of 128 or more (non-ASCII) are never selected.
+ */
+static inline uint64_t bytes_at_least(uint64_t word, uint8_t low) {
+    return ((word & BYTES(0x7f)) + BYTES(128 - low)) & ~word & BYTES(0x80);
+}
+
+/** Selects the whitespace bytes of a word: those up to ' ' */
+static inline uint64_t whitespace_bytes(uint64_t word) {
+    return ~bytes_at_least(word, ' ' + 1) & ~word & BYTES(0x80);
+}
+
+/** Selects the digit bytes of a word */
+static inline uint64_t digit_bytes(uint64_t word) {
+    return bytes_at_least(word, '0') & ~bytes_at_least(word, '9' + 1);
+}
+
+/** Converts a word of 8 ASCII digits to their value, 8 digits at a time */
+static inline uint32_t eight_digits(uint64_t word) {
+    word -= BYTES('0');
+    // Combine adjacent digits into 2-digit, then 4-digit, then 8-digit values
+    word = (word * 10) + (word >> 8);
+    word = (((word & 0x000000FF000000FF) * (100 + (1000000ULL << 32))) +
+            (((word >> 16) & 0x000000FF000000FF) * (1 + (10000ULL << 32)))) >> 32;
+    return word;
+}
+
+/**
+ * Skips whitespace, 8 bytes at a time.
+ *
+ * @return whether there is a non-whitespace byte in the buffer
+ */
+static bool skip_whitespace(void) {
+    while (true) {
+        while (position < limit) {
+            size_t skipped = first_unselected(whitespace_bytes(load_word(buffer + position)));
+            position += skipped;
+            if (skipped < 8) {
+                // The zeros after the input are whitespace, so this byte is input
+                return true;
+            }
+        }
+        position = limit;
+        if (!refill()) {
+            return false;
+        }
+    }
+}
+
+/** Skips the rest of a token, up to the next whitespace, 8 bytes at a time */
+static void skip_token(void) {
+    while (true) {
+        while (position < limit) {
+            uint64_t token = ~whitespace_bytes(load_word(buffer + position)) & BYTES(0x80);
+            size_t skipped = first_unselected(token);
+            position += skipped;
+            // The zeros after the input end the buffer, not the token
+            if (skipped < 8 && position < limit) {
+                return;
+            }
+        }
+        position = limit;
+        if (!refill()) {
+            return;
+        }
+    }
+}
+
+int input_int(int32_t *value) {
+    if (!skip_whitespace()) {
+        return 0;
+    }
+    if (limit - position < MAX_INT_BYTES) {
+        refill();
+    }
+    size_t start = position;
+    bool negative = buffer[position] == '-';
+    if (negative || buffer[position] == '+') {
+        position++;
+    }
+    size_t first_digit = position;
+    // The largest magnitude of an int with this sign. Larger magnitudes are
+    // capped just above it, so 64 bits never overflow.
+    uint64_t max = (uint64_t) INT32_MAX + negative;
+    uint64_t result = 0;
+    while (true) {
+        uint64_t word = load_word(buffer + position);
+        size_t digits = first_unselected(digit_bytes(word));
+        if (digits == 8) {
+            result = result * 100000000 + eight_digits(word);
+            result = result > max ? max + 1 : result;
+            position += 8;
+            continue;
+        }
+        for (size_t i = 0; i < digits; i++) {
+            result = result * 10 + (buffer[position + i] - '0');
+        }
+        position += digits;
+        break;
+    }
+    // The zeros after the input are whitespace, so they end a token
+    if (position == first_digit || (unsigned char) buffer[position] > ' ' || result > max) {
+        position = start;
+        skip_token();
+        return -1;
+    }
+    *value = (int32_t) (negative ? -(int64_t) result : (int64_t) result);
+    return 1;
+}
+
+int64_t input_ints(int32_t *values, size_t count) {
+    size_t read = 0;
+    while (read < count) {
+        int status = input_int(&values[read]);
+        if (status <= 0) {
+            return status < 0 ? -1 : (int64_t) read;
+        }
+        read++;
+    }
+    return read;
+}
+
+/**
+ * Decodes one UTF-8 sequence into UTF-16 code units. Malformed bytes decode
+ * to U+FFFD one at a time.
+ *
+ * @param bytes the sequence
+ * @param length the number of bytes available
+ * @param units set to the code units
+ * @param consumed set to the number of bytes decoded
+ * @return the number of code units
+ */
+static size_t decode_utf8(const unsigned char *bytes, size_t length, uint16_t units[2],
+                          size_t *consumed) {
+    unsigned char lead = bytes[0];
+    size_t size = lead < 0xe0 ? 2 : lead < 0xf0 ? 3 : 4;
+    if (lead < 0xc0 || size > length) {
+        *consumed = 1;
+        units[0] = 0xfffd;
+        return 1;
+    }
+    *consumed = size;
+    uint32_t code_point = lead & (0x7f >> size);
+    for (size_t i = 1; i < size; i++) {
+        code_point = (code_point << 6) | (bytes[i] & 0x3f);
+    }
+    if (code_point < 0x10000) {
+        units[0] = code_point;
+        return 1;
+    }
+    code_point -= 0x10000;
+    units[0] = 0xd800 | (code_point >> 10);
+    units[1] = 0xdc00 | (code_point & 0x3ff);
+    return 2;
+}
+
+int32_t input_line(int32_t *chars, size_t capacity) {
+    if (position == limit && !refill()) {
+        return -1;
+    }
+    size_t count = 0;
+    while (count < capacity) {
+        // Keep whole UTF-8 sequences in the buffer
+        if (limit - position < 4) {
+            refill();
+        }
+        if (position == limit) {
+            return count;
+        }
+        const char *newline = memchr(buffer + position, '\n', limit - position);
+        size_t end = newline != NULL ? (size_t) (newline - buffer) : limit;
+        while (position < end && count < capacity) {
+            const unsigned char *bytes = (const unsigned char *) buffer + position;
+            if (bytes[0] < 0x80) {
+                chars[count++] = bytes[0];
+                position++;
+                continue;
+            }
+            if (newline == NULL && end - position < 4 && !end_of_input) {
+                // The sequence may continue after a refill
+                break;
+            }
+            uint16_t units[2];
+            size_t consumed;
+            size_t unit_count = decode_utf8(bytes, end - position, units, &consumed);
+            if (count + unit_count > capacity) {
+                return count;
+            }
+            for (size_t i = 0; i < unit_count; i++) {
+                chars[count++] = units[i];
+            }
+            position += consumed;
+        }
+        if (newline != NULL && position == end) {
+            position++;
+            if (count > 0 && chars[count - 1] == '\r') {
+                count--;
+            }
+            return count;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,40 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <inttypes.h>
+#include <stddef.h>
+
+/**
+ * Reads the next whitespace-separated int from standard input.
+ * Any byte up to and including ' ' is whitespace. A token that is not an
+ * optional sign followed by digits, or whose value is out of the range of an
+ * int, is skipped, so the next call reads the token after it.
+ *
+ * @param value set to the int read
+ * @return 1 if an int was read, 0 at the end of input, or -1 if the token was not an int
+ */
+int input_int(int32_t *value);
+
+/**
+ * Reads whitespace-separated ints from standard input into an array.
+ * Reading stops at a token that is not an int, which is skipped.
+ *
+ * @param values the array to fill
+ * @param count the number of ints to read
+ * @return the number of ints read, which is less than `count` only at the end
+ *   of input, or -1 if a token was not an int
+ */
+int64_t input_ints(int32_t *values, size_t count);
+
+/**
+ * Reads a line from standard input as UTF-16 code units, without its line
+ * terminator. If the line is longer than `capacity`, the rest of it is left
+ * for the next call.
+ *
+ * @param chars the array to fill
+ * @param capacity the size of the array
+ * @return the number of code units read, or -1 at the end of input
+ */
+int32_t input_line(int32_t *chars, size_t capacity);
+
+#endif /* INPUT_H */
@@ -0,0 +1,462 @@
+#include "java_string.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "frame.h"
+#include "metrics.h"
+#include "output.h"
+#include "quota.h"
+#include "stats.h"
+
+/** The number of parts a new StringBuilder has room for */
+#define BUILDER_INITIAL_CAPACITY 8
+
+/** The number of slots the table of interned strings starts with; a power of 2 */
+#define INTERNED_INITIAL_CAPACITY 64
+
+/** An interned string, keyed by the modified UTF-8 it was created from */
+typedef struct {
+    const char *utf8;
+    size_t length;
+    int32_t ref;
+} interned_string_t;
+
+/**
+ * The interned strings, an open-addressing hash table whose empty slots have
+ * a NULL key. It is kept at most half full.
+ */
+static interned_string_t *interned = NULL;
+static size_t interned_capacity = 0;
+static size_t interned_count = 0;
+
+/** Accounts for heap memory allocated by the current frame */
+static void charge_allocation(size_t bytes) {
+    quota_charge_heap(bytes, current_frame);
+    stats_add_bytes(MEM_HEAP_ARRAYS, bytes);
+    metrics_add(&thread_metrics->allocated_bytes, bytes);
+}
+
+/**
+ * Allocates a string with room for its characters and adds it to the heap.
+ *
+ * @param type the string's type, which determines the size of a character
+ * @param length the number of characters
+ * @param ref set to the reference to the string
+ * @return the string's characters
+ */
+static void *string_allocate(heap_t *heap, u1 type, int32_t length, int32_t *ref) {
+    size_t bytes = string_bytes(type, length);
+    charge_allocation(bytes);
+    metrics_add(&thread_metrics->allocations, 1);
+    int32_t *string = malloc(bytes);
+    assert(string != NULL && "Failed to allocate string");
+    string[0] = length;
+    *ref = heap_add(heap, string, type, current_frame->method, current_frame->pc);
+    return &string[1];
+}
+
+/**
+ * Decodes the next character of UTF-8 into UTF-16 code units. Modified UTF-8,
+ * as in class files, encodes each code unit (including each half of a
+ * surrogate pair) in 1 to 3 bytes. Standard UTF-8, as in command-line
+ * arguments, encodes supplementary characters in 4 bytes, which become a
+ * surrogate pair. A truncated sequence decodes its first byte as Latin-1.
+ *
+ * @param utf8 the next byte, advanced past the character
+ * @param end the end of the bytes
+ * @param units set to the code units
+ * @return the number of code units, 1 or 2
+ */
+static int decode_utf8(const unsigned char **utf8, const unsigned char *end, uint16_t units[2]) {
+    const unsigned char *bytes = *utf8;
+    size_t size = bytes[0] < 0xc0 ? 1 : bytes[0] < 0xe0 ? 2 : bytes[0] < 0xf0 ? 3 : 4;
+    if (size > (size_t) (end - bytes)) {
+        size = 1;
+    }
+    *utf8 += size;
+    switch (size) {
+        case 1:
+            units[0] = bytes[0];
+            return 1;
+        case 2:
+            units[0] = (bytes[0] & 0x1f) << 6 | (bytes[1] & 0x3f);
+            return 1;
+        case 3:
+            units[0] = (bytes[0] & 0x0f) << 12 | (bytes[1] & 0x3f) << 6 | (bytes[2] & 0x3f);
+            return 1;
+        default:;
+            uint32_t code_point = (bytes[0] & 0x07) << 18 | (bytes[1] & 0x3f) << 12 |
+                                  (bytes[2] & 0x3f) << 6 | (bytes[3] & 0x3f);
+            units[0] = 0xd800 | (code_point - 0x10000) >> 10;
+            units[1] = 0xdc00 | (code_point & 0x3ff);
+            return 2;
+    }
+}
+
+int32_t string_from_utf8(heap_t *heap, const char *utf8, size_t length) {
+    // Find the length and the widest character to choose the representation
+    const unsigned char *start = (const unsigned char *) utf8;
+    const unsigned char *end = start + length;
+    int32_t units = 0;
+    uint16_t widest = 0;
+    for (const unsigned char *bytes = start; bytes < end;) {
+        uint16_t decoded[2];
+        int count = decode_utf8(&bytes, end, decoded);
+        units += count;
+        widest = decoded[0] > widest ? decoded[0] : widest;
+        widest = count == 2 ? 0xffff : widest;
+    }
+
+    int32_t ref;
+    u1 type = widest < 0x80 ? T_STRING_ASCII : widest < 0x100 ? T_STRING_LATIN1 : T_STRING_UTF16;
+    void *chars = string_allocate(heap, type, units, &ref);
+    if ((size_t) units == length && type == T_STRING_ASCII) {
+        // Every character is a single byte, so there is nothing to decode
+        memcpy(chars, utf8, length);
+    }
+    else if (type == T_STRING_UTF16) {
+        uint16_t *unit = chars;
+        for (const unsigned char *bytes = start; bytes < end;) {
+            unit += decode_utf8(&bytes, end, unit);
+        }
+    }
+    else {
+        uint8_t *unit = chars;
+        for (const unsigned char *bytes = start; bytes < end;) {
+            uint16_t decoded[2];
+            decode_utf8(&bytes, end, decoded);
+            *unit++ = decoded[0];
+        }
+    }
+    return ref;
+}
+
+/** Hashes modified UTF-8 with FNV-1a */
+static size_t hash_utf8(const char *utf8, size_t length) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char) utf8[i]) * 0x100000001b3;
+    }
+    return hash;
+}
+
+/** Finds the slot of the interned string with some contents, or the empty slot for it */
+static interned_string_t *find_interned(const char *utf8, size_t length) {
+    size_t mask = interned_capacity - 1;
+    for (size_t slot = hash_utf8(utf8, length) & mask;; slot = (slot + 1) & mask) {
+        interned_string_t *entry = &interned[slot];
+        if (entry->utf8 == NULL ||
+            (entry->length == length && memcmp(entry->utf8, utf8, length) == 0)) {
+            return entry;
+        }
+    }
+}
+
+/** Doubles the capacity of the table of interned strings, or creates it */
+static void grow_interned(void) {
+    interned_string_t *old = interned;
+    size_t old_capacity = interned_capacity;
+    interned_capacity = old_capacity == 0 ? INTERNED_INITIAL_CAPACITY : 2 * old_capacity;
+    interned = calloc(interned_capacity, sizeof(interned_string_t));
+    assert(interned != NULL && "Failed to allocate interned strings");
+    stats_add_bytes(MEM_CODE_CACHE, (interned_capacity - old_capacity) * sizeof(interned_string_t));
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i].utf8 != NULL) {
+            *find_interned(old[i].utf8, old[i].length) = old[i];
+        }
+    }
+    free(old);
+}
+
+int32_t string_intern(heap_t *heap, const char *utf8, size_t length) {
+    if (2 * (interned_count + 1) > interned_capacity) {
+        grow_interned();
+    }
+    // Modified UTF-8 encodes each string one way, so equal strings have equal keys
+    interned_string_t *entry = find_interned(utf8, length);
+    if (entry->utf8 == NULL) {
+        *entry = (interned_string_t){
+            .utf8 = utf8, .length = length, .ref = string_from_utf8(heap, utf8, length)};
+        interned_count++;
+    }
+    return entry->ref;
+}
+
+void string_intern_free(void) {
+    free(interned);
+    interned = NULL;
+    interned_capacity = 0;
+    interned_count = 0;
+}
+
+/** Gets a string's heap entry, checking that it is a string */
+static const heap_entry_t *string_entry(heap_t *heap, int32_t ref) {
+    assert(ref != NULL_REFERENCE && "Null string");
+    const heap_entry_t *entry = heap_entry(heap, ref);
+    assert(is_string_type(entry->type) && "Not a string");
+    return entry;
+}
+
+int32_t string_length(heap_t *heap, int32_t ref) {
+    return string_entry(heap, ref)->ptr[0];
+}
+
+uint16_t string_char_at(heap_t *heap, int32_t ref, int32_t index) {
+    const heap_entry_t *entry = string_entry(heap, ref);
+    assert(0 <= index && index < entry->ptr[0] && "String index out of bounds");
+    if (entry->type == T_STRING_UTF16) {
+        return ((const uint16_t *) &entry->ptr[1])[index];
+    }
+    return ((const uint8_t *) &entry->ptr[1])[index];
+}
+
+void string_print(int32_t stream, heap_t *heap, int32_t ref) {
+    if (ref == NULL_REFERENCE) {
+        output_write(stream, "null", strlen("null"));
+        return;
+    }
+    const heap_entry_t *entry = string_entry(heap, ref);
+    int32_t length = entry->ptr[0];
+    if (entry->type == T_STRING_ASCII) {
+        output_write(stream, (const char *) &entry->ptr[1], length);
+        return;
+    }
+
+    // Encode the characters as UTF-8 a chunk at a time
+    char encoded[1024];
+    size_t encoded_length = 0;
+    for (int32_t i = 0; i < length; i++) {
+        uint32_t code_point = entry->type == T_STRING_UTF16
+                                  ? ((const uint16_t *) &entry->ptr[1])[i]
+                                  : ((const uint8_t *) &entry->ptr[1])[i];
+        if (0xd800 <= code_point && code_point < 0xdc00 && i + 1 < length) {
+            uint16_t low = ((const uint16_t *) &entry->ptr[1])[i + 1];
+            if (0xdc00 <= low && low < 0xe000) {
+                code_point = 0x10000 + ((code_point - 0xd800) << 10) + (low - 0xdc00);
+                i++;
+            }
+        }
+        if (encoded_length + 4 > sizeof(encoded)) {
+            output_write(stream, encoded, encoded_length);
+            encoded_length = 0;
+        }
+        if (code_point < 0x80) {
+            encoded[encoded_length++] = code_point;
+        }
+        else if (code_point < 0x800) {
+            encoded[encoded_length++] = 0xc0 | code_point >> 6;
+            encoded[encoded_length++] = 0x80 | (code_point & 0x3f);
+        }
+        else if (code_point < 0x10000) {
+            encoded[encoded_length++] = 0xe0 | code_point >> 12;
+            encoded[encoded_length++] = 0x80 | (code_point >> 6 & 0x3f);
+            encoded[encoded_length++] = 0x80 | (code_point & 0x3f);
+        }
+        else {
+            encoded[encoded_length++] = 0xf0 | code_point >> 18;
+            encoded[encoded_length++] = 0x80 | (code_point >> 12 & 0x3f);
+            encoded[encoded_length++] = 0x80 | (code_point >> 6 & 0x3f);
+            encoded[encoded_length++] = 0x80 | (code_point & 0x3f);
+        }
+    }
+    output_write(stream, encoded, encoded_length);
+}
+
+bool string_parse_int(heap_t *heap, int32_t ref, int32_t *value) {
+    int32_t length = ref == NULL_REFERENCE ? 0 : string_length(heap, ref);
+    uint16_t sign = length > 0 ? string_char_at(heap, ref, 0) : 0;
+    bool negative = sign == '-';
+    int32_t index = sign == '-' || sign == '+' ? 1 : 0;
+    // Accumulate in 64 bits so that overflow past Integer.MIN_VALUE is detected
+    bool valid = index < length;
+    int64_t magnitude = 0;
+    for (; valid && index < length; index++) {
+        uint16_t c = string_char_at(heap, ref, index);
+        magnitude = magnitude * 10 + (c - '0');
+        valid = '0' <= c && c <= '9' && magnitude <= (int64_t) INT32_MAX + negative;
+    }
+    if (valid) {
+        *value = negative ? -magnitude : magnitude;
+    }
+    return valid;
+}
+
+/** The characters of a string part */
+typedef struct {
+    /** The type of string the characters would fit in */
+    u1 type;
+    /** The characters: 1 byte each, unless `type` is T_STRING_UTF16 */
+    const void *chars;
+    int32_t length;
+    /** Storage for characters that are not in a string */
+    union {
+        char digits[INT_DIGITS];
+        uint16_t unit;
+    } scratch;
+} part_text_t;
+
+/** Finds the characters of a string part */
+static void part_text(heap_t *heap, const string_part_t *part, part_text_t *text) {
+    switch (part->kind) {
+        case PART_STRING:
+            if (part->value == NULL_REFERENCE) {
+                *text = (part_text_t){.type = T_STRING_ASCII, .chars = "null", .length = 4};
+            }
+            else {
+                const heap_entry_t *entry = string_entry(heap, part->value);
+                *text = (part_text_t){
+                    .type = entry->type, .chars = &entry->ptr[1], .length = entry->ptr[0]};
+            }
+            break;
+        case PART_INT: {
+            char *start = format_int(text->scratch.digits, part->value);
+            text->type = T_STRING_ASCII;
+            text->chars = start;
+            text->length = text->scratch.digits + INT_DIGITS - start;
+            break;
+        }
+        case PART_CHAR: {
+            uint16_t unit = part->value;
+            text->length = 1;
+            if (unit < 0x100) {
+                text->type = unit < 0x80 ? T_STRING_ASCII : T_STRING_LATIN1;
+                text->scratch.digits[0] = unit;
+                text->chars = text->scratch.digits;
+            }
+            else {
+                text->type = T_STRING_UTF16;
+                text->scratch.unit = unit;
+                text->chars = &text->scratch.unit;
+            }
+            break;
+        }
+        default:
+            assert(part->kind == PART_BOOLEAN && "Unknown string part");
+            *text = (part_text_t){.type = T_STRING_ASCII,
+                                  .chars = part->value ? "true" : "false",
+                                  .length = part->value ? 4 : 5};
+            break;
+    }
+}
+
+int32_t string_concat(heap_t *heap, const string_part_t *parts, size_t part_count) {
+    // Measure the parts first so the string is allocated once
+    int32_t length = 0;
+    u1 type = T_STRING_ASCII;
+    part_text_t text;
+    for (size_t i = 0; i < part_count; i++) {
+        part_text(heap, &parts[i], &text);
+        length += text.length;
+        type = text.type > type ? text.type : type;
+    }
+
+    int32_t ref;
+    char *chars = string_allocate(heap, type, length, &ref);
+    for (size_t i = 0; i < part_count; i++) {
+        part_text(heap, &parts[i], &text);
+        if (type != T_STRING_UTF16 || text.type == T_STRING_UTF16) {
+            size_t bytes = string_bytes(type, text.length) - sizeof(int32_t);
+            memcpy(chars, text.chars, bytes);
+            chars += bytes;
+        }
+        else {
+            // Widen 1-byte characters
+            const uint8_t *narrow = text.chars;
+            for (int32_t j = 0; j < text.length; j++) {
+                uint16_t unit = narrow[j];
+                memcpy(chars, &unit, sizeof(unit));
+                chars += sizeof(unit);
+            }
+        }
+    }
+    return ref;
+}
+
+void string_print_parts(int32_t stream, heap_t *heap, const string_part_t *parts,
+                        size_t part_count) {
+    for (size_t i = 0; i < part_count; i++) {
+        switch (parts[i].kind) {
+            case PART_STRING:
+                string_print(stream, heap, parts[i].value);
+                break;
+            case PART_INT:
+                output_int(stream, parts[i].value);
+                break;
+            case PART_CHAR:
+                output_char(stream, parts[i].value);
+                break;
+            default:
+                assert(parts[i].kind == PART_BOOLEAN && "Unknown string part");
+                output_write(stream, parts[i].value ? "true" : "false", parts[i].value ? 4 : 5);
+                break;
+        }
+    }
+}
+
+void concat_recipe_parts(heap_t *heap, concat_recipe_t *recipe, const int32_t *arguments,
+                         string_part_t *parts) {
+    for (u2 i = 0; i < recipe->part_count; i++) {
+        concat_part_t *part = &recipe->parts[i];
+        parts[i].kind = part->kind;
+        if (part->is_argument) {
+            parts[i].value = *arguments++;
+        }
+        else {
+            if (part->kind == PART_STRING && part->value == NULL_REFERENCE) {
+                part->value = string_from_utf8(heap, part->chars, part->length);
+            }
+            parts[i].value = part->value;
+        }
+    }
+}
+
+/** The bytes a StringBuilder with room for `capacity` parts occupies */
+static size_t builder_bytes(int32_t capacity) {
+    return sizeof(int32_t[BUILDER_HEADER]) + sizeof(string_part_t[capacity]);
+}
+
+/** Gets a StringBuilder, checking that the reference is to one */
+static int32_t *builder_get(heap_t *heap, int32_t ref) {
+    assert(ref != NULL_REFERENCE && "Null StringBuilder");
+    const heap_entry_t *entry = heap_entry(heap, ref);
+    assert(entry->type == T_STRING_BUILDER && "Not a StringBuilder");
+    return entry->ptr;
+}
+
+int32_t string_builder_new(heap_t *heap) {
+    size_t bytes = builder_bytes(BUILDER_INITIAL_CAPACITY);
+    charge_allocation(bytes);
+    metrics_add(&thread_metrics->allocations, 1);
+    int32_t *builder = malloc(bytes);
+    assert(builder != NULL && "Failed to allocate StringBuilder");
+    builder[0] = 0;
+    builder[1] = BUILDER_INITIAL_CAPACITY;
+    return heap_add(heap, builder, T_STRING_BUILDER, current_frame->method, current_frame->pc);
+}
+
+void string_builder_append(heap_t *heap, int32_t ref, string_part_kind_t kind,
+                           int32_t value) {
+    int32_t *builder = builder_get(heap, ref);
+    if (builder[0] == builder[1]) {
+        int32_t capacity = builder[1] * 2;
+        charge_allocation(builder_bytes(capacity) - builder_bytes(builder[1]));
+        builder = realloc(builder, builder_bytes(capacity));
+        assert(builder != NULL && "Failed to grow StringBuilder");
+        builder[1] = capacity;
+        heap_set(heap, ref, builder);
+    }
+    string_part_t *parts = (string_part_t *) &builder[BUILDER_HEADER];
+    parts[builder[0]++] = (string_part_t){.kind = kind, .value = value};
+}
+
+int32_t string_builder_to_string(heap_t *heap, int32_t ref) {
+    int32_t *builder = builder_get(heap, ref);
+    return string_concat(heap, (string_part_t *) &builder[BUILDER_HEADER], builder[0]);
+}
+
+void string_builder_print(int32_t stream, heap_t *heap, int32_t ref) {
+    int32_t *builder = builder_get(heap, ref);
+    string_print_parts(stream, heap, (string_part_t *) &builder[BUILDER_HEADER], builder[0]);
+}
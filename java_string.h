@@ -0,0 +1,191 @@
+#ifndef JAVA_STRING_H
+#define JAVA_STRING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "heap.h"
+
+/**
+ * Heap entry types of java.lang.String objects, beyond the `atype` codes of
+ * arrays. Like an array, a string stores its length (in UTF-16 code units) in
+ * element 0. Its characters follow, packed into 1 byte each if they all fit
+ * in Latin-1 and 2 bytes each otherwise. ASCII strings are Latin-1 strings
+ * that can be written out as UTF-8 without any conversion.
+ */
+#define T_STRING_ASCII 16
+#define T_STRING_LATIN1 17
+#define T_STRING_UTF16 18
+
+/**
+ * The heap entry type of java.lang.StringBuilder objects. A builder stores
+ * the parts appended to it rather than their characters (see string_part_t),
+ * so the final string is allocated only once, with its exact length. Element
+ * 0 holds the number of parts and element 1 the capacity for parts.
+ */
+#define T_STRING_BUILDER 19
+
+/** The ints before a StringBuilder's parts: the number of parts and the capacity */
+#define BUILDER_HEADER 2
+
+/** The kinds of value that can be concatenated into a string */
+typedef enum { PART_STRING, PART_INT, PART_CHAR, PART_BOOLEAN } string_part_kind_t;
+
+/** A value to concatenate into a string */
+typedef struct {
+    int32_t kind;
+    /** A string reference (NULL_REFERENCE for "null"), int, char or boolean */
+    int32_t value;
+} string_part_t;
+
+/**
+ * Whether a heap entry type is one of the string types.
+ */
+static inline bool is_string_type(u1 type) {
+    return T_STRING_ASCII <= type && type <= T_STRING_UTF16;
+}
+
+/**
+ * The number of bytes a string of a given type and length occupies,
+ * including its length.
+ */
+static inline size_t string_bytes(u1 type, int32_t length) {
+    return sizeof(int32_t) + (size_t) length * (type == T_STRING_UTF16 ? 2 : 1);
+}
+
+/**
+ * Creates a string from modified UTF-8, the encoding of class file constants.
+ * Standard UTF-8, such as command-line arguments, is also accepted.
+ * The string is allocated by the current frame, whose pc must be up to date.
+ *
+ * @param utf8 the encoded characters
+ * @param length the number of bytes
+ * @return a reference to the string
+ */
+int32_t string_from_utf8(heap_t *heap, const char *utf8, size_t length);
+
+/**
+ * Gets the string of a String constant, like ldc. Constants with the same
+ * contents, in any class, share one string, so they compare equal with ==.
+ * The string is created the first time its contents are interned.
+ *
+ * @param utf8 the constant's modified UTF-8, which must outlive the interned strings
+ * @param length the number of bytes
+ * @return a reference to the string
+ */
+int32_t string_intern(heap_t *heap, const char *utf8, size_t length);
+
+/** Frees the table of interned strings; the strings themselves belong to the heap */
+void string_intern_free(void);
+
+/**
+ * Gets the number of UTF-16 code units in a string, like String.length().
+ */
+int32_t string_length(heap_t *heap, int32_t ref);
+
+/**
+ * Gets a UTF-16 code unit of a string, like String.charAt().
+ */
+uint16_t string_char_at(heap_t *heap, int32_t ref, int32_t index);
+
+/**
+ * Writes a string encoded as UTF-8, like PrintStream.print(String).
+ * ASCII strings are copied to the stream as they are.
+ *
+ * @param stream STDOUT_REFERENCE or STDERR_REFERENCE
+ * @param ref the string, or NULL_REFERENCE to write "null"
+ */
+void string_print(int32_t stream, heap_t *heap, int32_t ref);
+
+/**
+ * Parses a string as a decimal int, like Integer.parseInt(String).
+ *
+ * @param ref the string, or NULL_REFERENCE
+ * @param value set to the parsed value
+ * @return whether the string is a valid int; if not, Integer.parseInt()
+ *   throws NumberFormatException
+ */
+bool string_parse_int(heap_t *heap, int32_t ref, int32_t *value);
+
+/** A part of an invokedynamic string concatenation */
+typedef struct {
+    /** Whether the part is the call site's next argument, rather than a constant */
+    bool is_argument;
+    string_part_kind_t kind;
+    /** For constant strings, the characters in modified UTF-8 */
+    const char *chars;
+    size_t length;
+    /** For constant strings, the string once it is created; for constant ints, the int */
+    int32_t value;
+} concat_part_t;
+
+/**
+ * How an invokedynamic call site of StringConcatFactory concatenates its
+ * arguments and constants, determined by link_class().
+ */
+typedef struct concat_recipe {
+    /** The number of argument slots the call site pops */
+    u2 argument_count;
+    u2 part_count;
+    concat_part_t parts[];
+} concat_recipe_t;
+
+/**
+ * Gets the values to concatenate at an invokedynamic call site, creating the
+ * strings of constant parts the first time they are used. The current frame's
+ * pc must be up to date.
+ *
+ * @param recipe the call site's recipe
+ * @param arguments the call site's arguments
+ * @param parts set to the recipe's parts with their values
+ */
+void concat_recipe_parts(heap_t *heap, concat_recipe_t *recipe, const int32_t *arguments,
+                         string_part_t *parts);
+
+/**
+ * Concatenates values into a new string, like "" + a + b. The string is
+ * allocated by the current frame, whose pc must be up to date.
+ *
+ * @param parts the values
+ * @param part_count the number of values
+ * @return a reference to the string
+ */
+int32_t string_concat(heap_t *heap, const string_part_t *parts, size_t part_count);
+
+/**
+ * Writes the concatenation of values without creating a string.
+ *
+ * @param stream STDOUT_REFERENCE or STDERR_REFERENCE
+ * @param parts the values
+ * @param part_count the number of values
+ */
+void string_print_parts(int32_t stream, heap_t *heap, const string_part_t *parts,
+                        size_t part_count);
+
+/**
+ * Creates an empty StringBuilder. The builder is allocated by the current
+ * frame, whose pc must be up to date.
+ *
+ * @return a reference to the builder
+ */
+int32_t string_builder_new(heap_t *heap);
+
+/**
+ * Appends a value to a StringBuilder, like StringBuilder.append().
+ */
+void string_builder_append(heap_t *heap, int32_t builder, string_part_kind_t kind,
+                           int32_t value);
+
+/**
+ * Creates a string from a StringBuilder's contents, like StringBuilder.toString().
+ */
+int32_t string_builder_to_string(heap_t *heap, int32_t builder);
+
+/**
+ * Writes a StringBuilder's contents without creating a string.
+ *
+ * @param stream STDOUT_REFERENCE or STDERR_REFERENCE
+ */
+void string_builder_print(int32_t stream, heap_t *heap, int32_t builder);
+
+#endif /* JAVA_STRING_H */
@@ -2,13 +2,32 @@
 
 #include <assert.h>
 #include <inttypes.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "bytecode.h"
+#include "call_graph.h"
+#include "class_loader.h"
+#include "dispatch.h"
+#include "exception.h"
+#include "frame.h"
 #include "heap.h"
+#include "heap_dump.h"
+#include "image.h"
+#include "java_string.h"
+#include "mapped_file.h"
+#include "metrics.h"
+#include "native.h"
+#include "output.h"
+#include "prefetch.h"
+#include "quota.h"
 #include "read_class.h"
+#include "safepoint.h"
+#include "stats.h"
+#include "unroll.h"
 
 /** The name of the method to invoke to run the class file */
 const char MAIN_METHOD[] = "main";
@@ -21,17 +40,207 @@ const char MAIN_METHOD[] = "main";
 const char MAIN_DESCRIPTOR[] = "([Ljava/lang/String;)V";
 
 /**
- * Represents the return value of a Java method: either void or an int or a reference.
- * For simplification, we represent a reference as an index into a heap-allocated array.
- * (In a real JVM, methods could also return object references or other primitives.)
+ * Represents the return value of a Java method: either void or an int, float, double
+ * or reference. For simplification, we represent a reference as an index into a
+ * heap-allocated array. A method that throws an exception instead returns the exception.
  */
 typedef struct {
     /** Whether this returned value is an int */
     bool has_value;
-    /** The returned value (only valid if `has_value` is true) */
-    int32_t value;
+    /** Whether the returned value is a double, which takes two slots */
+    bool wide;
+    /** Whether the method threw the exception in `value` instead of returning */
+    bool threw;
+    /**
+     * The returned value (only valid if `has_value` or `threw` is true).
+     * A double's two slots are stored as one 64-bit value.
+     */
+    int64_t value;
 } optional_value_t;
 
+frame_t *current_frame = NULL;
+
+/**
+ * Gets the address of the field accessed by a quickened getfield or putfield,
+ * whose operand is the field's offset among the fields after the object's header.
+ */
+static inline u1 *field_address(heap_t *heap, int32_t ref, const u1 *bytecode, size_t pc) {
+    return (u1 *) &heap_get(heap, ref)[1] + operand_index(bytecode, pc);
+}
+
+/**
+ * Creates the exception thrown by an array access with an invalid index.
+ */
+static int32_t index_out_of_bounds(heap_t *heap, frame_t *frame, size_t pc, int32_t index,
+                                   int32_t length) {
+    char message[sizeof("Index  out of bounds for length ") + 2 * INT_DIGITS];
+    snprintf(message, sizeof(message), "Index %" PRId32 " out of bounds for length %" PRId32,
+             index, length);
+    frame->pc = pc;
+    return exception_new(heap, "java/lang/ArrayIndexOutOfBoundsException", message);
+}
+
+/** Describes what an instruction that throws NullPointerException was doing */
+static const char *null_pointer_message(u1 instruction) {
+    switch (instruction) {
+        case i_arraylength:
+            return "Cannot read the array length";
+        case i_iaload:
+        case i_faload:
+        case i_daload:
+        case i_aaload:
+            return "Cannot load from array";
+        case i_iastore:
+        case i_fastore:
+        case i_dastore:
+        case i_aastore:
+            return "Cannot store to array";
+        case i_putfield_int:
+        case i_putfield_short:
+        case i_putfield_byte:
+        case i_putfield_double:
+            return "Cannot assign field";
+        case i_invokevirtual_cached:
+        case i_invokeinterface_cached:
+        case i_invokenative:
+        case i_invokenative_virtual:
+        case i_print_builder:
+            return "Cannot invoke method";
+        default:
+            return "Cannot read field";
+    }
+}
+
+/**
+ * Creates the exception thrown by calling a method that was not resolved at
+ * link time, naming its Methodref, e.g. "Main.missing(I)V".
+ */
+static int32_t no_such_method(heap_t *heap, frame_t *frame, size_t pc) {
+    const char *class_name, *name, *descriptor;
+    get_member_ref(frame->method->class, operand_index(frame->method->code.code, pc),
+                   &class_name, &name, &descriptor);
+    char message[strlen(class_name) + strlen(name) + strlen(descriptor) + 2];
+    snprintf(message, sizeof(message), "%s.%s%s", class_name, name, descriptor);
+    frame->pc = pc;
+    return exception_new(heap, "java/lang/NoSuchMethodError", message);
+}
+
+/**
+ * Converts a float or double to an int like Java: NaN is 0, and values
+ * beyond the range of int saturate to Integer.MIN_VALUE or MAX_VALUE.
+ */
+static int32_t double_to_int(double value) {
+    if (isnan(value)) {
+        return 0;
+    }
+    if (value >= (double) INT32_MAX) {
+        return INT32_MAX;
+    }
+    if (value <= (double) INT32_MIN) {
+        return INT32_MIN;
+    }
+    return (int32_t) value;
+}
+
+/**
+ * Compares two floats or doubles like fcmpl/dcmpl or fcmpg/dcmpg,
+ * which differ only in how they compare NaN.
+ *
+ * @param nan_result the result if either value is NaN: -1 for the *cmpl instructions
+ *   and 1 for the *cmpg instructions
+ * @return -1, 0 or 1
+ */
+static int32_t compare_doubles(double a, double b, int32_t nan_result) {
+    if (a > b) {
+        return 1;
+    }
+    if (a == b) {
+        return 0;
+    }
+    return a < b ? -1 : nan_result;
+}
+
+/**
+ * Gets the `atype` of an array's elements from their field descriptor, e.g. "I".
+ */
+static u1 array_type(const char *descriptor) {
+    switch (descriptor[0]) {
+        case 'Z':
+            return 4;
+        case 'C':
+            return 5;
+        case 'F':
+            return 6;
+        case 'D':
+            return 7;
+        case 'B':
+            return 8;
+        case 'S':
+            return 9;
+        case 'I':
+            return 10;
+        case 'J':
+            return 11;
+        default:
+            return T_REFERENCE;
+    }
+}
+
+/**
+ * Allocates a multi-dimensional array, e.g. `new int[rows][columns]`, as one block:
+ * the outer array is followed by all the arrays of the next dimension, and so on.
+ * The rows of an int[][] are thus contiguous, in row-major order.
+ * The inner arrays are views into the block, which is freed with the outer array.
+ *
+ * @param frame the frame allocating the array
+ * @param descriptor the array's type, e.g. "[[I"
+ * @param counts the lengths of the first `dimensions` dimensions, none negative
+ * @param dimensions the number of dimensions to allocate; the arrays of any
+ *   further dimensions are null
+ * @return a reference to the outer array
+ */
+static int32_t new_multi_array(heap_t *heap, const frame_t *frame, const char *descriptor,
+                               const int32_t *counts, u1 dimensions) {
+    // Arrays of the last dimension allocated hold the elements, unless they are arrays too
+    u1 element_type = array_type(&descriptor[dimensions]);
+    // The size of each dimension is the number of its arrays times their length
+    size_t ints = 0;
+    size_t arrays = 1;
+    for (u1 d = 0; d < dimensions; d++) {
+        size_t element_ints = d + 1 == dimensions ? array_element_ints(element_type) : 1;
+        ints += arrays * (counts[d] * element_ints + 1);
+        arrays *= counts[d];
+    }
+    size_t bytes = ints * sizeof(int32_t);
+    quota_charge_heap(bytes, frame);
+    stats_add_bytes(MEM_HEAP_ARRAYS, bytes);
+    metrics_add(&thread_metrics->allocations, 1);
+    metrics_add(&thread_metrics->allocated_bytes, bytes);
+    int32_t *block = calloc(ints, sizeof(int32_t));
+    assert(block != NULL && "Failed to allocate multi-dimensional array");
+
+    block[0] = counts[0];
+    int32_t outer = heap_add(heap, block, dimensions == 1 ? element_type : T_REFERENCE,
+                             frame->method, frame->pc);
+    // Point each array of a dimension at the arrays of the next, which follow in order
+    int32_t *parent = block;
+    int32_t *child = block + counts[0] + 1;
+    arrays = 1;
+    for (u1 d = 0; d + 1 < dimensions; d++) {
+        u1 type = d + 2 == dimensions ? element_type : T_REFERENCE;
+        for (size_t i = 0; i < arrays; i++) {
+            for (int32_t j = 1; j <= counts[d]; j++) {
+                child[0] = counts[d + 1];
+                parent[j] = heap_add_view(heap, child, type, frame->method, frame->pc);
+                child += counts[d + 1] * array_element_ints(type) + 1;
+            }
+            parent += counts[d] + 1;
+        }
+        arrays *= counts[d];
+    }
+    return outer;
+}
+
 /**
  * Runs a method's instructions until the method returns.
  *
@@ -40,20 +249,38 @@ typedef struct {
  *   Except for parameters, the locals are uninitialized.
  * @param class the class file the method belongs to
  * @param heap an array of heap-allocated pointers, useful for references
- * @return an optional int containing the method's return value
+ * @return an optional int containing the method's return value,
+ *   or the exception the method threw and did not catch
  */
 optional_value_t execute(method_t *method, int32_t *locals, class_file_t *class,
                          heap_t *heap) {
+    assert(method->code.code != NULL && "Called a method stripped as unreachable");
     size_t pc = 0;
     u1 *bytecode = method->code.code;
     int32_t *stack = calloc(method->code.max_stack, sizeof(int32_t));
     size_t idx = 0;
+    // The exception being thrown, while looking for its handler
+    int32_t exception;
+    // The method an invoke calls, once it is resolved or dispatched
+    method_t *method_call;
+    frame_t frame = {.method = method,
+                     .locals = locals,
+                     .stack = stack,
+                     .depth = current_frame != NULL ? current_frame->depth + 1 : 1,
+                     .caller = current_frame};
+    current_frame = &frame;
+    quota_check_depth(&frame);
+    metrics_counters_t *metrics = thread_metrics;
+    metrics_add(&metrics->calls, 1);
+    safepoint_poll(&frame, 0);
     while (pc < method->code.code_length) {
         u1 instruction = bytecode[pc];
+        metrics_add(&metrics->instructions, 1);
         switch (instruction) {
             default:
-                pc += 1;
-                break;
+                fprintf(stderr, "Unsupported instruction 0x%02x at %s.%s%s:%zu\n", instruction,
+                        class->name, method->name, method->descriptor, pc);
+                exit(1);
             case i_bipush:;
                 stack[idx] = (int32_t)(int8_t) bytecode[pc + 1];
                 pc += 2;
@@ -65,17 +292,78 @@ optional_value_t execute(method_t *method, int32_t *locals, class_file_t *class,
                 pc += 1;
                 break;
             case i_return:;
+                current_frame = frame.caller;
                 free(stack);
                 optional_value_t result = {.has_value = false};
                 return result;
-            case i_getstatic:;
+            case i_invokenative:;
+            case i_invokenative_virtual:;
+                const native_method_t *native =
+                    class->resolved_natives[operand_index(bytecode, pc)];
+                idx -= native->arity;
+                if (native->receiver != NATIVE_STATIC && stack[idx] == NULL_REFERENCE) {
+                    goto null_pointer;
+                }
+                // Dispatch to the receiver class's override, if it has one
+                if (instruction == i_invokenative_virtual) {
+                    method_call = find_override(loaded_class(heap_get(heap, stack[idx])[0]),
+                                                native->name, native->descriptor);
+                    if (method_call != NULL) {
+                        idx += native->arity;
+                        goto call_method;
+                    }
+                }
+                frame.pc = pc;
+                int64_t native_result = native->function(&stack[idx], heap);
+                if (native_exception != NULL_REFERENCE) {
+                    exception = native_exception;
+                    native_exception = NULL_REFERENCE;
+                    goto throw_exception;
+                }
+                if (native->return_slots == 2) {
+                    memcpy(&stack[idx], &native_result, sizeof(native_result));
+                }
+                else if (native->return_slots == 1) {
+                    stack[idx] = (int32_t) native_result;
+                }
+                idx += native->return_slots;
                 pc += 3;
                 break;
-            case i_invokevirtual:;
-                idx -= 1;
-                printf("%i\n", stack[idx]);
+            case i_invokelibrary: {
+                const native_method_t *library_method =
+                    class->resolved_natives[operand_index(bytecode, pc)];
+                idx -= library_method->arity;
+                // Arrays are passed as pointers to their elements, without copying
+                teeny_arg_t library_args[library_method->arity + 1];
+                for (u2 i = 0; i < library_method->arity; i++) {
+                    if ((library_method->array_arguments >> i) & 1) {
+                        library_args[i].elements = stack[idx + i] == NULL_REFERENCE
+                                                       ? NULL
+                                                       : heap_get(heap, stack[idx + i]) + 1;
+                    }
+                    else {
+                        library_args[i].i = stack[idx + i];
+                    }
+                }
+                int32_t library_result = library_method->library_function(library_args);
+                if (library_method->return_slots > 0) {
+                    stack[idx] = library_result;
+                    idx += 1;
+                }
                 pc += 3;
                 break;
+            }
+            case i_invokevirtual:;
+            case i_invokeinterface:;
+                // Natives and loaded classes' methods were quickened at link time,
+                // so this method is unknown
+                exception = no_such_method(heap, &frame, pc);
+                goto throw_exception;
+            case i_aconst_null:
+                stack[idx] = NULL_REFERENCE;
+                idx += 1;
+                pc += 1;
+                break;
             case i_iconst_m1:
             case i_iconst_0:
             case i_iconst_1:
@@ -87,6 +375,19 @@ optional_value_t execute(method_t *method, int32_t *locals, class_file_t *class,
                 idx += 1;
                 pc += 1;
                 break;
+            case i_fconst_0:
+            case i_fconst_1:
+            case i_fconst_2:
+                stack[idx] = float_slot(instruction - i_fconst_0);
+                idx += 1;
+                pc += 1;
+                break;
+            case i_dconst_0:
+            case i_dconst_1:
+                put_double(&stack[idx], instruction - i_dconst_0);
+                idx += 2;
+                pc += 1;
+                break;
             case i_sipush:;
                 stack[idx] = (signed short) ((bytecode[pc + 1] << 8) | bytecode[pc + 2]);
                 idx += 1;
@@ -103,14 +404,24 @@ optional_value_t execute(method_t *method, int32_t *locals, class_file_t *class,
                 pc += 1;
                 break;
             case i_idiv:;
-                assert(stack[idx - 1] != 0);
-                stack[idx - 2] = stack[idx - 2] / stack[idx - 1];
+                if (stack[idx - 1] == 0) {
+                    frame.pc = pc;
+                    exception = exception_new(heap, "java/lang/ArithmeticException", "/ by zero");
+                    goto throw_exception;
+                }
+                // INT_MIN / -1 overflows in C, but wraps around to INT_MIN in Java
+                stack[idx - 2] = stack[idx - 1] == -1 ? (int32_t) -(uint32_t) stack[idx - 2]
+                                                      : stack[idx - 2] / stack[idx - 1];
                 idx -= 1;
                 pc += 1;
                 break;
             case i_irem:;
-                assert(stack[idx - 1] != 0);
-                stack[idx - 2] = stack[idx - 2] % stack[idx - 1];
+                if (stack[idx - 1] == 0) {
+                    frame.pc = pc;
+                    exception = exception_new(heap, "java/lang/ArithmeticException", "/ by zero");
+                    goto throw_exception;
+                }
+                stack[idx - 2] = stack[idx - 1] == -1 ? 0 : stack[idx - 2] % stack[idx - 1];
                 idx -= 1;
                 pc += 1;
                 break;
@@ -151,12 +462,123 @@ optional_value_t execute(method_t *method, int32_t *locals, class_file_t *class,
                 idx -= 1;
                 pc += 1;
                 break;
+            case i_fadd:
+                stack[idx - 2] = float_slot(get_float(stack[idx - 2]) + get_float(stack[idx - 1]));
+                idx -= 1;
+                pc += 1;
+                break;
+            case i_fsub:
+                stack[idx - 2] = float_slot(get_float(stack[idx - 2]) - get_float(stack[idx - 1]));
+                idx -= 1;
+                pc += 1;
+                break;
+            case i_fmul:
+                stack[idx - 2] = float_slot(get_float(stack[idx - 2]) * get_float(stack[idx - 1]));
+                idx -= 1;
+                pc += 1;
+                break;
+            case i_fdiv:
+                stack[idx - 2] = float_slot(get_float(stack[idx - 2]) / get_float(stack[idx - 1]));
+                idx -= 1;
+                pc += 1;
+                break;
+            case i_frem:
+                // Java's % truncates the quotient, like fmod()
+                stack[idx - 2] =
+                    float_slot(fmodf(get_float(stack[idx - 2]), get_float(stack[idx - 1])));
+                idx -= 1;
+                pc += 1;
+                break;
+            case i_fneg:
+                stack[idx - 1] = float_slot(-get_float(stack[idx - 1]));
+                pc += 1;
+                break;
+            case i_dadd:
+                put_double(&stack[idx - 4],
+                           get_double(&stack[idx - 4]) + get_double(&stack[idx - 2]));
+                idx -= 2;
+                pc += 1;
+                break;
+            case i_dsub:
+                put_double(&stack[idx - 4],
+                           get_double(&stack[idx - 4]) - get_double(&stack[idx - 2]));
+                idx -= 2;
+                pc += 1;
+                break;
+            case i_dmul:
+                put_double(&stack[idx - 4],
+                           get_double(&stack[idx - 4]) * get_double(&stack[idx - 2]));
+                idx -= 2;
+                pc += 1;
+                break;
+            case i_ddiv:
+                put_double(&stack[idx - 4],
+                           get_double(&stack[idx - 4]) / get_double(&stack[idx - 2]));
+                idx -= 2;
+                pc += 1;
+                break;
+            case i_drem:
+                put_double(&stack[idx - 4],
+                           fmod(get_double(&stack[idx - 4]), get_double(&stack[idx - 2])));
+                idx -= 2;
+                pc += 1;
+                break;
+            case i_dneg:
+                put_double(&stack[idx - 2], -get_double(&stack[idx - 2]));
+                pc += 1;
+                break;
+            case i_i2f:
+                stack[idx - 1] = float_slot(stack[idx - 1]);
+                pc += 1;
+                break;
+            case i_i2d:
+                put_double(&stack[idx - 1], stack[idx - 1]);
+                idx += 1;
+                pc += 1;
+                break;
+            case i_f2i:
+                stack[idx - 1] = double_to_int(get_float(stack[idx - 1]));
+                pc += 1;
+                break;
+            case i_f2d:
+                put_double(&stack[idx - 1], get_float(stack[idx - 1]));
+                idx += 1;
+                pc += 1;
+                break;
+            case i_d2i:
+                stack[idx - 2] = double_to_int(get_double(&stack[idx - 2]));
+                idx -= 1;
+                pc += 1;
+                break;
+            case i_d2f:
+                stack[idx - 2] = float_slot(get_double(&stack[idx - 2]));
+                idx -= 1;
+                pc += 1;
+                break;
+            case i_fcmpl:
+            case i_fcmpg:
+                stack[idx - 2] = compare_doubles(get_float(stack[idx - 2]),
+                                                 get_float(stack[idx - 1]),
+                                                 instruction == i_fcmpg ? 1 : -1);
+                idx -= 1;
+                pc += 1;
+                break;
+            case i_dcmpl:
+            case i_dcmpg:
+                stack[idx - 4] = compare_doubles(get_double(&stack[idx - 4]),
+                                                 get_double(&stack[idx - 2]),
+                                                 instruction == i_dcmpg ? 1 : -1);
+                idx -= 3;
+                pc += 1;
+                break;
             case i_iload:;
+            case i_fload:;
                 stack[idx] = locals[bytecode[pc + 1]];
                 pc += 2;
                 idx += 1;
                 break;
             case i_istore:;
+            case i_fstore:;
                 locals[bytecode[pc + 1]] = stack[idx - 1];
                 idx -= 1;
                 pc += 2;
@@ -173,6 +595,27 @@ optional_value_t execute(method_t *method, int32_t *locals, class_file_t *class,
                 pc += 1;
                 idx += 1;
                 break;
+            case i_fload_0:
+            case i_fload_1:
+            case i_fload_2:
+            case i_fload_3:
+                stack[idx] = locals[instruction - i_fload_0];
+                pc += 1;
+                idx += 1;
+                break;
+            case i_dload:
+            case i_dload_0:
+            case i_dload_1:
+            case i_dload_2:
+            case i_dload_3: {
+                // A double spans two locals, like two operand stack entries
+                u1 local = instruction == i_dload ? bytecode[pc + 1] : instruction - i_dload_0;
+                stack[idx] = locals[local];
+                stack[idx + 1] = locals[local + 1];
+                pc += instruction == i_dload ? 2 : 1;
+                idx += 2;
+                break;
+            }
             case i_istore_0:
             case i_istore_1:
             case i_istore_2:
@@ -181,133 +624,225 @@ optional_value_t execute(method_t *method, int32_t *locals, class_file_t *class,
                 idx -= 1;
                 pc += 1;
                 break;
+            case i_fstore_0:
+            case i_fstore_1:
+            case i_fstore_2:
+            case i_fstore_3:
+                locals[instruction - i_fstore_0] = stack[idx - 1];
+                idx -= 1;
+                pc += 1;
+                break;
+            case i_dstore:
+            case i_dstore_0:
+            case i_dstore_1:
+            case i_dstore_2:
+            case i_dstore_3: {
+                u1 local = instruction == i_dstore ? bytecode[pc + 1] : instruction - i_dstore_0;
+                locals[local] = stack[idx - 2];
+                locals[local + 1] = stack[idx - 1];
+                pc += instruction == i_dstore ? 2 : 1;
+                idx -= 2;
+                break;
+            }
             case i_ldc:;
+            case i_ldc_w: {
+                // An int or float constant; ldc_w takes a 2-byte index for large pools
+                u2 constant = instruction == i_ldc ? bytecode[pc + 1] : operand_index(bytecode, pc);
                 stack[idx] =
-                    ((CONSTANT_Integer_info *) class->constant_pool[bytecode[pc + 1] - 1]
-                         .info)
-                        ->bytes;
-                pc += 2;
+                    ((CONSTANT_Integer_info *) class->constant_pool[constant - 1].info)->bytes;
+                pc += instruction == i_ldc ? 2 : 3;
                 idx += 1;
                 break;
-            case i_ifeq:;
-                if (stack[idx - 1] == 0) {
-                    pc += (int16_t)(bytecode[pc + 1] << 8 | bytecode[pc + 2]);
+            }
+            case i_ldc2_w:;
+                // A double constant is represented by its bits, like a long
+                const CONSTANT_Long_info *wide_constant =
+                    class->constant_pool[operand_index(bytecode, pc) - 1].info;
+                memcpy(&stack[idx], &wide_constant->bytes, sizeof(wide_constant->bytes));
+                pc += 3;
+                idx += 2;
+                break;
+            case i_ldc_string:;
+            case i_ldc_w_string: {
+                u2 index = instruction == i_ldc_string ? bytecode[pc + 1]
+                                                       : operand_index(bytecode, pc);
+                int32_t *string = &class->resolved_strings[index];
+                if (*string == NULL_REFERENCE) {
+                    const CONSTANT_String_info *constant = class->constant_pool[index - 1].info;
+                    const char *chars = class->constant_pool[constant->string_index - 1].info;
+                    frame.pc = pc;
+                    *string = string_intern(heap, chars, strlen(chars));
+                }
+                stack[idx] = *string;
+                pc += instruction == i_ldc_string ? 2 : 3;
+                idx += 1;
+                break;
+            }
+            case i_concat:
+            case i_print_concat: {
+                concat_recipe_t *recipe = class->resolved_concats[operand_index(bytecode, pc)];
+                idx -= recipe->argument_count;
+                string_part_t parts[recipe->part_count + 1];
+                frame.pc = pc;
+                concat_recipe_parts(heap, recipe, &stack[idx], parts);
+                if (instruction == i_concat) {
+                    stack[idx] = string_concat(heap, parts, recipe->part_count);
+                    idx += 1;
+                    pc += 5;
+                }
+                else {
                     idx -= 1;
-                    break;
+                    string_print_parts(stack[idx], heap, parts, recipe->part_count);
+                    if (bytecode[pc + 3]) {
+                        output_write(stack[idx], "\n", 1);
+                    }
+                    pc += 8;
                 }
+                break;
+            }
+            case i_new_builder:;
+                frame.pc = pc;
+                stack[idx] = string_builder_new(heap);
+                idx += 1;
                 pc += 3;
+                break;
+            case i_print_builder:;
+                idx -= 2;
+                if (stack[idx + 1] == NULL_REFERENCE) {
+                    goto null_pointer;
+                }
+                string_builder_print(stack[idx], heap, stack[idx + 1]);
+                if (bytecode[pc + 3]) {
+                    output_write(stack[idx], "\n", 1);
+                }
+                pc += 6;
+                break;
+            case i_ifeq:;
+            case i_ifnull:;
                 idx -= 1;
+                if (stack[idx] == 0) {
+                    goto branch;
+                }
+                pc += 3;
                 break;
             case i_ifne:;
-                if (stack[idx - 1] != 0) {
-                    pc += (int16_t)(bytecode[pc + 1] << 8 | bytecode[pc + 2]);
-                    idx -= 1;
-                    break;
+            case i_ifnonnull:;
+                idx -= 1;
+                if (stack[idx] != 0) {
+                    goto branch;
                 }
                 pc += 3;
-                idx -= 1;
                 break;
             case i_iflt:;
-                if (stack[idx - 1] < 0) {
-                    pc += (int16_t)(bytecode[pc + 1] << 8 | bytecode[pc + 2]);
-                    idx -= 1;
-                    break;
+                idx -= 1;
+                if (stack[idx] < 0) {
+                    goto branch;
                 }
                 pc += 3;
-                idx -= 1;
                 break;
             case i_ifge:;
-                if (stack[idx - 1] >= 0) {
-                    pc += (int16_t)(bytecode[pc + 1] << 8 | bytecode[pc + 2]);
-                    idx -= 1;
-                    break;
+                idx -= 1;
+                if (stack[idx] >= 0) {
+                    goto branch;
                 }
                 pc += 3;
-                idx -= 1;
                 break;
             case i_ifgt:;
-                if (stack[idx - 1] > 0) {
-                    pc += (int16_t)(bytecode[pc + 1] << 8 | bytecode[pc + 2]);
-                    idx -= 1;
-                    break;
+                idx -= 1;
+                if (stack[idx] > 0) {
+                    goto branch;
                 }
                 pc += 3;
-                idx -= 1;
                 break;
             case i_ifle:;
-                if (stack[idx - 1] <= 0) {
-                    pc += (int16_t)(bytecode[pc + 1] << 8 | bytecode[pc + 2]);
-                    idx -= 1;
-                    break;
+                idx -= 1;
+                if (stack[idx] <= 0) {
+                    goto branch;
                 }
                 pc += 3;
-                idx -= 1;
                 break;
             case i_if_icmpeq:;
-                if (stack[idx - 1] == stack[idx - 2]) {
-                    pc += (int16_t)(bytecode[pc + 1] << 8 | bytecode[pc + 2]);
-                    idx -= 2;
-                    break;
+            case i_if_acmpeq:;
+                idx -= 2;
+                if (stack[idx + 1] == stack[idx]) {
+                    goto branch;
                 }
                 pc += 3;
-                idx -= 2;
                 break;
             case i_if_icmpne:;
-                if (stack[idx - 1] != stack[idx - 2]) {
-                    pc += (int16_t)(bytecode[pc + 1] << 8 | bytecode[pc + 2]);
-                    idx -= 2;
-                    break;
+            case i_if_acmpne:;
+                idx -= 2;
+                if (stack[idx + 1] != stack[idx]) {
+                    goto branch;
                 }
                 pc += 3;
-                idx -= 2;
                 break;
             case i_if_icmplt:;
-                if (stack[idx - 2] < stack[idx - 1]) {
-                    pc += (int16_t)(bytecode[pc + 1] << 8 | bytecode[pc + 2]);
-                    idx -= 2;
-                    break;
+                idx -= 2;
+                if (stack[idx] < stack[idx + 1]) {
+                    goto branch;
                 }
                 pc += 3;
-                idx -= 2;
                 break;
             case i_if_icmpge:;
-                if (stack[idx - 2] >= stack[idx - 1]) {
-                    pc += (int16_t)(bytecode[pc + 1] << 8 | bytecode[pc + 2]);
-                    idx -= 2;
-                    break;
+                idx -= 2;
+                if (stack[idx] >= stack[idx + 1]) {
+                    goto branch;
                 }
                 pc += 3;
-                idx -= 2;
                 break;
             case i_if_icmpgt:;
-                if (stack[idx - 2] > stack[idx - 1]) {
-                    pc += (int16_t)(bytecode[pc + 1] << 8 | bytecode[pc + 2]);
-                    idx -= 2;
-                    break;
+                idx -= 2;
+                if (stack[idx] > stack[idx + 1]) {
+                    goto branch;
                 }
                 pc += 3;
-                idx -= 2;
                 break;
             case i_if_icmple:;
-                if (stack[idx - 2] <= stack[idx - 1]) {
-                    pc += (int16_t)(bytecode[pc + 1] << 8 | bytecode[pc + 2]);
-                    idx -= 2;
-                    break;
+                idx -= 2;
+                if (stack[idx] <= stack[idx + 1]) {
+                    goto branch;
                 }
                 pc += 3;
-                idx -= 2;
                 break;
-            case i_goto:;
-                pc += (int16_t)(bytecode[pc + 1] << 8 | bytecode[pc + 2]);
+            case i_goto:
+            branch:;
+                int16_t offset = branch_offset(bytecode, pc);
+                // Backward branches are safepoints, so loops can always be stopped
+                if (offset < 0) {
+                    safepoint_poll(&frame, pc);
+                }
+                pc += offset;
                 break;
             case i_ireturn:;
+            case i_freturn:;
                 optional_value_t conditional_result = {.has_value = true,
                                                        .value = stack[idx - 1]};
+                current_frame = frame.caller;
                 free(stack);
                 return conditional_result;
             case i_invokestatic:;
-                method_t *method_call = find_method_from_index(
-                    (int16_t)(bytecode[pc + 1] << 8 | bytecode[pc + 2]), class);
+            case i_invokespecial:;
+            case i_invokevirtual_cached:;
+            case i_invokeinterface_cached:;
+                if (instruction == i_invokevirtual_cached ||
+                    instruction == i_invokeinterface_cached) {
+                    // Dispatch on the class in the receiver's header
+                    inline_cache_t *cache = &class->inline_caches[operand_index(bytecode, pc)];
+                    int32_t receiver = stack[idx - get_number_of_parameters(cache->method)];
+                    if (receiver == NULL_REFERENCE) {
+                        goto null_pointer;
+                    }
+                    method_call = inline_cache_lookup(cache, heap_get(heap, receiver)[0]);
+                }
+                else {
+                    method_call = class->resolved_methods[operand_index(bytecode, pc)];
+                    if (method_call == NULL) {
+                        exception = no_such_method(heap, &frame, pc);
+                        goto throw_exception;
+                    }
+                }
+            call_method:;
                 int32_t *local_queue =
                     calloc((method_call->code.max_locals), sizeof(int32_t));
                 // stack to queue means highest idx in stack goes to lowest idx in queue
@@ -315,53 +850,330 @@ optional_value_t execute(method_t *method, int32_t *locals, class_file_t *class,
                     local_queue[i] = stack[idx - 1];
                     idx -= 1;
                 }
+                // Calls are safepoints for the caller
+                frame.pc = pc;
                 optional_value_t method_call_result =
-                    execute(method_call, local_queue, class, heap);
-                if (method_call_result.has_value) {
-                    stack[idx] = method_call_result.value;
+                    execute(method_call, local_queue, method_call->class, heap);
+                free(local_queue);
+                if (method_call_result.threw) {
+                    exception = (int32_t) method_call_result.value;
+                    goto throw_exception;
+                }
+                if (method_call_result.wide) {
+                    memcpy(&stack[idx], &method_call_result.value, sizeof(int64_t));
+                    idx += 2;
+                }
+                else if (method_call_result.has_value) {
+                    stack[idx] = (int32_t) method_call_result.value;
                     idx += 1;
                 }
-                pc += 3;
-                free(local_queue);
+                pc += instruction == i_invokeinterface_cached ? 5 : 3;
+                break;
+            null_pointer:;
+                frame.pc = pc;
+                exception = exception_new(heap, "java/lang/NullPointerException",
+                                          null_pointer_message(instruction));
+                goto throw_exception;
+            case i_athrow:
+                exception = stack[idx - 1];
+                if (exception == NULL_REFERENCE) {
+                    frame.pc = pc;
+                    exception = exception_new(heap, "java/lang/NullPointerException",
+                                              "Cannot throw a null exception");
+                }
+            throw_exception:;
+                // The exception table is only consulted once an exception is thrown
+                int32_t handler_pc = exception_find_handler(&method->code, pc, heap, exception);
+                if (handler_pc < 0) {
+                    current_frame = frame.caller;
+                    free(stack);
+                    optional_value_t thrown = {.threw = true, .value = exception};
+                    return thrown;
+                }
+                // The handler starts with just the exception on the stack
+                stack[0] = exception;
+                idx = 1;
+                pc = handler_pc;
                 break;
             case i_nop:;
                 pc += 1;
                 break;
+            case i_pop:;
+                idx -= 1;
+                pc += 1;
+                break;
             case i_dup:;
                 stack[idx] = stack[idx - 1];
                 idx += 1;
                 pc += 1;
                 break;
+            case i_pop2:
+                idx -= 2;
+                pc += 1;
+                break;
+            case i_dup2:
+                stack[idx] = stack[idx - 2];
+                stack[idx + 1] = stack[idx - 1];
+                idx += 2;
+                pc += 1;
+                break;
+            case i_new_object: {
+                const class_file_t *object_class = loaded_class(operand_index(bytecode, pc));
+                size_t bytes = object_bytes(object_class);
+                frame.pc = pc;
+                quota_charge_heap(bytes, &frame);
+                stats_add_bytes(MEM_HEAP_ARRAYS, bytes);
+                metrics_add(&metrics->allocations, 1);
+                metrics_add(&metrics->allocated_bytes, bytes);
+                int32_t *object = calloc(1, bytes);
+                assert(object != NULL && "Failed to allocate object");
+                // The header holds the class's id; the fields are zeroed
+                object[0] = object_class->id;
+                stack[idx] = heap_add(heap, object, T_OBJECT, method, pc);
+                idx += 1;
+                pc += 3;
+                break;
+            }
+            case i_getfield_int:
+            case i_getfield_reference:
+                if (stack[idx - 1] == NULL_REFERENCE) {
+                    goto null_pointer;
+                }
+                stack[idx - 1] = *(int32_t *) field_address(heap, stack[idx - 1], bytecode, pc);
+                pc += 3;
+                break;
+            case i_getfield_short:
+                if (stack[idx - 1] == NULL_REFERENCE) {
+                    goto null_pointer;
+                }
+                stack[idx - 1] = *(int16_t *) field_address(heap, stack[idx - 1], bytecode, pc);
+                pc += 3;
+                break;
+            case i_getfield_char:
+                if (stack[idx - 1] == NULL_REFERENCE) {
+                    goto null_pointer;
+                }
+                stack[idx - 1] = *(uint16_t *) field_address(heap, stack[idx - 1], bytecode, pc);
+                pc += 3;
+                break;
+            case i_getfield_byte:
+                if (stack[idx - 1] == NULL_REFERENCE) {
+                    goto null_pointer;
+                }
+                stack[idx - 1] = *(int8_t *) field_address(heap, stack[idx - 1], bytecode, pc);
+                pc += 3;
+                break;
+            case i_getfield_double:
+                if (stack[idx - 1] == NULL_REFERENCE) {
+                    goto null_pointer;
+                }
+                memcpy(&stack[idx - 1], field_address(heap, stack[idx - 1], bytecode, pc),
+                       sizeof(double));
+                idx += 1;
+                pc += 3;
+                break;
+            case i_putfield_double:
+                if (stack[idx - 3] == NULL_REFERENCE) {
+                    goto null_pointer;
+                }
+                memcpy(field_address(heap, stack[idx - 3], bytecode, pc), &stack[idx - 2],
+                       sizeof(double));
+                idx -= 3;
+                pc += 3;
+                break;
+            case i_putfield_int:
+                if (stack[idx - 2] == NULL_REFERENCE) {
+                    goto null_pointer;
+                }
+                *(int32_t *) field_address(heap, stack[idx - 2], bytecode, pc) = stack[idx - 1];
+                idx -= 2;
+                pc += 3;
+                break;
+            case i_putfield_short:
+                if (stack[idx - 2] == NULL_REFERENCE) {
+                    goto null_pointer;
+                }
+                *(int16_t *) field_address(heap, stack[idx - 2], bytecode, pc) = stack[idx - 1];
+                idx -= 2;
+                pc += 3;
+                break;
+            case i_putfield_byte:
+                if (stack[idx - 2] == NULL_REFERENCE) {
+                    goto null_pointer;
+                }
+                *(int8_t *) field_address(heap, stack[idx - 2], bytecode, pc) = stack[idx - 1];
+                idx -= 2;
+                pc += 3;
+                break;
             case i_newarray:;
-                assert(stack[idx - 1] >= 0);
-                int32_t *new_arr = calloc(stack[idx - 1] + 1, sizeof(int32_t));
+            case i_anewarray:;
+                if (stack[idx - 1] < 0) {
+                    char size[INT_DIGITS + 1];
+                    snprintf(size, sizeof(size), "%" PRId32, stack[idx - 1]);
+                    frame.pc = pc;
+                    exception = exception_new(heap, "java/lang/NegativeArraySizeException", size);
+                    goto throw_exception;
+                }
+                // anewarray's operand is the element class, which is not needed
+                u1 type = instruction == i_newarray ? bytecode[pc + 1] : T_REFERENCE;
+                size_t array_ints = (size_t) stack[idx - 1] * array_element_ints(type) + 1;
+                // Charge the quota first, so an over-budget array is never allocated
+                frame.pc = pc;
+                quota_charge_heap(array_ints * sizeof(int32_t), &frame);
+                stats_add_bytes(MEM_HEAP_ARRAYS, array_ints * sizeof(int32_t));
+                metrics_add(&metrics->allocations, 1);
+                metrics_add(&metrics->allocated_bytes, array_ints * sizeof(int32_t));
+                // calloc initializes the elements to their default value, 0
+                int32_t *new_arr = calloc(array_ints, sizeof(int32_t));
+                assert(new_arr != NULL && "Failed to allocate array");
                 // stores the length in the first idx
                 new_arr[0] = stack[idx - 1];
-                // initialize to default type, int32_t = 0
-                for (int32_t i = 1; i <= stack[idx - 1]; i++) {
-                    new_arr[i] = 0;
-                }
-                int32_t reference = heap_add(heap, new_arr);
+                int32_t reference = heap_add(heap, new_arr, type, method, pc);
                 stack[idx - 1] = reference;
-                pc += 2;
+                pc += instruction == i_newarray ? 2 : 3;
+                break;
+            case i_prefetch: {
+                // Only a hint, so the locals may hold anything without harm. Strides
+                // shorter than a cache line are left to the hardware prefetcher.
+                int32_t prefetch_ref = locals[bytecode[pc + 1]];
+                int32_t stride = locals[bytecode[pc + 3]];
+                if (stride > 0 && 0 < prefetch_ref && prefetch_ref < heap_count(heap)) {
+                    const heap_entry_t *entry = heap_entry(heap, prefetch_ref);
+                    int64_t ahead =
+                        locals[bytecode[pc + 2]] + (int64_t) PREFETCH_ITERATIONS * stride;
+                    if (entry->ptr != NULL && entry->type != T_OBJECT) {
+                        // The stride in ints, since doubles take two
+                        size_t element_ints = array_element_ints(entry->type);
+                        if ((int64_t) stride * element_ints >= PREFETCH_MIN_STRIDE &&
+                            0 <= ahead && ahead < entry->ptr[0]) {
+                            __builtin_prefetch(&entry->ptr[1 + ahead * element_ints]);
+                        }
+                    }
+                }
+                pc += 4;
+                break;
+            }
+            case i_array_literal: {
+                const array_literal_t *literal =
+                    &class->array_literals[operand_index(bytecode, pc)];
+                int32_t *literal_arr = heap_get(heap, stack[idx - 1]);
+                // The array's length is usually a constant, but it might be too short
+                u4 count = (u4) literal_arr[0] < literal->element_count ? (u4) literal_arr[0]
+                                                                         : literal->element_count;
+                size_t element_ints = array_element_ints(literal->type);
+                memcpy(&literal_arr[1], literal->values, sizeof(int32_t[count * element_ints]));
+                if (count < literal->element_count) {
+                    exception = index_out_of_bounds(heap, &frame, pc, count, literal_arr[0]);
+                    goto throw_exception;
+                }
+                pc += literal->code_length;
+                break;
+            }
+            case i_multianewarray: {
+                u1 dimensions = bytecode[pc + 3];
+                idx -= dimensions;
+                frame.pc = pc;
+                for (u1 d = 0; d < dimensions; d++) {
+                    if (stack[idx + d] < 0) {
+                        char size[INT_DIGITS + 1];
+                        snprintf(size, sizeof(size), "%" PRId32, stack[idx + d]);
+                        exception =
+                            exception_new(heap, "java/lang/NegativeArraySizeException", size);
+                        goto throw_exception;
+                    }
+                }
+                const char *descriptor = get_class_name(class, operand_index(bytecode, pc));
+                stack[idx] = new_multi_array(heap, &frame, descriptor, &stack[idx], dimensions);
+                idx += 1;
+                pc += 4;
                 break;
+            }
             case i_arraylength:;
+                if (stack[idx - 1] == NULL_REFERENCE) {
+                    goto null_pointer;
+                }
                 stack[idx - 1] = heap_get(heap, stack[idx - 1])[0];
                 pc += 1;
                 break;
+            case i_dreturn:;
+                optional_value_t double_result = {.has_value = true, .wide = true};
+                memcpy(&double_result.value, &stack[idx - 2], sizeof(double_result.value));
+                current_frame = frame.caller;
+                free(stack);
+                return double_result;
             case i_areturn:;
                 optional_value_t reference_result = {.has_value = true,
                                                      .value = stack[idx - 1]};
+                current_frame = frame.caller;
                 free(stack);
                 return reference_result;
             case i_iastore:;
-                int32_t *store_arr = heap_get(heap, stack[idx - 3]);
+            case i_fastore:;
+            case i_aastore:;
+                if (stack[idx - 3] == NULL_REFERENCE) {
+                    goto null_pointer;
+                }
+                const heap_entry_t *store_entry = heap_entry(heap, stack[idx - 3]);
+                int32_t *store_arr = store_entry->ptr;
+                if ((uint32_t) stack[idx - 2] >= (uint32_t) store_arr[0]) {
+                    exception =
+                        index_out_of_bounds(heap, &frame, pc, stack[idx - 2], store_arr[0]);
+                    goto throw_exception;
+                }
+                // A store to a file mapped read-only would fault, so it throws instead
+                if (__builtin_expect(store_entry->read_only, 0)) {
+                    frame.pc = pc;
+                    exception = exception_new(heap, "java/nio/ReadOnlyBufferException",
+                                              "Cannot store to a read-only array");
+                    goto throw_exception;
+                }
                 store_arr[stack[idx - 2] + 1] = stack[idx - 1];
                 pc += 1;
                 idx -= 3;
                 break;
+            case i_dastore: {
+                if (stack[idx - 4] == NULL_REFERENCE) {
+                    goto null_pointer;
+                }
+                int32_t *double_arr = heap_get(heap, stack[idx - 4]);
+                if ((uint32_t) stack[idx - 3] >= (uint32_t) double_arr[0]) {
+                    exception =
+                        index_out_of_bounds(heap, &frame, pc, stack[idx - 3], double_arr[0]);
+                    goto throw_exception;
+                }
+                // Each double takes two ints, stored like its two slots
+                memcpy(&double_arr[1 + 2 * stack[idx - 3]], &stack[idx - 2], sizeof(double));
+                pc += 1;
+                idx -= 4;
+                break;
+            }
+            case i_daload: {
+                if (stack[idx - 2] == NULL_REFERENCE) {
+                    goto null_pointer;
+                }
+                int32_t *double_arr = heap_get(heap, stack[idx - 2]);
+                if ((uint32_t) stack[idx - 1] >= (uint32_t) double_arr[0]) {
+                    exception =
+                        index_out_of_bounds(heap, &frame, pc, stack[idx - 1], double_arr[0]);
+                    goto throw_exception;
+                }
+                memcpy(&stack[idx - 2], &double_arr[1 + 2 * stack[idx - 1]], sizeof(double));
+                pc += 1;
+                break;
+            }
             case i_iaload:;
-                stack[idx - 2] = heap_get(heap, stack[idx - 2])[stack[idx - 1] + 1];
+            case i_faload:;
+            case i_aaload:;
+                if (stack[idx - 2] == NULL_REFERENCE) {
+                    goto null_pointer;
+                }
+                int32_t *load_arr = heap_get(heap, stack[idx - 2]);
+                if ((uint32_t) stack[idx - 1] >= (uint32_t) load_arr[0]) {
+                    exception =
+                        index_out_of_bounds(heap, &frame, pc, stack[idx - 1], load_arr[0]);
+                    goto throw_exception;
+                }
+                stack[idx - 2] = load_arr[stack[idx - 1] + 1];
                 idx -= 1;
                 pc += 1;
                 break;
@@ -393,43 +1205,199 @@ optional_value_t execute(method_t *method, int32_t *locals, class_file_t *class,
                 break;
         }
     }
+    current_frame = frame.caller;
     free(stack);
     optional_value_t result = {.has_value = false};
     return result;
 }
 
+/**
+ * Parses the numeric value of an option like -Xmaxheap:1000000.
+ * Exits with a usage error if the value is not a positive integer.
+ */
+static uint64_t parse_option_value(const char *option, const char *value) {
+    char *end;
+    unsigned long long result = strtoull(value, &end, 10);
+    if (*value == '\0' || *value == '-' || *end != '\0' || result == 0) {
+        fprintf(stderr, "Invalid value for option %s\n", option);
+        exit(1);
+    }
+    return result;
+}
+
+/**
+ * Creates the String[] passed to main() from command-line arguments.
+ * The strings and the array are allocated by the current frame.
+ *
+ * @param count the number of arguments
+ * @param arguments the arguments, encoded as UTF-8
+ * @return a reference to the array of strings
+ */
+static int32_t create_arguments(heap_t *heap, int count, char **arguments) {
+    size_t bytes = (count + 1) * sizeof(int32_t);
+    quota_charge_heap(bytes, current_frame);
+    stats_add_bytes(MEM_HEAP_ARRAYS, bytes);
+    metrics_add(&thread_metrics->allocations, 1);
+    metrics_add(&thread_metrics->allocated_bytes, bytes);
+    int32_t *array = malloc(bytes);
+    assert(array != NULL && "Failed to allocate arguments");
+    array[0] = count;
+    for (int i = 0; i < count; i++) {
+        array[i + 1] = string_from_utf8(heap, arguments[i], strlen(arguments[i]));
+    }
+    return heap_add(heap, array, T_REFERENCE, current_frame->method, current_frame->pc);
+}
+
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "USAGE: %s <class file>\n", argv[0]);
+    // Options come before the class file. An application image has neither,
+    // so all its arguments are the program's.
+    bool embedded = image_embedded();
+    const char *heap_dump_path = NULL;
+    const char *image_path = NULL;
+    bool print_method_effects = false;
+    quota_limits_t limits = {0};
+    int arg = 1;
+    for (; !embedded && arg < argc && argv[arg][0] == '-'; arg++) {
+        if (strcmp(argv[arg], "-Xstats") == 0) {
+            stats_enabled = true;
+        }
+        else if (strncmp(argv[arg], "-Xheapdump:", strlen("-Xheapdump:")) == 0) {
+            heap_dump_path = argv[arg] + strlen("-Xheapdump:");
+        }
+        else if (strncmp(argv[arg], "-Xmetrics:", strlen("-Xmetrics:")) == 0) {
+            metrics_serve(argv[arg] + strlen("-Xmetrics:"));
+        }
+        else if (strncmp(argv[arg], "-Xbudget:", strlen("-Xbudget:")) == 0) {
+            limits.budget = parse_option_value(argv[arg], argv[arg] + strlen("-Xbudget:"));
+        }
+        else if (strncmp(argv[arg], "-Xmaxheap:", strlen("-Xmaxheap:")) == 0) {
+            limits.max_heap_bytes =
+                parse_option_value(argv[arg], argv[arg] + strlen("-Xmaxheap:"));
+        }
+        else if (strncmp(argv[arg], "-Xmaxdepth:", strlen("-Xmaxdepth:")) == 0) {
+            limits.max_depth = parse_option_value(argv[arg], argv[arg] + strlen("-Xmaxdepth:"));
+        }
+        else if (strncmp(argv[arg], "-Xtimeout:", strlen("-Xtimeout:")) == 0) {
+            limits.timeout_ms = parse_option_value(argv[arg], argv[arg] + strlen("-Xtimeout:"));
+        }
+        else if (strcmp(argv[arg], "-Xasyncoutput") == 0) {
+            output_start_writer();
+        }
+        else if (strncmp(argv[arg], "-Xmmap:", strlen("-Xmmap:")) == 0) {
+            mapped_file_add(argv[arg] + strlen("-Xmmap:"));
+        }
+        else if (strncmp(argv[arg], "-Xnativelib:", strlen("-Xnativelib:")) == 0) {
+            load_native_library(argv[arg] + strlen("-Xnativelib:"));
+        }
+        else if (strcmp(argv[arg], "-Xnoprefetch") == 0) {
+            prefetch_enabled = false;
+        }
+        else if (strcmp(argv[arg], "-Xlogunroll") == 0) {
+            unroll_log_enabled = true;
+        }
+        else if (strcmp(argv[arg], "-Xeffects") == 0) {
+            print_method_effects = true;
+        }
+        else if (strncmp(argv[arg], "-Ximage:", strlen("-Ximage:")) == 0) {
+            image_path = argv[arg] + strlen("-Ximage:");
+        }
+        else if (strncmp(argv[arg], "-Xanalyze:", strlen("-Xanalyze:")) == 0) {
+            // Analyze a heap dump instead of running a class
+            heap_dump_analyze(argv[arg] + strlen("-Xanalyze:"), stdout);
+            return 0;
+        }
+        else {
+            fprintf(stderr, "Unknown option %s\n", argv[arg]);
+            return 1;
+        }
+    }
+    if (!embedded && arg >= argc) {
+        fprintf(stderr, "USAGE: %s [options] <class file> [args...]\n", argv[0]);
         return 1;
     }
+    int first_argument = embedded ? 1 : arg + 1;
 
-    // Open the class file for reading
-    FILE *class_file = fopen(argv[1], "r");
-    assert(class_file != NULL && "Failed to open file");
+    quota_enable(&limits);
+    metrics_attach_thread();
 
     // Parse the class file
-    class_file_t *class = get_class(class_file);
-    int error = fclose(class_file);
-    assert(error == 0 && "Failed to close file");
+    stats_phase_begin(PHASE_PARSE);
+    class_file_t *class =
+        embedded ? load_class(IMAGE_CLASSES[0].name) : load_main_class(argv[arg]);
+    stats_phase_end(PHASE_PARSE);
+
+    // Prepare the methods for execution, loading the classes they use
+    stats_phase_begin(PHASE_LINK);
+    link_classes();
+    stats_phase_end(PHASE_LINK);
 
     // The heap array is initially allocated to hold zero elements.
     heap_t *heap = heap_init();
+    metrics_watch_heap(heap);
+    if (heap_dump_path != NULL) {
+        heap_dump_enable(heap_dump_path, heap);
+    }
 
     // Execute the main method
+    stats_phase_begin(PHASE_METHOD_LOOKUP);
     method_t *main_method = find_method(MAIN_METHOD, MAIN_DESCRIPTOR, class);
     assert(main_method != NULL && "Missing main() method");
-    /* In a real JVM, locals[0] would contain a reference to String[] args.
-     * But since TeenyJVM doesn't support Objects, we leave it uninitialized. */
+    stats_phase_end(PHASE_METHOD_LOOKUP);
+
+    // Find the methods main() can call, freeing the code of the others
+    stats_phase_begin(PHASE_ANALYZE);
+    analyze_program(main_method);
+    stats_phase_end(PHASE_ANALYZE);
+    if (print_method_effects) {
+        print_effects(stderr);
+    }
+
+    // Linking loaded every class the program can use, so they make up its image
+    if (image_path != NULL) {
+        image_write(image_path);
+        free_classes();
+        metrics_watch_heap(NULL);
+        heap_free(heap);
+        return 0;
+    }
     int32_t locals[main_method->code.max_locals];
     // Initialize all local variables to 0
     memset(locals, 0, sizeof(locals));
+    // locals[0] is String[] args, the arguments after the class file (or all of an image's).
+    // They are allocated at the start of main(), before it runs.
+    frame_t arguments_frame = {.method = main_method, .locals = locals, .depth = 1};
+    current_frame = &arguments_frame;
+    locals[0] = create_arguments(heap, argc - first_argument, &argv[first_argument]);
+    current_frame = NULL;
+    stats_phase_begin(PHASE_EXECUTE);
     optional_value_t result = execute(main_method, locals, class, heap);
+    stats_phase_end(PHASE_EXECUTE);
+    if (result.threw) {
+        exception_uncaught(heap, (int32_t) result.value);
+    }
     assert(!result.has_value && "main() should return void");
 
+    if (heap_dump_path != NULL) {
+        heap_dump_write(heap_dump_path, heap, NULL);
+    }
+
+    stats_phase_begin(PHASE_OUTPUT_FLUSH);
+    output_flush();
+    stats_phase_end(PHASE_OUTPUT_FLUSH);
+
+    stats_phase_begin(PHASE_FREE);
     // Free the internal data structures
-    free_class(class);
+    string_intern_free();
+    free_classes();
 
-    // Free the heap
+    // Stop the metrics server reading the heap before freeing it
+    metrics_watch_heap(NULL);
     heap_free(heap);
+    stats_phase_end(PHASE_FREE);
+
+    metrics_stop();
+
+    if (stats_enabled) {
+        stats_print(stderr);
+    }
 }
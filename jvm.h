@@ -2,12 +2,13 @@
 #define JVM_H
 
 /**
- * JVM integer instruction mnemonics and opcodes. If you're interested,
+ * JVM instruction mnemonics and opcodes. If you're interested,
  * https://docs.oracle.com/javase/specs/jvms/se12/html/jvms-6.html
  * has the full list of JVM instructions and their specifications.
  */
 typedef enum {
     i_nop = 0x0,
+    i_aconst_null = 0x1,
     i_iconst_m1 = 0x2,
     i_iconst_0 = 0x3,
     i_iconst_1 = 0x4,
@@ -15,38 +16,86 @@ typedef enum {
     i_iconst_3 = 0x6,
     i_iconst_4 = 0x7,
     i_iconst_5 = 0x8,
+    i_fconst_0 = 0xb,
+    i_fconst_1 = 0xc,
+    i_fconst_2 = 0xd,
+    i_dconst_0 = 0xe,
+    i_dconst_1 = 0xf,
     i_bipush = 0x10,
     i_sipush = 0x11,
     i_ldc = 0x12,
+    i_ldc_w = 0x13,
+    i_ldc2_w = 0x14,
     i_iload = 0x15,
+    i_fload = 0x17,
+    i_dload = 0x18,
     i_aload = 0x19,
     i_iload_0 = 0x1a,
     i_iload_1 = 0x1b,
     i_iload_2 = 0x1c,
     i_iload_3 = 0x1d,
+    i_fload_0 = 0x22,
+    i_fload_1 = 0x23,
+    i_fload_2 = 0x24,
+    i_fload_3 = 0x25,
+    i_dload_0 = 0x26,
+    i_dload_1 = 0x27,
+    i_dload_2 = 0x28,
+    i_dload_3 = 0x29,
     i_aload_0 = 0x2a,
     i_aload_1 = 0x2b,
     i_aload_2 = 0x2c,
     i_aload_3 = 0x2d,
     i_iaload = 0x2e,
+    i_faload = 0x30,
+    i_daload = 0x31,
+    i_aaload = 0x32,
     i_istore = 0x36,
+    i_fstore = 0x38,
+    i_dstore = 0x39,
     i_astore = 0x3a,
     i_istore_0 = 0x3b,
     i_istore_1 = 0x3c,
     i_istore_2 = 0x3d,
     i_istore_3 = 0x3e,
+    i_fstore_0 = 0x43,
+    i_fstore_1 = 0x44,
+    i_fstore_2 = 0x45,
+    i_fstore_3 = 0x46,
+    i_dstore_0 = 0x47,
+    i_dstore_1 = 0x48,
+    i_dstore_2 = 0x49,
+    i_dstore_3 = 0x4a,
     i_astore_0 = 0x4b,
     i_astore_1 = 0x4c,
     i_astore_2 = 0x4d,
     i_astore_3 = 0x4e,
     i_iastore = 0x4f,
+    i_fastore = 0x51,
+    i_dastore = 0x52,
+    i_aastore = 0x53,
+    i_pop = 0x57,
+    i_pop2 = 0x58,
     i_dup = 0x59,
+    i_dup2 = 0x5c,
     i_iadd = 0x60,
+    i_fadd = 0x62,
+    i_dadd = 0x63,
     i_isub = 0x64,
+    i_fsub = 0x66,
+    i_dsub = 0x67,
     i_imul = 0x68,
+    i_fmul = 0x6a,
+    i_dmul = 0x6b,
     i_idiv = 0x6c,
+    i_fdiv = 0x6e,
+    i_ddiv = 0x6f,
     i_irem = 0x70,
+    i_frem = 0x72,
+    i_drem = 0x73,
     i_ineg = 0x74,
+    i_fneg = 0x76,
+    i_dneg = 0x77,
     i_ishl = 0x78,
     i_ishr = 0x7a,
     i_iushr = 0x7c,
@@ -54,6 +103,16 @@ typedef enum {
     i_ior = 0x80,
     i_ixor = 0x82,
     i_iinc = 0x84,
+    i_i2f = 0x86,
+    i_i2d = 0x87,
+    i_f2i = 0x8b,
+    i_f2d = 0x8d,
+    i_d2i = 0x8e,
+    i_d2f = 0x90,
+    i_fcmpl = 0x95,
+    i_fcmpg = 0x96,
+    i_dcmpl = 0x97,
+    i_dcmpg = 0x98,
     i_ifeq = 0x99,
     i_ifne = 0x9a,
     i_iflt = 0x9b,
@@ -66,15 +125,117 @@ typedef enum {
     i_if_icmpge = 0xa2,
     i_if_icmpgt = 0xa3,
     i_if_icmple = 0xa4,
+    i_if_acmpeq = 0xa5,
+    i_if_acmpne = 0xa6,
     i_goto = 0xa7,
     i_ireturn = 0xac,
+    i_freturn = 0xae,
+    i_dreturn = 0xaf,
     i_areturn = 0xb0,
     i_return = 0xb1,
     i_getstatic = 0xb2,
+    i_getfield = 0xb4,
+    i_putfield = 0xb5,
     i_invokevirtual = 0xb6,
+    i_invokespecial = 0xb7,
     i_invokestatic = 0xb8,
+    i_invokeinterface = 0xb9,
+    i_invokedynamic = 0xba,
+    i_new = 0xbb,
     i_newarray = 0xbc,
-    i_arraylength = 0xbe
+    i_anewarray = 0xbd,
+    i_arraylength = 0xbe,
+    i_athrow = 0xbf,
+    i_multianewarray = 0xc5,
+    i_ifnull = 0xc6,
+    i_ifnonnull = 0xc7,
+
+    /*
+     * TeenyJVM-internal instructions. link_class() rewrites ("quickens")
+     * standard instructions into these once their operands are resolved.
+     */
+
+    /** invokestatic/invokevirtual of a native method; same operand */
+    i_invokenative = 0xcb,
+    /** invokestatic of a native method from a shared library; same operand */
+    i_invokelibrary = 0xcc,
+    /** ldc of a String constant; same operand */
+    i_ldc_string = 0xcd,
+    /** invokedynamic that concatenates strings; same operands */
+    i_concat = 0xce,
+    /**
+     * concat followed by print/println(String) of the result, without creating
+     * the string. Operand byte 3 is 1 for println; the print's operands follow.
+     */
+    i_print_concat = 0xcf,
+    /** new java/lang/StringBuilder; same operand */
+    i_new_builder = 0xd0,
+    /**
+     * StringBuilder.toString() followed by print/println(String) of the result,
+     * without creating the string. Operand byte 3 is 1 for println.
+     */
+    i_print_builder = 0xd1,
+    /** new of a loaded class; the operand is the class's id instead */
+    i_new_object = 0xd2,
+    /**
+     * getfield of an int or float field, a short field,
+     * a char field and a byte or boolean field.
+     * The operand is the field's byte offset in the object instead.
+     */
+    i_getfield_int = 0xd3,
+    i_getfield_short = 0xd4,
+    i_getfield_char = 0xd5,
+    i_getfield_byte = 0xd6,
+    /**
+     * putfield of an int, float or reference field, a short or char field
+     * and a byte or boolean field. The operand is the field's byte offset instead.
+     */
+    i_putfield_int = 0xd7,
+    i_putfield_short = 0xd8,
+    i_putfield_byte = 0xd9,
+    /**
+     * invokevirtual of a method of a loaded class, dispatched through an
+     * inline cache. The operand is the index of the call site's inline cache instead.
+     */
+    i_invokevirtual_cached = 0xda,
+    /**
+     * invokeinterface of a method of a loaded interface, dispatched through an
+     * inline cache. The operand is the index of the call site's inline cache
+     * instead; the last two operand bytes are kept.
+     */
+    i_invokeinterface_cached = 0xdb,
+    /**
+     * getfield and putfield of a double field.
+     * The operand is the field's byte offset in the object instead.
+     */
+    i_getfield_double = 0xdc,
+    i_putfield_double = 0xdd,
+    /**
+     * The dup, index, value, store sequences of a constant array initializer,
+     * which copy the elements into the array on top of the stack.
+     * The operand is the index of the initializer's array literal; the rest of
+     * the sequence is replaced by nops, which are skipped.
+     */
+    i_array_literal = 0xde,
+    /**
+     * getfield of a reference field, which runs like getfield_int but tells
+     * stack maps that it pushes a reference. The operand is the field's byte offset instead.
+     */
+    i_getfield_reference = 0xdf,
+    /**
+     * A hint that the array in the first operand's local will soon be accessed at
+     * the index in the second operand's local plus a few times the stride in the
+     * third's, inserted at the head of loops that stride through an array.
+     * It fetches that element into the cache if it is in bounds and does nothing else.
+     */
+    i_prefetch = 0xe0,
+    /** ldc_w of a String constant; same operand */
+    i_ldc_w_string = 0xe1,
+    /**
+     * invokevirtual of a native method that loaded classes may override,
+     * e.g. Throwable.getMessage(); same operand
+     */
+    i_invokenative_virtual = 0xe2
 } jvm_instruction_t;
 
 #endif /* JVM_H */
@@ -0,0 +1,584 @@
+#include "link.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bytecode.h"
+#include "class_loader.h"
+#include "dispatch.h"
+#include "frame.h"
+#include "heap.h"
+#include "java_string.h"
+#include "jvm.h"
+#include "native.h"
+#include "output.h"
+#include "prefetch.h"
+#include "read_class.h"
+#include "stack_map.h"
+#include "stats.h"
+#include "unroll.h"
+
+/**
+ * Finds a method declared by a loaded class, one of its superclasses
+ * or one of their interfaces.
+ *
+ * @return the method, or NULL if there is no such method
+ */
+static method_t *find_inherited_method(const class_file_t *class, const char *name,
+                                       const char *descriptor) {
+    for (const class_file_t *super = class; super != NULL; super = super->super_class) {
+        method_t *method = find_method(name, descriptor, super);
+        if (method != NULL) {
+            return method;
+        }
+    }
+    // Then the methods of interfaces, including default methods
+    for (const class_file_t *super = class; super != NULL; super = super->super_class) {
+        for (u2 i = 0; i < super->interface_count; i++) {
+            method_t *method = find_inherited_method(super->interfaces[i], name, descriptor);
+            if (method != NULL) {
+                return method;
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Resolves every Methodref and InterfaceMethodref to a method of a loaded class or a native method.
+ * Classes other than this one are loaded when first referred to.
+ */
+static void resolve_methods(class_file_t *class) {
+    size_t constant_count = 0;
+    while (class->constant_pool[constant_count].info != NULL) {
+        constant_count++;
+    }
+    class->resolved_methods = calloc(constant_count + 1, sizeof(method_t *));
+    class->resolved_natives = calloc(constant_count + 1, sizeof(native_method_t *));
+    class->resolved_strings = calloc(constant_count + 1, sizeof(int32_t));
+    assert(class->resolved_methods != NULL && class->resolved_natives != NULL &&
+           class->resolved_strings != NULL && "Failed to allocate resolved methods");
+    stats_add_bytes(MEM_CODE_CACHE,
+                    (constant_count + 1) *
+                        (sizeof(method_t *) + sizeof(native_method_t *) + sizeof(int32_t)));
+
+    for (u2 index = 1; index <= constant_count; index++) {
+        if (class->constant_pool[index - 1].tag != CONSTANT_Methodref &&
+            class->constant_pool[index - 1].tag != CONSTANT_InterfaceMethodref) {
+            continue;
+        }
+        const char *class_name, *name, *descriptor;
+        get_member_ref(class, index, &class_name, &name, &descriptor);
+        const class_file_t *owner = load_class(class_name);
+        method_t *method = find_inherited_method(owner, name, descriptor);
+        if (method == NULL) {
+            const native_method_t *native = find_native_method(class_name, name, descriptor);
+            // Built-in classes inherit the natives of their superclasses,
+            // e.g. ArithmeticException.<init>(String) is Throwable's
+            for (const class_file_t *super = owner;
+                 native == NULL && super != NULL && super->super_name != NULL;
+                 super = super->super_class) {
+                native = find_native_method(super->super_name, name, descriptor);
+            }
+            class->resolved_natives[index] = native;
+        }
+        else if (method->native != NULL) {
+            class->resolved_natives[index] = method->native;
+        }
+        else {
+            class->resolved_methods[index] = method;
+        }
+    }
+}
+
+/** Skips past a type in a method descriptor, e.g. "[I" or "Ljava/lang/String;" */
+static const char *next_type(const char *type) {
+    while (*type == '[') {
+        type++;
+    }
+    return *type == 'L' ? strchr(type, ';') + 1 : type + 1;
+}
+
+/** Gets the kind of string part for a field descriptor, e.g. "I" */
+static string_part_kind_t concat_part_kind(const char *type) {
+    switch (type[0]) {
+        case 'I':
+        case 'S':
+        case 'B':
+            return PART_INT;
+        case 'C':
+            return PART_CHAR;
+        case 'Z':
+            return PART_BOOLEAN;
+        default:
+            if (strncmp(type, "Ljava/lang/String;", strlen("Ljava/lang/String;")) != 0) {
+                fprintf(stderr, "Unsupported string concatenation of %s\n", type);
+                assert(false);
+            }
+            return PART_STRING;
+    }
+}
+
+/**
+ * Builds the recipe of an invokedynamic call site that concatenates strings
+ * with StringConcatFactory, or returns NULL for any other call site.
+ */
+static concat_recipe_t *resolve_concat(class_file_t *class, u2 index) {
+    const CONSTANT_InvokeDynamic_info *call_site = class->constant_pool[index - 1].info;
+    assert(call_site->bootstrap_method_attr_index < class->bootstrap_method_count &&
+           "Missing bootstrap method");
+    const bootstrap_method_t *bootstrap =
+        &class->bootstrap_methods[call_site->bootstrap_method_attr_index];
+    const CONSTANT_MethodHandle_info *handle =
+        class->constant_pool[bootstrap->bootstrap_method_ref - 1].info;
+    const char *class_name, *name, *descriptor;
+    get_member_ref(class, handle->reference_index, &class_name, &name, &descriptor);
+    if (strcmp(class_name, "java/lang/invoke/StringConcatFactory") != 0) {
+        return NULL;
+    }
+    const CONSTANT_NameAndType_info *name_and_type =
+        class->constant_pool[call_site->name_and_type_index - 1].info;
+    const char *arguments = class->constant_pool[name_and_type->descriptor_index - 1].info;
+
+    // makeConcat just concatenates the arguments; makeConcatWithConstants has
+    // a recipe of constant text, \1 for each argument and \2 for each constant
+    const char *recipe = NULL;
+    if (strcmp(name, "makeConcatWithConstants") == 0) {
+        const CONSTANT_String_info *recipe_constant =
+            class->constant_pool[bootstrap->bootstrap_arguments[0] - 1].info;
+        recipe = class->constant_pool[recipe_constant->string_index - 1].info;
+    }
+    u2 argument_count = get_descriptor_parameters(arguments);
+    size_t max_parts = recipe != NULL ? 2 * strlen(recipe) + 1 : argument_count;
+    concat_recipe_t *concat =
+        malloc(sizeof(concat_recipe_t) + sizeof(concat_part_t[max_parts]));
+    assert(concat != NULL && "Failed to allocate concatenation recipe");
+    stats_add_bytes(MEM_CODE_CACHE, sizeof(concat_recipe_t) + sizeof(concat_part_t[max_parts]));
+    concat->argument_count = argument_count;
+    concat->part_count = 0;
+
+    const char *argument = arguments + 1;
+    u2 constant = 1;
+    const char *c = recipe;
+    while (recipe == NULL ? concat->part_count < argument_count : *c != '\0') {
+        concat_part_t *part = &concat->parts[concat->part_count++];
+        if (recipe == NULL || *c == '\1') {
+            *part = (concat_part_t){.is_argument = true, .kind = concat_part_kind(argument)};
+            argument = next_type(argument);
+            c += recipe != NULL;
+        }
+        else if (*c == '\2') {
+            const cp_info *value =
+                &class->constant_pool[bootstrap->bootstrap_arguments[constant++] - 1];
+            if (value->tag == CONSTANT_Integer) {
+                *part = (concat_part_t){
+                    .kind = PART_INT, .value = ((CONSTANT_Integer_info *) value->info)->bytes};
+            }
+            else {
+                assert(value->tag == CONSTANT_String && "Unsupported concatenation constant");
+                u2 chars_index = ((CONSTANT_String_info *) value->info)->string_index;
+                const char *chars = class->constant_pool[chars_index - 1].info;
+                *part = (concat_part_t){
+                    .kind = PART_STRING, .chars = chars, .length = strlen(chars)};
+            }
+            c++;
+        }
+        else {
+            // Constant text runs until the next argument or constant
+            size_t length = strcspn(c, "\1\2");
+            *part = (concat_part_t){.kind = PART_STRING, .chars = c, .length = length};
+            c += length;
+        }
+    }
+    return concat;
+}
+
+/** Resolves every InvokeDynamic constant that concatenates strings */
+static void resolve_call_sites(class_file_t *class) {
+    size_t constant_count = 0;
+    while (class->constant_pool[constant_count].info != NULL) {
+        constant_count++;
+    }
+    class->resolved_concats = calloc(constant_count + 1, sizeof(concat_recipe_t *));
+    assert(class->resolved_concats != NULL && "Failed to allocate resolved call sites");
+    stats_add_bytes(MEM_CODE_CACHE, (constant_count + 1) * sizeof(concat_recipe_t *));
+    for (u2 index = 1; index <= constant_count; index++) {
+        if (class->constant_pool[index - 1].tag == CONSTANT_InvokeDynamic) {
+            class->resolved_concats[index] = resolve_concat(class, index);
+        }
+    }
+}
+
+/**
+ * Checks whether an instruction prints a String and can be fused with the
+ * instruction before it, which creates the String.
+ *
+ * @param newline set to whether the instruction is println rather than print
+ */
+static bool is_fusable_print(const class_file_t *class, const method_t *method, u4 pc,
+                             bool *newline) {
+    const u1 *code = method->code.code;
+    if (pc >= method->code.code_length || code[pc] != i_invokevirtual ||
+        is_branch_target(code, method->code.code_length, pc)) {
+        return false;
+    }
+    const native_method_t *native = class->resolved_natives[operand_index(code, pc)];
+    if (native == NULL || strcmp(native->class_name, "java/io/PrintStream") != 0 ||
+        strcmp(native->descriptor, "(Ljava/lang/String;)V") != 0) {
+        return false;
+    }
+    *newline = strcmp(native->name, "println") == 0;
+    return true;
+}
+
+/**
+ * Rewrites invokevirtual or invokeinterface of a method of a loaded class.
+ * Private methods of classes cannot be overridden, so they are called
+ * directly like with invokespecial; other calls go through a new inline cache.
+ * invokeinterface keeps its last two operand bytes.
+ */
+static void quicken_virtual_call(class_file_t *class, u1 *code, u4 pc, method_t *callee) {
+    if (!is_virtual(callee) && callee->selector == 0) {
+        assert(code[pc] == i_invokevirtual && "Private method called through an interface");
+        code[pc] = i_invokespecial;
+        return;
+    }
+    class->inline_caches = realloc(class->inline_caches,
+                                   sizeof(inline_cache_t[class->inline_cache_count + 1]));
+    assert(class->inline_caches != NULL && "Failed to allocate inline caches");
+    stats_add_bytes(MEM_CODE_CACHE, sizeof(inline_cache_t));
+    u2 index = class->inline_cache_count++;
+    class->inline_caches[index] = (inline_cache_t){.method = callee, .entry_count = 0};
+    code[pc] = code[pc] == i_invokeinterface ? i_invokeinterface_cached : i_invokevirtual_cached;
+    code[pc + 1] = index >> 8;
+    code[pc + 2] = index;
+}
+
+/**
+ * Finds the instance field a Fieldref refers to.
+ *
+ * @param offset set to the field's offset in an object
+ * @return the first character of the field's descriptor, e.g. 'I'
+ */
+static char resolve_field(const class_file_t *class, u2 index, u2 *offset) {
+    const char *class_name, *name, *descriptor;
+    get_member_ref(class, index, &class_name, &name, &descriptor);
+    const field_t *field = find_field(load_class(class_name), name, descriptor);
+    if (field == NULL || (field->access_flags & IS_STATIC) != 0) {
+        fprintf(stderr, "Unsupported field %s.%s\n", class_name, name);
+        assert(false);
+    }
+    *offset = field->offset;
+    return field->descriptor[0];
+}
+
+/**
+ * Reads the constant an instruction pushes, if it pushes an int, float or double constant.
+ *
+ * @param value set to the constant's slots
+ * @return the number of slots pushed: 1 for an int or float, 2 for a double,
+ *         or 0 if the instruction does not push such a constant
+ */
+static u1 pushed_constant(const class_file_t *class, const u1 *code, u4 pc, int32_t value[2]) {
+    u1 instruction = code[pc];
+    if (i_iconst_m1 <= instruction && instruction <= i_iconst_5) {
+        value[0] = instruction - i_iconst_0;
+        return 1;
+    }
+    if (i_fconst_0 <= instruction && instruction <= i_fconst_2) {
+        value[0] = float_slot(instruction - i_fconst_0);
+        return 1;
+    }
+    if (i_dconst_0 <= instruction && instruction <= i_dconst_1) {
+        put_double(value, instruction - i_dconst_0);
+        return 2;
+    }
+    switch (instruction) {
+        case i_bipush:
+            value[0] = (int8_t) code[pc + 1];
+            return 1;
+        case i_sipush:
+            value[0] = (int16_t) operand_index(code, pc);
+            return 1;
+        case i_ldc:
+        case i_ldc_w: {
+            u2 index = instruction == i_ldc ? code[pc + 1] : operand_index(code, pc);
+            const cp_info *constant = &class->constant_pool[index - 1];
+            if (constant->tag != CONSTANT_Integer && constant->tag != CONSTANT_Float) {
+                return 0;
+            }
+            value[0] = ((const CONSTANT_Integer_info *) constant->info)->bytes;
+            return 1;
+        }
+        case i_ldc2_w: {
+            const cp_info *constant = &class->constant_pool[operand_index(code, pc) - 1];
+            if (constant->tag != CONSTANT_Double) {
+                return 0;
+            }
+            memcpy(value, &((const CONSTANT_Long_info *) constant->info)->bytes, sizeof(double));
+            return 2;
+        }
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Rewrites the constant initializer of a new int, float or double array,
+ * e.g. `int[] x = {5, 1, 6}`, into array_literal. javac stores each element with
+ * a dup, index, value, store sequence, with the indices counting up from 0.
+ * The sequences are only replaced if nothing jumps into them.
+ *
+ * @param pc the offset of the instruction after the newarray
+ * @param type the newarray's `atype`
+ */
+static void quicken_array_literal(class_file_t *class, const method_t *method, u4 pc,
+                                  u1 type) {
+    u1 store;
+    switch (type) {
+        case 6:
+            store = i_fastore;
+            break;
+        case 7:
+            store = i_dastore;
+            break;
+        case 10:
+            store = i_iastore;
+            break;
+        default:
+            return;
+    }
+    u1 *code = method->code.code;
+    u4 code_length = method->code.code_length;
+    size_t element_ints = array_element_ints(type);
+    int32_t *values = NULL;
+    u4 count = 0;
+    u4 end = pc;
+    while (end < code_length && code[end] == i_dup) {
+        int32_t index[2], value[2];
+        u4 index_pc = end + 1;
+        if (pushed_constant(class, code, index_pc, index) != 1 || index[0] != (int32_t) count) {
+            break;
+        }
+        u4 value_pc = index_pc + instruction_length(code, index_pc);
+        if (pushed_constant(class, code, value_pc, value) != element_ints) {
+            break;
+        }
+        u4 store_pc = value_pc + instruction_length(code, value_pc);
+        if (code[store_pc] != store) {
+            break;
+        }
+        values = realloc(values, sizeof(int32_t[(count + 1) * element_ints]));
+        assert(values != NULL && "Failed to allocate array literal");
+        memcpy(&values[count * element_ints], value, sizeof(int32_t[element_ints]));
+        count++;
+        end = store_pc + 1;
+    }
+
+    bool jumped_into = count > 0 && has_branch_target(code, code_length, pc + 1, end);
+    for (u2 i = 0; i < method->code.handler_count && !jumped_into; i++) {
+        const exception_handler_t *handler = &method->code.handlers[i];
+        jumped_into = (pc < handler->start_pc && handler->start_pc < end) ||
+                      (pc < handler->end_pc && handler->end_pc < end) ||
+                      (pc < handler->handler_pc && handler->handler_pc < end);
+    }
+    if (count == 0 || jumped_into) {
+        free(values);
+        return;
+    }
+
+    class->array_literals = realloc(class->array_literals,
+                                    sizeof(array_literal_t[class->array_literal_count + 1]));
+    assert(class->array_literals != NULL && "Failed to allocate array literals");
+    stats_add_bytes(MEM_CODE_CACHE,
+                    sizeof(array_literal_t) + sizeof(int32_t[count * element_ints]));
+    u2 literal = class->array_literal_count++;
+    class->array_literals[literal] = (array_literal_t){
+        .code_length = end - pc, .element_count = count, .values = values, .type = type};
+    code[pc] = i_array_literal;
+    code[pc + 1] = literal >> 8;
+    code[pc + 2] = literal;
+    // Keeps the rest of the sequence walkable for other passes over the bytecode
+    memset(&code[pc + 3], i_nop, end - pc - 3);
+}
+
+/**
+ * Rewrites getstatic of System.out/System.err into pushing its reference,
+ * ldc of String constants into ldc_string,
+ * calls of native methods into invokenative or invokelibrary,
+ * string concatenation into concat or new_builder, new of loaded classes into
+ * new_object, field accesses into getfield_* or putfield_* with the
+ * field's offset, virtual and interface calls into invokevirtual_cached
+ * and invokeinterface_cached and constant array initializers into array_literal.
+ * A concatenation that is only printed is fused with the
+ * print into print_concat or print_builder.
+ */
+static void quicken(method_t *method, class_file_t *class) {
+    u1 *code = method->code.code;
+    for (u4 pc = 0; pc < method->code.code_length; pc += instruction_length(code, pc)) {
+        switch (code[pc]) {
+            case i_getstatic: {
+                const char *class_name, *name, *descriptor;
+                get_member_ref(class, operand_index(code, pc), &class_name, &name, &descriptor);
+                int16_t stream;
+                if (strcmp(class_name, "java/lang/System") == 0 &&
+                    strcmp(name, "out") == 0) {
+                    stream = STDOUT_REFERENCE;
+                }
+                else if (strcmp(class_name, "java/lang/System") == 0 &&
+                         strcmp(name, "err") == 0) {
+                    stream = STDERR_REFERENCE;
+                }
+                else {
+                    fprintf(stderr, "Unsupported static field %s.%s\n", class_name, name);
+                    assert(false);
+                }
+                // sipush has the same length as getstatic
+                code[pc] = i_sipush;
+                code[pc + 1] = (u2) stream >> 8;
+                code[pc + 2] = (u2) stream;
+                break;
+            }
+            case i_newarray:
+                quicken_array_literal(class, method, pc + 2, code[pc + 1]);
+                break;
+            case i_ldc:
+                if (class->constant_pool[code[pc + 1] - 1].tag == CONSTANT_String) {
+                    code[pc] = i_ldc_string;
+                }
+                break;
+            case i_ldc_w:
+                if (class->constant_pool[operand_index(code, pc) - 1].tag == CONSTANT_String) {
+                    code[pc] = i_ldc_w_string;
+                }
+                break;
+            case i_new: {
+                const char *class_name = get_class_name(class, operand_index(code, pc));
+                if (strcmp(class_name, "java/lang/StringBuilder") == 0) {
+                    code[pc] = i_new_builder;
+                    break;
+                }
+                const class_file_t *object_class = load_class(class_name);
+                if (object_class == NULL) {
+                    fprintf(stderr, "Unsupported class %s\n", class_name);
+                    assert(false);
+                }
+                code[pc] = i_new_object;
+                code[pc + 1] = object_class->id >> 8;
+                code[pc + 2] = object_class->id;
+                break;
+            }
+            case i_getfield:
+            case i_putfield: {
+                u2 offset;
+                char type = resolve_field(class, operand_index(code, pc), &offset);
+                bool get = code[pc] == i_getfield;
+                switch (type) {
+                    case 'S':
+                        code[pc] = get ? i_getfield_short : i_putfield_short;
+                        break;
+                    case 'C':
+                        code[pc] = get ? i_getfield_char : i_putfield_short;
+                        break;
+                    case 'B':
+                    case 'Z':
+                        code[pc] = get ? i_getfield_byte : i_putfield_byte;
+                        break;
+                    case 'D':
+                        code[pc] = get ? i_getfield_double : i_putfield_double;
+                        break;
+                    case 'L':
+                    case '[':
+                        code[pc] = get ? i_getfield_reference : i_putfield_int;
+                        break;
+                    case 'J':
+                        fprintf(stderr, "Unsupported field type %c\n", type);
+                        assert(false);
+                        break;
+                    default:
+                        code[pc] = get ? i_getfield_int : i_putfield_int;
+                }
+                code[pc + 1] = offset >> 8;
+                code[pc + 2] = offset;
+                break;
+            }
+            case i_invokedynamic: {
+                if (class->resolved_concats[operand_index(code, pc)] == NULL) {
+                    fprintf(stderr, "Unsupported invokedynamic\n");
+                    assert(false);
+                }
+                bool newline;
+                if (is_fusable_print(class, method, pc + 5, &newline)) {
+                    // invokedynamic's last two operand bytes are always 0
+                    code[pc] = i_print_concat;
+                    code[pc + 3] = newline;
+                }
+                else {
+                    code[pc] = i_concat;
+                }
+                break;
+            }
+            case i_invokestatic:
+            case i_invokevirtual:
+            case i_invokespecial:
+            case i_invokeinterface: {
+                const native_method_t *native = class->resolved_natives[operand_index(code, pc)];
+                bool newline;
+                if (native == NULL) {
+                    method_t *callee = class->resolved_methods[operand_index(code, pc)];
+                    if ((code[pc] == i_invokevirtual || code[pc] == i_invokeinterface) &&
+                        callee != NULL) {
+                        quicken_virtual_call(class, code, pc, callee);
+                    }
+                    break;
+                }
+                if (strcmp(native->class_name, "java/lang/StringBuilder") == 0 &&
+                    strcmp(native->name, "toString") == 0 &&
+                    is_fusable_print(class, method, pc + 3, &newline)) {
+                    // The print's opcode is replaced by the newline flag
+                    code[pc] = i_print_builder;
+                    code[pc + 3] = newline;
+                }
+                else if (code[pc] == i_invokevirtual &&
+                         native->receiver == NATIVE_OVERRIDABLE) {
+                    code[pc] = i_invokenative_virtual;
+                }
+                else {
+                    code[pc] = native->library_function != NULL ? i_invokelibrary
+                                                                : i_invokenative;
+                }
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * Resolves the classes caught by exception handlers. A handler for a class
+ * that does not exist keeps a NULL catch_class, so it catches nothing.
+ */
+static void resolve_handlers(class_file_t *class) {
+    for (method_t *method = class->methods; method->name != NULL; method++) {
+        for (u2 i = 0; i < method->code.handler_count; i++) {
+            exception_handler_t *handler = &method->code.handlers[i];
+            if (handler->catch_type != 0) {
+                handler->catch_class = load_class(get_class_name(class, handler->catch_type));
+            }
+        }
+    }
+}
+
+void link_class(class_file_t *class) {
+    resolve_methods(class);
+    resolve_handlers(class);
+    resolve_call_sites(class);
+    for (method_t *method = class->methods; method->name != NULL; method++) {
+        quicken(method, class);
+        unroll_loops(class, method);
+        insert_prefetches(method);
+    }
+    compute_stack_maps(class);
+}
@@ -0,0 +1,16 @@
+#ifndef LINK_H
+#define LINK_H
+
+#include "class_file.h"
+
+/**
+ * Prepares a parsed class for execution: resolves each Methodref once,
+ * rewrites instructions whose operands resolve to something cheaper to run
+ * (see the internal instructions in jvm.h), unrolls small counted loops,
+ * prefetches strided array accesses and computes stack maps.
+ *
+ * @param class the parsed class file
+ */
+void link_class(class_file_t *class);
+
+#endif /* LINK_H */
@@ -0,0 +1,74 @@
+#include "mapped_file.h"
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** The files added with mapped_file_add() */
+static const char **files = NULL;
+static int32_t file_count = 0;
+
+void mapped_file_add(const char *path) {
+    files = realloc(files, (file_count + 1) * sizeof(char *));
+    assert(files != NULL && "Failed to allocate mapped files");
+    files[file_count++] = path;
+}
+
+int32_t *mapped_file_map(int32_t file, int32_t flags) {
+    if (file < 0 || file >= file_count) {
+        fprintf(stderr, "No mapped file %" PRId32 "\n", file);
+        exit(1);
+    }
+    if ((flags & MAPPED_READ_ONLY) != 0 && (flags & MAPPED_NATIVE_ORDER) == 0) {
+        fprintf(stderr, "Read-only mapped files must be in native byte order\n");
+        exit(1);
+    }
+    int fd = open(files[file], O_RDONLY);
+    struct stat status;
+    if (fd < 0 || fstat(fd, &status) < 0) {
+        fprintf(stderr, "Failed to open %s: %s\n", files[file], strerror(errno));
+        exit(1);
+    }
+    size_t length = status.st_size / sizeof(int32_t);
+    assert(length <= INT32_MAX && "Mapped file is too large for an array");
+
+    // The length goes at the end of an anonymous page, just before the
+    // file's contents, so the array has the same layout as a heap array.
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t bytes = length * sizeof(int32_t);
+    char *region = mmap(NULL, page + bytes, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert(region != MAP_FAILED && "Failed to reserve mapped file");
+    if (bytes > 0) {
+        int protection = (flags & MAPPED_READ_ONLY) != 0 ? PROT_READ : PROT_READ | PROT_WRITE;
+        void *contents = mmap(region + page, bytes, protection, MAP_PRIVATE | MAP_FIXED, fd, 0);
+        if (contents == MAP_FAILED) {
+            fprintf(stderr, "Failed to map %s: %s\n", files[file], strerror(errno));
+            exit(1);
+        }
+    }
+    close(fd);
+
+    int32_t *array = (int32_t *) (region + page) - 1;
+    array[0] = length;
+    if ((flags & MAPPED_NATIVE_ORDER) == 0) {
+        madvise(region + page, bytes, MADV_SEQUENTIAL);
+        uint32_t *elements = (uint32_t *) &array[1];
+        for (size_t i = 0; i < length; i++) {
+            elements[i] = ntohl(elements[i]);
+        }
+    }
+    return array;
+}
+
+void mapped_file_unmap(int32_t *array) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    munmap((char *) &array[1] - page, page + array[0] * sizeof(int32_t));
+}
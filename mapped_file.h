@@ -0,0 +1,44 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <inttypes.h>
+
+/**
+ * Flags for mapping a file as an int[]. By default the file holds big-endian
+ * ints (as written by DataOutputStream) and is mapped copy-on-write: the ints
+ * are converted when the file is mapped, and writes to the array are private.
+ */
+/** The file holds ints in the machine's byte order, so no conversion is done */
+#define MAPPED_NATIVE_ORDER 1
+/** The array is mapped read-only (requires MAPPED_NATIVE_ORDER) */
+#define MAPPED_READ_ONLY 2
+
+/**
+ * Adds a file that the program can map. Files are numbered from 0 in the
+ * order they are added.
+ *
+ * @param path the path of the file
+ */
+void mapped_file_add(const char *path);
+
+/**
+ * Maps a file as an int[]. The array's elements are the mapping itself, so
+ * pages are only read when the program touches them. A trailing partial int
+ * in the file is not part of the array. Exits with an error if the file
+ * cannot be mapped.
+ *
+ * @param file the number of the file
+ * @param flags MAPPED_* flags
+ * @return the array, laid out like any other heap array: element 0 holds the
+ *   length, followed by the elements
+ */
+int32_t *mapped_file_map(int32_t file, int32_t flags);
+
+/**
+ * Unmaps an array returned by mapped_file_map().
+ *
+ * @param array the array
+ */
+void mapped_file_unmap(int32_t *array);
+
+#endif /* MAPPED_FILE_H */
@@ -0,0 +1,163 @@
+#include "metrics.h"
+
+#include <assert.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "output.h"
+
+/** How long to wait for a client to send an HTTP request, in milliseconds */
+const int REQUEST_TIMEOUT_MS = 100;
+
+_Thread_local metrics_counters_t *thread_metrics = NULL;
+
+/** Every thread's counters. New threads are pushed onto the front. */
+static metrics_counters_t *all_metrics = NULL;
+static pthread_mutex_t all_metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** The heap whose handles are reported, set by metrics_watch_heap() */
+static const heap_t *watched_heap = NULL;
+/** Held while the heap is read, so it is not freed during a snapshot */
+static pthread_mutex_t watched_heap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *socket_path = NULL;
+static int listen_fd = -1;
+
+void metrics_attach_thread(void) {
+    metrics_counters_t *counters = calloc(1, sizeof(*counters));
+    assert(counters != NULL && "Failed to allocate metrics");
+    pthread_mutex_lock(&all_metrics_lock);
+    counters->next = all_metrics;
+    all_metrics = counters;
+    pthread_mutex_unlock(&all_metrics_lock);
+    thread_metrics = counters;
+}
+
+/** Sums every thread's counters into `total` */
+static void sum_metrics(metrics_counters_t *total) {
+    memset(total, 0, sizeof(*total));
+    pthread_mutex_lock(&all_metrics_lock);
+    for (metrics_counters_t *counters = all_metrics; counters != NULL;
+         counters = counters->next) {
+        total->instructions += __atomic_load_n(&counters->instructions, __ATOMIC_RELAXED);
+        total->calls += __atomic_load_n(&counters->calls, __ATOMIC_RELAXED);
+        total->allocations += __atomic_load_n(&counters->allocations, __ATOMIC_RELAXED);
+        total->allocated_bytes +=
+            __atomic_load_n(&counters->allocated_bytes, __ATOMIC_RELAXED);
+        total->output_bytes += __atomic_load_n(&counters->output_bytes, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&all_metrics_lock);
+}
+
+/** Formats one metric in the Prometheus text format */
+static int format_metric(char *buffer, size_t size, const char *name, const char *type,
+                         const char *help, uint64_t value) {
+    return snprintf(buffer, size, "# HELP %s %s\n# TYPE %s %s\n%s %" PRIu64 "\n", name,
+                    help, name, type, name, value);
+}
+
+static void serve_client(int client) {
+    // Only answer with HTTP if the client sent a request
+    char request[512];
+    bool http = false;
+    struct pollfd readable = {.fd = client, .events = POLLIN};
+    if (poll(&readable, 1, REQUEST_TIMEOUT_MS) > 0) {
+        ssize_t length = read(client, request, sizeof(request) - 1);
+        http = length >= 4 && strncmp(request, "GET ", 4) == 0;
+    }
+
+    metrics_counters_t total;
+    sum_metrics(&total);
+    // Handles, unlike allocations, include each row of a multi-dimensional array and
+    // each mapped file, and not the reserved null reference
+    pthread_mutex_lock(&watched_heap_lock);
+    uint64_t handles = watched_heap != NULL ? (uint64_t) heap_count(watched_heap) - 1 : 0;
+    pthread_mutex_unlock(&watched_heap_lock);
+    char body[2048];
+    int length = 0;
+    length += format_metric(body + length, sizeof(body) - length,
+                            "teenyjvm_instructions_total", "counter",
+                            "Bytecode instructions executed.", total.instructions);
+    length += format_metric(body + length, sizeof(body) - length, "teenyjvm_calls_total",
+                            "counter", "Methods invoked.", total.calls);
+    length += format_metric(body + length, sizeof(body) - length,
+                            "teenyjvm_allocations_total", "counter", "Arrays allocated.",
+                            total.allocations);
+    // Nothing is collected, so every allocated array is still live
+    length += format_metric(body + length, sizeof(body) - length,
+                            "teenyjvm_heap_live_bytes", "gauge",
+                            "Bytes of live heap arrays.", total.allocated_bytes);
+    length += format_metric(body + length, sizeof(body) - length, "teenyjvm_heap_handles",
+                            "gauge", "Arrays in the heap's handle table.", handles);
+    length += format_metric(body + length, sizeof(body) - length,
+                            "teenyjvm_output_bytes_total", "counter",
+                            "Bytes of program output.", total.output_bytes);
+
+    if (http) {
+        char header[128];
+        int header_length = snprintf(header, sizeof(header),
+                                     "HTTP/1.0 200 OK\r\n"
+                                     "Content-Type: text/plain; version=0.0.4\r\n"
+                                     "Content-Length: %d\r\n\r\n",
+                                     length);
+        if (write(client, header, header_length) != header_length) {
+            return;
+        }
+    }
+    if (write(client, body, length) != length) {
+        return;
+    }
+}
+
+static void *metrics_server(void *arg) {
+    (void) arg;
+    while (true) {
+        int client = accept(listen_fd, NULL, NULL);
+        if (client < 0) {
+            continue;
+        }
+        serve_client(client);
+        close(client);
+    }
+    return NULL;
+}
+
+void metrics_watch_heap(const heap_t *heap) {
+    pthread_mutex_lock(&watched_heap_lock);
+    watched_heap = heap;
+    pthread_mutex_unlock(&watched_heap_lock);
+}
+
+void metrics_serve(const char *path) {
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    assert(strlen(path) < sizeof(address.sun_path) && "Metrics socket path too long");
+    strcpy(address.sun_path, path);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    assert(listen_fd >= 0 && "Failed to create metrics socket");
+    unlink(path);
+    int error = bind(listen_fd, (struct sockaddr *) &address, sizeof(address));
+    assert(error == 0 && "Failed to bind metrics socket");
+    error = listen(listen_fd, 8);
+    assert(error == 0 && "Failed to listen on metrics socket");
+    socket_path = path;
+
+    pthread_t thread;
+    error = output_create_thread(&thread, metrics_server, NULL);
+    assert(error == 0 && "Failed to start metrics thread");
+    pthread_detach(thread);
+}
+
+void metrics_stop(void) {
+    if (socket_path != NULL) {
+        unlink(socket_path);
+        socket_path = NULL;
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <inttypes.h>
+
+#include "heap.h"
+
+/**
+ * Counters belonging to one thread that runs Java code.
+ * Only the owning thread writes them, so increments need no locking;
+ * the metrics server sums every thread's counters when it is scraped.
+ */
+typedef struct metrics_counters {
+    /** Bytecode instructions executed */
+    uint64_t instructions;
+    /** Methods invoked, including main() */
+    uint64_t calls;
+    /** Arrays allocated */
+    uint64_t allocations;
+    /** Bytes of arrays allocated */
+    uint64_t allocated_bytes;
+    /** Bytes of program output */
+    uint64_t output_bytes;
+    /** The next thread's counters */
+    struct metrics_counters *next;
+} metrics_counters_t;
+
+/** The calling thread's counters, set by metrics_attach_thread() */
+extern _Thread_local metrics_counters_t *thread_metrics;
+
+/**
+ * Adds to a counter of the calling thread.
+ * This is a plain load and store, which is safe because only one thread
+ * writes each counter; the atomics just keep concurrent reads well-defined.
+ */
+static inline void metrics_add(uint64_t *counter, uint64_t amount) {
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + amount,
+                     __ATOMIC_RELAXED);
+}
+
+/**
+ * Gives the calling thread its own counters and sets `thread_metrics`.
+ * Must be called by each thread before it runs Java code.
+ */
+void metrics_attach_thread(void);
+
+/**
+ * Starts a thread that serves the counters in the Prometheus text format
+ * on a Unix socket. Each connection receives one snapshot; connections that
+ * send an HTTP request get an HTTP response, so `curl --unix-socket` works.
+ *
+ * @param path the path of the socket to create (replacing any existing file)
+ */
+void metrics_serve(const char *path);
+
+/**
+ * Makes the metrics server report the number of handles in a heap.
+ * Until this is called, no handles are reported. Once this returns,
+ * the server no longer reads the previous heap, so it can be freed.
+ *
+ * @param heap the heap of the running program, or NULL to stop reporting
+ */
+void metrics_watch_heap(const heap_t *heap);
+
+/**
+ * Removes the socket created by metrics_serve(), if any.
+ */
+void metrics_stop(void);
+
+#endif /* METRICS_H */
@@ -0,0 +1,420 @@
+#include "native.h"
+
+#include <assert.h>
+#include <dlfcn.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bytecode.h"
+#include "exception.h"
+#include "frame.h"
+#include "input.h"
+#include "java_string.h"
+#include "mapped_file.h"
+#include "output.h"
+#include "read_class.h"
+
+int32_t native_exception = NULL_REFERENCE;
+
+static int64_t print_int(int32_t *args, heap_t *heap) {
+    (void) heap;
+    output_int(args[0], args[1]);
+    return 0;
+}
+
+static int64_t println_int(int32_t *args, heap_t *heap) {
+    (void) heap;
+    output_int(args[0], args[1]);
+    output_write(args[0], "\n", 1);
+    return 0;
+}
+
+static int64_t print_char(int32_t *args, heap_t *heap) {
+    (void) heap;
+    output_char(args[0], args[1]);
+    return 0;
+}
+
+static int64_t println_char(int32_t *args, heap_t *heap) {
+    (void) heap;
+    output_char(args[0], args[1]);
+    output_write(args[0], "\n", 1);
+    return 0;
+}
+
+static int64_t print_boolean(int32_t *args, heap_t *heap) {
+    (void) heap;
+    if (args[1]) {
+        output_write(args[0], "true", strlen("true"));
+    }
+    else {
+        output_write(args[0], "false", strlen("false"));
+    }
+    return 0;
+}
+
+static int64_t println_boolean(int32_t *args, heap_t *heap) {
+    print_boolean(args, heap);
+    output_write(args[0], "\n", 1);
+    return 0;
+}
+
+static int64_t print_float(int32_t *args, heap_t *heap) {
+    (void) heap;
+    output_float(args[0], get_float(args[1]));
+    return 0;
+}
+
+static int64_t println_float(int32_t *args, heap_t *heap) {
+    print_float(args, heap);
+    output_write(args[0], "\n", 1);
+    return 0;
+}
+
+static int64_t print_double(int32_t *args, heap_t *heap) {
+    (void) heap;
+    output_double(args[0], get_double(&args[1]));
+    return 0;
+}
+
+static int64_t println_double(int32_t *args, heap_t *heap) {
+    print_double(args, heap);
+    output_write(args[0], "\n", 1);
+    return 0;
+}
+
+static int64_t println(int32_t *args, heap_t *heap) {
+    (void) heap;
+    output_write(args[0], "\n", 1);
+    return 0;
+}
+
+static int64_t print_string(int32_t *args, heap_t *heap) {
+    string_print(args[0], heap, args[1]);
+    return 0;
+}
+
+static int64_t println_string(int32_t *args, heap_t *heap) {
+    string_print(args[0], heap, args[1]);
+    output_write(args[0], "\n", 1);
+    return 0;
+}
+
+static int64_t length(int32_t *args, heap_t *heap) {
+    return string_length(heap, args[0]);
+}
+
+static int64_t char_at(int32_t *args, heap_t *heap) {
+    int32_t length = string_length(heap, args[0]);
+    if ((uint32_t) args[1] >= (uint32_t) length) {
+        char message[sizeof("Index  out of bounds for length ") + 2 * INT_DIGITS];
+        snprintf(message, sizeof(message), "Index %" PRId32 " out of bounds for length %" PRId32,
+                 args[1], length);
+        native_exception =
+            exception_new(heap, "java/lang/StringIndexOutOfBoundsException", message);
+        return 0;
+    }
+    return string_char_at(heap, args[0], args[1]);
+}
+
+static int64_t object_init(int32_t *args, heap_t *heap) {
+    (void) args;
+    (void) heap;
+    return 0;
+}
+
+static int64_t builder_init(int32_t *args, heap_t *heap) {
+    (void) args;
+    (void) heap;
+    return 0;
+}
+
+static int64_t builder_init_string(int32_t *args, heap_t *heap) {
+    string_builder_append(heap, args[0], PART_STRING, args[1]);
+    return 0;
+}
+
+static int64_t append_string(int32_t *args, heap_t *heap) {
+    string_builder_append(heap, args[0], PART_STRING, args[1]);
+    return args[0];
+}
+
+static int64_t append_int(int32_t *args, heap_t *heap) {
+    string_builder_append(heap, args[0], PART_INT, args[1]);
+    return args[0];
+}
+
+static int64_t append_char(int32_t *args, heap_t *heap) {
+    string_builder_append(heap, args[0], PART_CHAR, args[1]);
+    return args[0];
+}
+
+static int64_t append_boolean(int32_t *args, heap_t *heap) {
+    string_builder_append(heap, args[0], PART_BOOLEAN, args[1]);
+    return args[0];
+}
+
+static int64_t builder_to_string(int32_t *args, heap_t *heap) {
+    return string_builder_to_string(heap, args[0]);
+}
+
+/** Returns a double from a native method, as the bits of its two slots */
+static int64_t return_double(double value) {
+    int64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static int64_t math_sqrt(int32_t *args, heap_t *heap) {
+    (void) heap;
+    return return_double(sqrt(get_double(args)));
+}
+
+static int64_t math_abs(int32_t *args, heap_t *heap) {
+    (void) heap;
+    return return_double(fabs(get_double(args)));
+}
+
+static int64_t parse_int(int32_t *args, heap_t *heap) {
+    int32_t value = 0;
+    if (!string_parse_int(heap, args[0], &value)) {
+        // The message quotes the string, e.g. For input string: "12x"
+        const char *prefix = args[0] == NULL_REFERENCE ? "Cannot parse null string: "
+                                                       : "For input string: \"";
+        string_part_t parts[] = {
+            {PART_STRING, string_from_utf8(heap, prefix, strlen(prefix))},
+            {PART_STRING, args[0]},
+            {PART_CHAR, '"'},
+        };
+        int32_t message = string_concat(heap, parts, args[0] == NULL_REFERENCE ? 2 : 3);
+        native_exception = exception_new(heap, "java/lang/NumberFormatException", NULL);
+        heap_get(heap, native_exception)[1] = message;
+    }
+    return value;
+}
+
+/** An exception's message is Throwable's only field, which follows the header */
+static int64_t throwable_init(int32_t *args, heap_t *heap) {
+    heap_get(heap, args[0])[1] = NULL_REFERENCE;
+    return 0;
+}
+
+static int64_t throwable_init_message(int32_t *args, heap_t *heap) {
+    heap_get(heap, args[0])[1] = args[1];
+    return 0;
+}
+
+static int64_t throwable_get_message(int32_t *args, heap_t *heap) {
+    return heap_get(heap, args[0])[1];
+}
+
+static int64_t map_file(int32_t *args, heap_t *heap) {
+    int32_t *array = mapped_file_map(args[0], args[1]);
+    return heap_add_mapped(heap, array, (args[1] & MAPPED_READ_ONLY) != 0,
+                           current_frame->method, current_frame->pc);
+}
+
+static int64_t read_int(int32_t *args, heap_t *heap) {
+    (void) args;
+    int32_t value = 0;
+    if (input_int(&value) < 0) {
+        native_exception = exception_new(heap, "java/util/InputMismatchException", NULL);
+    }
+    return value;
+}
+
+static int64_t read_ints(int32_t *args, heap_t *heap) {
+    if (args[0] == NULL_REFERENCE) {
+        native_exception = exception_new(heap, "java/lang/NullPointerException", NULL);
+        return 0;
+    }
+    if (heap_entry(heap, args[0])->read_only) {
+        native_exception = exception_new(heap, "java/nio/ReadOnlyBufferException",
+                                         "Cannot store to a read-only array");
+        return 0;
+    }
+    int32_t *array = heap_get(heap, args[0]);
+    int64_t read = input_ints(&array[1], array[0]);
+    if (read < 0) {
+        native_exception = exception_new(heap, "java/util/InputMismatchException", NULL);
+    }
+    return read;
+}
+
+static int64_t read_line(int32_t *args, heap_t *heap) {
+    if (args[0] == NULL_REFERENCE) {
+        native_exception = exception_new(heap, "java/lang/NullPointerException", NULL);
+        return 0;
+    }
+    int32_t *array = heap_get(heap, args[0]);
+    return input_line(&array[1], array[0]);
+}
+
+static const native_method_t NATIVE_METHODS[] = {
+    {"java/io/PrintStream", "print", "(I)V", print_int, 2, 0, NULL, 0, NATIVE_INSTANCE},
+    {"java/io/PrintStream", "println", "(I)V", println_int, 2, 0, NULL, 0, NATIVE_INSTANCE},
+    {"java/io/PrintStream", "print", "(C)V", print_char, 2, 0, NULL, 0, NATIVE_INSTANCE},
+    {"java/io/PrintStream", "println", "(C)V", println_char, 2, 0, NULL, 0, NATIVE_INSTANCE},
+    {"java/io/PrintStream", "print", "(Z)V", print_boolean, 2, 0, NULL, 0, NATIVE_INSTANCE},
+    {"java/io/PrintStream", "println", "(Z)V", println_boolean, 2, 0, NULL, 0,
+     NATIVE_INSTANCE},
+    {"java/io/PrintStream", "print", "(F)V", print_float, 2, 0, NULL, 0, NATIVE_INSTANCE},
+    {"java/io/PrintStream", "println", "(F)V", println_float, 2, 0, NULL, 0, NATIVE_INSTANCE},
+    {"java/io/PrintStream", "print", "(D)V", print_double, 3, 0, NULL, 0, NATIVE_INSTANCE},
+    {"java/io/PrintStream", "println", "(D)V", println_double, 3, 0, NULL, 0,
+     NATIVE_INSTANCE},
+    {"java/io/PrintStream", "println", "()V", println, 1, 0, NULL, 0, NATIVE_INSTANCE},
+    {"java/io/PrintStream", "print", "(Ljava/lang/String;)V", print_string, 2, 0, NULL, 0,
+     NATIVE_INSTANCE},
+    {"java/io/PrintStream", "println", "(Ljava/lang/String;)V", println_string, 2, 0, NULL,
+     0, NATIVE_INSTANCE},
+    {"java/lang/Object", "<init>", "()V", object_init, 1, 0, NULL, 0, NATIVE_INSTANCE},
+    {"java/lang/String", "length", "()I", length, 1, 1, NULL, 0, NATIVE_INSTANCE},
+    {"java/lang/String", "charAt", "(I)C", char_at, 2, 1, NULL, 0, NATIVE_INSTANCE},
+    {"java/lang/StringBuilder", "<init>", "()V", builder_init, 1, 0, NULL, 0,
+     NATIVE_INSTANCE},
+    {"java/lang/StringBuilder", "<init>", "(Ljava/lang/String;)V", builder_init_string, 2,
+     0, NULL, 0, NATIVE_INSTANCE},
+    {"java/lang/StringBuilder", "append", "(Ljava/lang/String;)Ljava/lang/StringBuilder;",
+     append_string, 2, 1, NULL, 0, NATIVE_INSTANCE},
+    {"java/lang/StringBuilder", "append", "(I)Ljava/lang/StringBuilder;", append_int, 2, 1,
+     NULL, 0, NATIVE_INSTANCE},
+    {"java/lang/StringBuilder", "append", "(C)Ljava/lang/StringBuilder;", append_char, 2, 1,
+     NULL, 0, NATIVE_INSTANCE},
+    {"java/lang/StringBuilder", "append", "(Z)Ljava/lang/StringBuilder;", append_boolean, 2,
+     1, NULL, 0, NATIVE_INSTANCE},
+    {"java/lang/StringBuilder", "toString", "()Ljava/lang/String;", builder_to_string, 1, 1,
+     NULL, 0, NATIVE_INSTANCE},
+    {"java/lang/Math", "sqrt", "(D)D", math_sqrt, 2, 2, NULL, 0, NATIVE_STATIC},
+    {"java/lang/Math", "abs", "(D)D", math_abs, 2, 2, NULL, 0, NATIVE_STATIC},
+    {"java/lang/Integer", "parseInt", "(Ljava/lang/String;)I", parse_int, 1, 1, NULL, 0,
+     NATIVE_STATIC},
+    {"java/lang/Throwable", "<init>", "()V", throwable_init, 1, 0, NULL, 0, NATIVE_INSTANCE},
+    {"java/lang/Throwable", "<init>", "(Ljava/lang/String;)V", throwable_init_message, 2, 0,
+     NULL, 0, NATIVE_INSTANCE},
+    {"java/lang/Throwable", "getMessage", "()Ljava/lang/String;", throwable_get_message, 1,
+     1, NULL, 0, NATIVE_OVERRIDABLE},
+    {"teeny/MappedFile", "map", "(II)[I", map_file, 2, 1, NULL, 0, NATIVE_STATIC},
+    {"teeny/Stdin", "readInt", "()I", read_int, 0, 1, NULL, 0, NATIVE_STATIC},
+    {"teeny/Stdin", "readInts", "([I)I", read_ints, 1, 1, NULL, 0, NATIVE_STATIC},
+    {"teeny/Stdin", "readLine", "([C)I", read_line, 1, 1, NULL, 0, NATIVE_STATIC},
+};
+
+const native_method_t *find_native_method(const char *class_name, const char *name,
+                                          const char *descriptor) {
+    size_t count = sizeof(NATIVE_METHODS) / sizeof(NATIVE_METHODS[0]);
+    for (const native_method_t *native = NATIVE_METHODS; native < NATIVE_METHODS + count;
+         native++) {
+        if (strcmp(native->class_name, class_name) == 0 &&
+            strcmp(native->name, name) == 0 &&
+            strcmp(native->descriptor, descriptor) == 0) {
+            assert(native->arity == get_descriptor_parameters(descriptor) +
+                                        (native->receiver != NATIVE_STATIC) &&
+                   native->return_slots == get_return_slots(descriptor) &&
+                   "Native method does not match its descriptor");
+            return native;
+        }
+    }
+    return NULL;
+}
+
+/** The libraries loaded with load_native_library() */
+static void **libraries = NULL;
+static size_t library_count = 0;
+
+void load_native_library(const char *path) {
+    void *library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (library == NULL) {
+        fprintf(stderr, "Failed to load native library: %s\n", dlerror());
+        exit(1);
+    }
+    libraries = realloc(libraries, (library_count + 1) * sizeof(void *));
+    assert(libraries != NULL && "Failed to allocate native libraries");
+    libraries[library_count++] = library;
+}
+
+/**
+ * Stands in for a library method that no loaded library defines, so that
+ * calling it throws UnsatisfiedLinkError. The caller's frame is at the call,
+ * whose operand names the method.
+ */
+static int64_t unsatisfied_link(int32_t *args, heap_t *heap) {
+    (void) args;
+    const method_t *caller = current_frame->method;
+    const char *class_name, *name, *descriptor;
+    get_member_ref(caller->class, operand_index(caller->code.code, current_frame->pc),
+                   &class_name, &name, &descriptor);
+    char message[strlen(class_name) + strlen(name) + strlen(descriptor) + 2];
+    snprintf(message, sizeof(message), "%s.%s%s", class_name, name, descriptor);
+    native_exception = exception_new(heap, "java/lang/UnsatisfiedLinkError", message);
+    return 0;
+}
+
+native_method_t *bind_library_method(const class_file_t *class, const method_t *method) {
+    // The symbol is the class name (with / and $ replaced) and the method name
+    size_t class_length = strlen(class->name);
+    char symbol[class_length + 1 + strlen(method->name) + 1];
+    strcpy(symbol, class->name);
+    for (char *c = symbol; *c != '\0'; c++) {
+        if (*c == '/' || *c == '$') {
+            *c = '_';
+        }
+    }
+    symbol[class_length] = '_';
+    strcpy(symbol + class_length + 1, method->name);
+
+    // Library functions take no receiver, so they can only implement static methods
+    bool is_static = (method->access_flags & IS_STATIC) != 0;
+    teeny_native_t function = NULL;
+    for (size_t i = 0; is_static && i < library_count && function == NULL; i++) {
+        *(void **) &function = dlsym(libraries[i], symbol);
+    }
+
+    native_method_t *native = malloc(sizeof(*native));
+    assert(native != NULL && "Failed to allocate native method");
+    if (function == NULL) {
+        // The method may never be called, so it only fails if it is
+        *native = (native_method_t){.class_name = class->name,
+                                    .name = method->name,
+                                    .descriptor = method->descriptor,
+                                    .function = unsatisfied_link,
+                                    .arity = get_number_of_parameters(method),
+                                    .return_slots = get_return_slots(method->descriptor),
+                                    .receiver = is_static ? NATIVE_STATIC : NATIVE_INSTANCE};
+        return native;
+    }
+    *native = (native_method_t){.class_name = class->name,
+                                .name = method->name,
+                                .descriptor = method->descriptor,
+                                .arity = method->parameter_count,
+                                .library_function = function,
+                                .receiver = NATIVE_STATIC};
+    assert(native->arity <= 32 && "Too many native method arguments");
+
+    // Only ints and int arrays can be passed, and only ints returned
+    const char *type = method->descriptor + 1;
+    for (u2 arg = 0; arg < native->arity; arg++) {
+        if (strncmp(type, "[I", 2) == 0) {
+            native->array_arguments |= (uint32_t) 1 << arg;
+            type += 2;
+        }
+        else if (strchr("IZCBS", *type) != NULL) {
+            type++;
+        }
+        else {
+            fprintf(stderr, "Unsupported native method signature %s.%s%s\n", class->name,
+                    method->name, method->descriptor);
+            exit(1);
+        }
+    }
+    assert(*type == ')' && "Malformed descriptor");
+    native->return_slots = get_return_slots(method->descriptor);
+    if (native->return_slots > 0 && strchr("IZCBS", type[1]) == NULL) {
+        fprintf(stderr, "Unsupported native method return type %s.%s%s\n", class->name,
+                method->name, method->descriptor);
+        exit(1);
+    }
+    return native;
+}
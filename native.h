@@ -0,0 +1,95 @@
+#ifndef NATIVE_H
+#define NATIVE_H
+
+#include <stdbool.h>
+
+#include "class_file.h"
+#include "heap.h"
+#include "teeny_native.h"
+
+/**
+ * A method implemented in C by the VM, e.g. PrintStream.println(int).
+ *
+ * @param args the argument slots, starting with the receiver for instance methods
+ * @param heap the heap, for natives that access arrays
+ * @return the return value, ignored for void methods; a double is returned
+ *   as the 64 bits of its two slots (see frame.h)
+ */
+typedef int64_t (*native_function_t)(int32_t *args, heap_t *heap);
+
+/** How a native method is called on a receiver */
+typedef enum {
+    /** A static method, without a receiver */
+    NATIVE_STATIC,
+    /** An instance method no loaded class can override, e.g. String.length() */
+    NATIVE_INSTANCE,
+    /**
+     * An instance method of a class that loaded classes may extend and override,
+     * e.g. Throwable.getMessage()
+     */
+    NATIVE_OVERRIDABLE,
+} native_receiver_t;
+
+/**
+ * A native method and its calling convention. Methods built into the VM use
+ * `function`; methods from shared libraries use `library_function`.
+ */
+typedef struct native_method {
+    /** The class, name and descriptor of the method, as in a Methodref */
+    const char *class_name;
+    const char *name;
+    const char *descriptor;
+    /** The C function implementing the method */
+    native_function_t function;
+    /** The number of argument slots, including the receiver for instance methods */
+    u2 arity;
+    /** The number of slots the return value takes: 0 for void methods, 2 for doubles */
+    u1 return_slots;
+    /** The library function implementing the method, or NULL for built-in natives */
+    teeny_native_t library_function;
+    /** For library functions, bit i is set if argument i is an int[] */
+    uint32_t array_arguments;
+    /** Whether the method takes a receiver and whether it can be overridden */
+    native_receiver_t receiver;
+} native_method_t;
+
+/**
+ * The exception thrown by the last native method to return, or NULL_REFERENCE.
+ * A native method throws an exception by setting this before it returns;
+ * the interpreter then clears it and throws the exception from the call.
+ */
+extern int32_t native_exception;
+
+/**
+ * Finds the native implementation of a method.
+ *
+ * @param class_name the internal name of the method's class, e.g. "java/io/PrintStream"
+ * @param name the method name, e.g. "println"
+ * @param descriptor the method descriptor, e.g. "(I)V"
+ * @return the native method, or NULL if the VM doesn't implement it
+ */
+const native_method_t *find_native_method(const char *class_name, const char *name,
+                                          const char *descriptor);
+
+/**
+ * Loads a shared library whose functions can implement native methods.
+ * Exits with an error if the library cannot be loaded.
+ *
+ * @param path the path of the library, as given to dlopen()
+ */
+void load_native_library(const char *path);
+
+/**
+ * Binds a `native static` method to the function in a loaded library named
+ * after its class and method (see teeny_native.h). If there is no such
+ * function, calling the method throws UnsatisfiedLinkError, as does calling
+ * a native instance method, which library functions cannot implement.
+ * Exits with an error if the method's signature cannot be passed to a function.
+ *
+ * @param class the class declaring the method
+ * @param method the native method
+ * @return the binding, allocated on the heap
+ */
+native_method_t *bind_library_method(const class_file_t *class, const method_t *method);
+
+#endif /* NATIVE_H */
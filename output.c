@@ -0,0 +1,440 @@
+#include "output.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <float.h>
+#include <math.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "metrics.h"
+
+/** The size of each standard output buffer */
+#define OUTPUT_BUFFER_SIZE (1 << 16)
+
+/** The number of buffers the writer thread can have in flight */
+#define ASYNC_BUFFERS 8
+
+/** How long to wait for the writer thread after a fatal signal, in milliseconds */
+#define SIGNAL_FLUSH_TIMEOUT_MS 1000
+
+/** The signals whose default action kills the VM; output is flushed first */
+static const int FATAL_SIGNALS[] = {SIGABRT, SIGBUS, SIGFPE, SIGINT, SIGSEGV, SIGTERM};
+
+/**
+ * The standard output buffers. Without a writer thread, only the first is
+ * used. With one, they form a ring: the interpreter fills buffer
+ * `published % ASYNC_BUFFERS` while the writer writes the buffers from
+ * `written` up to `published`.
+ */
+static char buffers[ASYNC_BUFFERS][OUTPUT_BUFFER_SIZE];
+static size_t lengths[ASYNC_BUFFERS];
+static char *buffer = buffers[0];
+static size_t buffered = 0;
+static bool flush_registered = false;
+
+/** Whether a writer thread was started by output_start_writer() */
+static bool async = false;
+/** Buffers handed to the writer thread; only the interpreter changes this */
+static _Atomic size_t published = 0;
+/**
+ * Buffers that have been claimed for writing. Each buffer is written by
+ * whoever claims it: the writer thread, or the fatal signal handler, which
+ * claims all the rest by setting this to CLAIMED_BY_HANDLER.
+ */
+static _Atomic size_t claimed = 0;
+#define CLAIMED_BY_HANDLER SIZE_MAX
+/** Buffers written by the writer thread; only the writer changes this */
+static _Atomic size_t written = 0;
+/** Posted when a buffer is published, and when a buffer is written */
+static sem_t buffers_published;
+static sem_t buffers_written;
+
+/** Writes all the bytes to a file descriptor, retrying partial writes */
+static void write_fully(int fd, const char *bytes, size_t length) {
+    while (length > 0) {
+        ssize_t count = write(fd, bytes, length);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        assert(count > 0 && "Failed to write output");
+        bytes += count;
+        length -= count;
+    }
+}
+
+/** Writes the published buffers in order, until the signal handler claims them */
+static void *writer_thread(void *arg) {
+    (void) arg;
+    while (true) {
+        sem_wait(&buffers_published);
+        size_t next = atomic_load_explicit(&claimed, memory_order_relaxed);
+        while (next != CLAIMED_BY_HANDLER &&
+               next != atomic_load_explicit(&published, memory_order_acquire)) {
+            if (!atomic_compare_exchange_strong(&claimed, &next, next + 1)) {
+                continue;
+            }
+            write_fully(STDOUT_FILENO, buffers[next % ASYNC_BUFFERS],
+                        lengths[next % ASYNC_BUFFERS]);
+            next++;
+            atomic_store_explicit(&written, next, memory_order_release);
+            sem_post(&buffers_written);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Hands the current buffer to the writer, or writes it without a writer.
+ * Waits while every buffer is in flight.
+ */
+static void hand_off(void) {
+    if (!async) {
+        write_fully(STDOUT_FILENO, buffer, buffered);
+        buffered = 0;
+        return;
+    }
+    if (buffered == 0) {
+        return;
+    }
+    // The buffer is switched before it is published, so a signal handler
+    // running in between sees it as pending rather than as the current one
+    size_t next = atomic_load_explicit(&published, memory_order_relaxed);
+    lengths[next % ASYNC_BUFFERS] = buffered;
+    buffer = buffers[(next + 1) % ASYNC_BUFFERS];
+    buffered = 0;
+    atomic_store_explicit(&published, next + 1, memory_order_release);
+    sem_post(&buffers_published);
+    // The new current buffer may still be being written
+    while (next + 1 - atomic_load_explicit(&written, memory_order_acquire) == ASYNC_BUFFERS) {
+        sem_wait(&buffers_written);
+    }
+}
+
+void output_flush(void) {
+    hand_off();
+    if (async) {
+        while (atomic_load_explicit(&written, memory_order_acquire) !=
+               atomic_load_explicit(&published, memory_order_relaxed)) {
+            sem_wait(&buffers_written);
+        }
+    }
+}
+
+/** Writes bytes to standard output from a signal handler, giving up on an error */
+static void write_on_signal(const char *bytes, size_t length) {
+    for (size_t offset = 0; offset < length;) {
+        ssize_t count = write(STDOUT_FILENO, bytes + offset, length - offset);
+        if (count <= 0 && errno != EINTR) {
+            break;
+        }
+        offset += count > 0 ? count : 0;
+    }
+}
+
+/** Sleeps for up to `timeout_ms` until the writer has written `target` buffers */
+static void wait_for_writer(size_t target, int timeout_ms) {
+    struct timespec millisecond = {.tv_sec = 0, .tv_nsec = 1000000};
+    for (int waited = 0; atomic_load_explicit(&written, memory_order_acquire) != target &&
+                         (timeout_ms < 0 || waited < timeout_ms);
+         waited++) {
+        nanosleep(&millisecond, NULL);
+    }
+}
+
+/**
+ * Writes the buffered output when a signal is about to kill the VM, then
+ * kills it. This runs on the interpreter thread, between any two statements
+ * of hand_off(). The writer thread gets a chance to finish the buffers it has.
+ * If it does not finish in time, the buffers it has not claimed are claimed
+ * and written here, after the one it is writing, so each buffer is written
+ * once and in order.
+ */
+static void flush_on_signal(int signal_number) {
+    size_t target = atomic_load_explicit(&published, memory_order_relaxed);
+    // hand_off() switched buffers but did not publish the last one yet
+    bool pending = buffer != buffers[target % ASYNC_BUFFERS];
+    if (pending) {
+        target++;
+    }
+    wait_for_writer(target, SIGNAL_FLUSH_TIMEOUT_MS);
+    // Only async-signal-safe calls from here on
+    size_t next = atomic_exchange(&claimed, CLAIMED_BY_HANDLER);
+    if (next != CLAIMED_BY_HANDLER) {
+        wait_for_writer(next, -1);
+        for (; next != target; next++) {
+            write_on_signal(buffers[next % ASYNC_BUFFERS], lengths[next % ASYNC_BUFFERS]);
+        }
+        if (!pending) {
+            write_on_signal(buffer, buffered);
+        }
+        buffered = 0;
+    }
+    // The handler was reset, so the signal kills the VM once it is unblocked
+    raise(signal_number);
+}
+
+/** Registers the exit and signal handlers that flush standard output */
+static void register_flush(void) {
+    atexit(output_flush);
+    for (size_t i = 0; i < sizeof(FATAL_SIGNALS) / sizeof(FATAL_SIGNALS[0]); i++) {
+        struct sigaction action = {.sa_handler = flush_on_signal, .sa_flags = SA_RESETHAND};
+        sigemptyset(&action.sa_mask);
+        sigaction(FATAL_SIGNALS[i], &action, NULL);
+    }
+    flush_registered = true;
+}
+
+int output_create_thread(pthread_t *thread, void *(*start)(void *), void *arg) {
+    // The thread inherits a mask blocking the flushed signals, so their handler
+    // runs on the interpreter thread, which owns the current buffer
+    sigset_t flushed;
+    sigset_t previous;
+    sigemptyset(&flushed);
+    for (size_t i = 0; i < sizeof(FATAL_SIGNALS) / sizeof(FATAL_SIGNALS[0]); i++) {
+        sigaddset(&flushed, FATAL_SIGNALS[i]);
+    }
+    pthread_sigmask(SIG_BLOCK, &flushed, &previous);
+    int result = pthread_create(thread, NULL, start, arg);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    return result;
+}
+
+void output_start_writer(void) {
+    assert(!async && buffered == 0 && "Writer started after output");
+    int result = sem_init(&buffers_published, 0, 0) | sem_init(&buffers_written, 0, 0);
+    assert(result == 0 && "Failed to create writer semaphores");
+    pthread_t writer;
+    result = output_create_thread(&writer, writer_thread, NULL);
+    assert(result == 0 && "Failed to start writer thread");
+    pthread_detach(writer);
+    async = true;
+}
+
+void output_write(int32_t stream, const char *bytes, size_t length) {
+    metrics_add(&thread_metrics->output_bytes, length);
+    if (stream == STDERR_REFERENCE) {
+        write_fully(STDERR_FILENO, bytes, length);
+        return;
+    }
+    assert(stream == STDOUT_REFERENCE && "Not an output stream");
+
+    if (!flush_registered) {
+        register_flush();
+    }
+    if (buffered + length > OUTPUT_BUFFER_SIZE) {
+        hand_off();
+        // Without a writer, writes that would not fit in the buffer anyway go
+        // straight out; with one, they are split across buffers to stay in order
+        if (length > OUTPUT_BUFFER_SIZE && !async) {
+            write_fully(STDOUT_FILENO, bytes, length);
+            return;
+        }
+        while (length > OUTPUT_BUFFER_SIZE) {
+            memcpy(buffer, bytes, OUTPUT_BUFFER_SIZE);
+            buffered = OUTPUT_BUFFER_SIZE;
+            hand_off();
+            bytes += OUTPUT_BUFFER_SIZE;
+            length -= OUTPUT_BUFFER_SIZE;
+        }
+    }
+    memcpy(buffer + buffered, bytes, length);
+    buffered += length;
+}
+
+char *format_int(char digits[INT_DIGITS], int32_t value) {
+    // Format the digits backwards from the end of the buffer
+    char *start = digits + INT_DIGITS;
+    uint32_t magnitude = value < 0 ? -(uint32_t) value : (uint32_t) value;
+    do {
+        *--start = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (value < 0) {
+        *--start = '-';
+    }
+    return start;
+}
+
+void output_int(int32_t stream, int32_t value) {
+    char digits[INT_DIGITS];
+    char *start = format_int(digits, value);
+    output_write(stream, start, digits + INT_DIGITS - start);
+}
+
+void output_char(int32_t stream, uint16_t value) {
+    char bytes[3];
+    size_t length;
+    if (value < 0x80) {
+        bytes[0] = value;
+        length = 1;
+    }
+    else if (value < 0x800) {
+        bytes[0] = 0xC0 | value >> 6;
+        bytes[1] = 0x80 | (value & 0x3F);
+        length = 2;
+    }
+    else {
+        bytes[0] = 0xE0 | value >> 12;
+        bytes[1] = 0x80 | (value >> 6 & 0x3F);
+        bytes[2] = 0x80 | (value & 0x3F);
+        length = 3;
+    }
+    output_write(stream, bytes, length);
+}
+
+/** The most significant digits needed to round-trip any double */
+#define MAX_DOUBLE_DIGITS 17
+
+/** Checks whether a decimal reads back as a value */
+static bool round_trips(const char *decimal, double value, bool is_float) {
+    return is_float ? strtof(decimal, NULL) == (float) value : strtod(decimal, NULL) == value;
+}
+
+/**
+ * Gets the significant digits of a decimal from printf()'s %e or %d format.
+ *
+ * @param digits set to the digits, without trailing zeros
+ * @return the number of digits
+ */
+static int significant_digits(const char *decimal, char digits[MAX_DOUBLE_DIGITS]) {
+    int count = 0;
+    for (const char *c = decimal; *c != '\0' && *c != 'e'; c++) {
+        if (*c != '.') {
+            digits[count++] = *c;
+        }
+    }
+    while (count > 1 && digits[count - 1] == '0') {
+        count--;
+    }
+    return count;
+}
+
+/**
+ * Finds the shortest decimal that reads back as a positive, finite value,
+ * choosing the closest one if several decimals have that many digits.
+ *
+ * This is deliberately simpler than a dedicated shortest-digits algorithm like
+ * Ryu or Schubfach (which Java itself uses): it relies on the C library's
+ * correctly rounded printf() and strtod(), and costs at most three pairs of
+ * calls to them per normal value, which is negligible next to writing the output.
+ *
+ * @param digits set to the decimal's significant digits, without trailing zeros
+ * @param exponent set to the decimal's exponent, as in d.ddd * 10^exponent
+ * @return the number of digits
+ */
+static int shortest_digits(double value, bool is_float, char digits[MAX_DOUBLE_DIGITS],
+                           int *exponent) {
+    char decimal[MAX_DOUBLE_DIGITS + sizeof(".e-308")];
+    // Integers below 10^7 are common, and all their digits are significant
+    if (value < 1e7 && value == (int32_t) value) {
+        int length = snprintf(decimal, sizeof(decimal), "%" PRId32, (int32_t) value);
+        *exponent = length - 1;
+        return significant_digits(decimal, digits);
+    }
+
+    // Any decimal of up to FLT_DIG or DBL_DIG digits reads back as a distinct value,
+    // so rounding to that many digits finds the shortest decimal that round-trips,
+    // padded with zeros. More digits are only tried if that does not round-trip.
+    // Subnormals have less precision, so their search starts from a single digit.
+    int precision = is_float ? FLT_DIG : DBL_DIG;
+    if (value < (is_float ? FLT_MIN : DBL_MIN)) {
+        precision = 1;
+    }
+    snprintf(decimal, sizeof(decimal), "%.*e", precision - 1, value);
+    while (!round_trips(decimal, value, is_float)) {
+        precision++;
+        snprintf(decimal, sizeof(decimal), "%.*e", precision - 1, value);
+    }
+    int count = significant_digits(decimal, digits);
+    // Like Java, a closer two-digit decimal is preferred to a one-digit one
+    if (count == 1) {
+        snprintf(decimal, sizeof(decimal), "%.1e", value);
+        if (round_trips(decimal, value, is_float)) {
+            count = significant_digits(decimal, digits);
+        }
+    }
+    *exponent = atoi(strchr(decimal, 'e') + 1);
+    return count;
+}
+
+size_t format_double(char chars[DOUBLE_CHARS], double value, bool is_float) {
+    char *c = chars;
+    if (isnan(value)) {
+        memcpy(c, "NaN", strlen("NaN"));
+        return strlen("NaN");
+    }
+    if (signbit(value)) {
+        *c++ = '-';
+        value = -value;
+    }
+    if (isinf(value)) {
+        memcpy(c, "Infinity", strlen("Infinity"));
+        return c + strlen("Infinity") - chars;
+    }
+    if (value == 0) {
+        memcpy(c, "0.0", strlen("0.0"));
+        return c + strlen("0.0") - chars;
+    }
+
+    char digits[MAX_DOUBLE_DIGITS];
+    int exponent;
+    int count = shortest_digits(value, is_float, digits, &exponent);
+    if (-3 <= exponent && exponent < 7) {
+        // Plain notation, e.g. 0.001 or 1234.5, with at least one digit after the point
+        if (exponent < 0) {
+            memcpy(c, "0.000", 1 - exponent);
+            c += 1 - exponent;
+            memcpy(c, digits, count);
+            c += count;
+            return c - chars;
+        }
+        for (int i = 0; i <= exponent; i++) {
+            *c++ = i < count ? digits[i] : '0';
+        }
+        *c++ = '.';
+        if (count > exponent + 1) {
+            memcpy(c, &digits[exponent + 1], count - exponent - 1);
+            c += count - exponent - 1;
+        }
+        else {
+            *c++ = '0';
+        }
+        return c - chars;
+    }
+
+    // Computerized scientific notation, e.g. 1.0E7 or 1.25E-5
+    *c++ = digits[0];
+    *c++ = '.';
+    if (count > 1) {
+        memcpy(c, &digits[1], count - 1);
+        c += count - 1;
+    }
+    else {
+        *c++ = '0';
+    }
+    *c++ = 'E';
+    char exponent_digits[INT_DIGITS];
+    char *start = format_int(exponent_digits, exponent);
+    memcpy(c, start, exponent_digits + INT_DIGITS - start);
+    c += exponent_digits + INT_DIGITS - start;
+    return c - chars;
+}
+
+void output_double(int32_t stream, double value) {
+    char chars[DOUBLE_CHARS];
+    output_write(stream, chars, format_double(chars, value, false));
+}
+
+void output_float(int32_t stream, float value) {
+    char chars[DOUBLE_CHARS];
+    output_write(stream, chars, format_double(chars, value, true));
+}
@@ -0,0 +1,95 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * The references that System.out and System.err evaluate to.
+ * They are negative so they never collide with heap references.
+ */
+#define STDOUT_REFERENCE (-1)
+#define STDERR_REFERENCE (-2)
+
+/**
+ * Writes bytes to a stream. Standard output is buffered until the buffer
+ * fills up or output_flush() is called; standard error is not buffered.
+ *
+ * @param stream STDOUT_REFERENCE or STDERR_REFERENCE
+ * @param bytes the bytes to write
+ * @param length the number of bytes
+ */
+void output_write(int32_t stream, const char *bytes, size_t length);
+
+/** Enough characters for any int in decimal, including a minus sign */
+#define INT_DIGITS 11
+
+/**
+ * Formats an int in decimal at the end of a buffer.
+ *
+ * @param digits the buffer
+ * @param value the int
+ * @return the first character; the characters end at digits + INT_DIGITS
+ */
+char *format_int(char digits[INT_DIGITS], int32_t value);
+
+/**
+ * Writes an int in decimal, like PrintStream.print(int).
+ */
+void output_int(int32_t stream, int32_t value);
+
+/**
+ * Writes a UTF-16 code unit encoded as UTF-8, like PrintStream.print(char).
+ */
+void output_char(int32_t stream, uint16_t value);
+
+/** Enough characters for any double in Java's format, e.g. "-2.2250738585072014E-308" */
+#define DOUBLE_CHARS 32
+
+/**
+ * Formats a double or float like Double.toString() or Float.toString(): the
+ * shortest decimal that reads back as the value, in plain notation from 10^-3
+ * up to 10^7 (e.g. "0.1" or "100.0") and in scientific notation otherwise (e.g. "1.0E-5").
+ *
+ * @param chars the buffer
+ * @param value the value; a float is passed as its exact double value
+ * @param is_float whether the value is a float, which needs fewer digits
+ * @return the number of characters
+ */
+size_t format_double(char chars[DOUBLE_CHARS], double value, bool is_float);
+
+/**
+ * Writes a double like PrintStream.print(double).
+ */
+void output_double(int32_t stream, double value);
+
+/**
+ * Writes a float like PrintStream.print(float).
+ */
+void output_float(int32_t stream, float value);
+
+/**
+ * Writes everything buffered for standard output, waiting for the writer
+ * thread if there is one. This is registered with atexit(), so output is not
+ * lost by exit(); output is also flushed before a signal kills the VM.
+ */
+void output_flush(void);
+
+/**
+ * Starts a thread that writes standard output, so the interpreter does not
+ * wait for slow pipes. The interpreter hands full buffers to the thread
+ * through a ring of buffers, and only waits when all of them are in flight.
+ * This must be called before any output.
+ */
+void output_start_writer(void);
+
+/**
+ * Starts a thread like pthread_create(), with the signals that flush standard
+ * output blocked in it. Their handler must run on the interpreter thread,
+ * since it writes the buffer the interpreter is filling.
+ */
+int output_create_thread(pthread_t *thread, void *(*start)(void *), void *arg);
+
+#endif /* OUTPUT_H */
@@ -0,0 +1,99 @@
+#include "prefetch.h"
+
+#include <stddef.h>
+
+#include "bytecode.h"
+#include "jvm.h"
+
+bool prefetch_enabled = true;
+
+/** Counts the instructions in a range of bytecode that store to a local variable */
+static u4 count_writes(const u1 *code, u4 start, u4 end, u2 local) {
+    u4 writes = 0;
+    for (u4 pc = start; pc < end; pc += instruction_length(code, pc)) {
+        writes += writes_local(code, pc, local);
+    }
+    return writes;
+}
+
+/**
+ * Matches `iload index; iload stride; iadd; istore index`, with the loads in either order.
+ *
+ * @return whether the instructions at `pc` are such an update
+ */
+static bool match_stride_update(const u1 *code, u4 pc, u2 *index, u2 *stride) {
+    u2 first, second, stored;
+    u4 first_length = load_index(code, pc, i_iload, i_iload_0, &first);
+    if (first_length == 0) {
+        return false;
+    }
+    u4 second_length = load_index(code, pc + first_length, i_iload, i_iload_0, &second);
+    u4 add = pc + first_length + second_length;
+    if (second_length == 0 || first == second || code[add] != i_iadd ||
+        load_index(code, add + 1, i_istore, i_istore_0, &stored) == 0) {
+        return false;
+    }
+    if (stored != first && stored != second) {
+        return false;
+    }
+    *index = stored;
+    *stride = stored == first ? second : first;
+    return true;
+}
+
+/**
+ * Finds an array that an innermost loop accesses at a strided index.
+ *
+ * @param operands set to the prefetch instruction's operands:
+ *                 the locals of the array, the index and the stride
+ * @return whether the loop has such an access
+ */
+static bool find_strided_access(const code_t *code, u4 head, u4 back_branch, u1 operands[3]) {
+    const u1 *bytecode = code->code;
+    for (u4 pc = head; pc < back_branch; pc += instruction_length(bytecode, pc)) {
+        if (is_branch(bytecode[pc]) && branch_offset(bytecode, pc) < 0) {
+            return false;
+        }
+    }
+    for (u4 pc = head; pc < back_branch; pc += instruction_length(bytecode, pc)) {
+        u2 index, stride;
+        if (!match_stride_update(bytecode, pc, &index, &stride) ||
+            count_writes(bytecode, head, back_branch, index) != 1 ||
+            count_writes(bytecode, head, back_branch, stride) != 0) {
+            continue;
+        }
+        for (u4 access = head; access < back_branch;
+             access += instruction_length(bytecode, access)) {
+            u2 array, loaded;
+            u4 length = load_index(bytecode, access, i_aload, i_aload_0, &array);
+            if (length != 0 &&
+                load_index(bytecode, access + length, i_iload, i_iload_0, &loaded) != 0 &&
+                loaded == index && count_writes(bytecode, head, back_branch, array) == 0) {
+                operands[0] = (u1) array;
+                operands[1] = (u1) index;
+                operands[2] = (u1) stride;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void insert_prefetches(method_t *method) {
+    code_t *code = &method->code;
+    if (!prefetch_enabled || code->code == NULL || !can_relocate(code)) {
+        return;
+    }
+    for (u4 pc = 0; pc < code->code_length; pc += instruction_length(code->code, pc)) {
+        if (code->code[pc] != i_goto || branch_offset(code->code, pc) >= 0) {
+            continue;
+        }
+        u4 head = pc + branch_offset(code->code, pc);
+        u1 prefetch[4] = {i_prefetch};
+        if (find_strided_access(code, head, pc, &prefetch[1]) &&
+            insert_instruction(code, head, prefetch, sizeof(prefetch))) {
+            // The backward branch has moved past the prefetch
+            pc += sizeof(prefetch);
+        }
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <stdbool.h>
+
+#include "class_file.h"
+
+/**
+ * How many iterations ahead of a strided loop the prefetch instruction fetches.
+ * Far enough ahead to hide a cache miss behind the interpreter's work on the
+ * iterations in between, but close enough that the line is still cached when reached.
+ */
+#define PREFETCH_ITERATIONS 16
+
+/**
+ * The shortest stride, in ints, that is prefetched: the ints in a 64-byte
+ * cache line. A stride of elements spans array_element_ints() times as many
+ * ints, so 8 doubles fill a line. Hardware prefetchers keep up with shorter
+ * strides by themselves.
+ */
+#define PREFETCH_MIN_STRIDE 16
+
+/** Whether prefetch instructions are inserted (-Xnoprefetch turns this off) */
+extern bool prefetch_enabled;
+
+/**
+ * Inserts a prefetch instruction (see jvm.h) at the head of each innermost loop
+ * of a method that accesses an array at an index stepped by a loop-invariant
+ * stride, like the sieve's `for (j = i * i; j < n; j = j + i) prime[j] = 1`:
+ * the index is updated by `iload j; iload i; iadd; istore j` and written nowhere
+ * else in the loop, neither the stride nor the array are written in the loop, and
+ * the loop has `aload prime; iload j`. Hardware prefetchers miss such strides,
+ * which can span many pages.
+ *
+ * This must run after loops are unrolled and before stack maps are computed.
+ *
+ * @param method the method whose bytecode to rewrite
+ */
+void insert_prefetches(method_t *method);
+
+#endif /* PREFETCH_H */
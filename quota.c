@@ -0,0 +1,83 @@
+#include "quota.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "safepoint.h"
+
+size_t quota_heap_bytes = 0;
+size_t quota_max_heap_bytes = SIZE_MAX;
+size_t quota_max_depth = SIZE_MAX;
+
+static quota_limits_t limits;
+
+static void budget_exhausted(frame_t *top, void *arg) {
+    (void) arg;
+    quota_exceeded(QUOTA_BUDGET, top);
+}
+
+static void deadline_passed(frame_t *top, void *arg) {
+    (void) arg;
+    quota_exceeded(QUOTA_TIMEOUT, top);
+}
+
+static void request_deadline(int signal) {
+    (void) signal;
+    safepoint_request_operation(SAFEPOINT_DEADLINE);
+}
+
+void quota_enable(const quota_limits_t *new_limits) {
+    limits = *new_limits;
+    if (limits.budget != 0) {
+        safepoint_budget = limits.budget;
+        safepoint_register_operation(SAFEPOINT_BUDGET_EXHAUSTED, budget_exhausted, NULL);
+    }
+    if (limits.max_heap_bytes != 0) {
+        quota_max_heap_bytes = limits.max_heap_bytes;
+    }
+    if (limits.max_depth != 0) {
+        quota_max_depth = limits.max_depth;
+    }
+    if (limits.timeout_ms != 0) {
+        // The timer only requests a safepoint; the interpreter exits at its next poll
+        safepoint_register_operation(SAFEPOINT_DEADLINE, deadline_passed, NULL);
+        struct sigaction action = {.sa_handler = request_deadline};
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = SA_RESTART;
+        int error = sigaction(SIGALRM, &action, NULL);
+        assert(error == 0 && "Failed to install SIGALRM handler");
+        struct itimerval timer = {
+            .it_value = {.tv_sec = limits.timeout_ms / 1000,
+                         .tv_usec = limits.timeout_ms % 1000 * 1000}};
+        error = setitimer(ITIMER_REAL, &timer, NULL);
+        assert(error == 0 && "Failed to start timeout timer");
+    }
+}
+
+void quota_exceeded(quota_t quota, const frame_t *frame) {
+    switch (quota) {
+        case QUOTA_BUDGET:
+            fprintf(stderr, "Budget of %" PRId64 " backward branches and calls exhausted",
+                    limits.budget);
+            break;
+        case QUOTA_HEAP:
+            fprintf(stderr, "Heap limit of %zu bytes exceeded", quota_max_heap_bytes);
+            break;
+        case QUOTA_DEPTH:
+            fprintf(stderr, "Stack depth limit of %zu frames exceeded", quota_max_depth);
+            break;
+        case QUOTA_TIMEOUT:
+            fprintf(stderr, "Timeout of %" PRIu64 " ms exceeded", limits.timeout_ms);
+            break;
+        default:
+            assert(false && "Unknown quota");
+    }
+    fprintf(stderr, " in %s%s at pc %zu\n", frame->method->name, frame->method->descriptor,
+            frame->pc);
+    exit(QUOTA_EXIT_STATUS(quota));
+}
@@ -0,0 +1,81 @@
+#ifndef QUOTA_H
+#define QUOTA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "frame.h"
+
+/**
+ * Resource limits for a run. When one is exceeded, the VM prints a short
+ * diagnostic to stderr and exits with the quota's exit status.
+ */
+typedef enum {
+    /** Too many backward branches and calls (safepoint polls) */
+    QUOTA_BUDGET,
+    /** Too many bytes of arrays allocated */
+    QUOTA_HEAP,
+    /** Too many nested calls */
+    QUOTA_DEPTH,
+    /** Ran for too long */
+    QUOTA_TIMEOUT,
+    NUM_QUOTAS
+} quota_t;
+
+/** The exit status of a run that exceeded a quota */
+#define QUOTA_EXIT_STATUS(quota) (3 + (quota))
+
+/** The limits of a run. Zero means unlimited. */
+typedef struct {
+    /** The maximum number of safepoint polls */
+    int64_t budget;
+    /** The maximum number of bytes of arrays */
+    size_t max_heap_bytes;
+    /** The maximum number of frames on the Java stack */
+    size_t max_depth;
+    /** The maximum wall-clock run time, in milliseconds */
+    uint64_t timeout_ms;
+} quota_limits_t;
+
+/** The number of bytes of arrays allocated so far */
+extern size_t quota_heap_bytes;
+/** The limits in effect (SIZE_MAX when unlimited) */
+extern size_t quota_max_heap_bytes;
+extern size_t quota_max_depth;
+
+/**
+ * Enforces limits for the rest of the run. The timeout starts now.
+ */
+void quota_enable(const quota_limits_t *limits);
+
+/**
+ * Prints a diagnostic and exits with QUOTA_EXIT_STATUS(quota).
+ *
+ * @param quota the quota that was exceeded
+ * @param frame the innermost frame, with its pc up to date
+ */
+void quota_exceeded(quota_t quota, const frame_t *frame) __attribute__((noreturn));
+
+/**
+ * Accounts for an array allocation, exiting if the heap limit is exceeded.
+ *
+ * @param bytes the size of the array
+ * @param frame the allocating frame, with its pc up to date
+ */
+static inline void quota_charge_heap(size_t bytes, const frame_t *frame) {
+    quota_heap_bytes += bytes;
+    if (__builtin_expect(quota_heap_bytes > quota_max_heap_bytes, 0)) {
+        quota_exceeded(QUOTA_HEAP, frame);
+    }
+}
+
+/**
+ * Exits if a new frame exceeds the stack depth limit.
+ */
+static inline void quota_check_depth(const frame_t *frame) {
+    if (__builtin_expect(frame->depth > quota_max_depth, 0)) {
+        quota_exceeded(QUOTA_DEPTH, frame);
+    }
+}
+
+#endif /* QUOTA_H */
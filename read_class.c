@@ -6,8 +6,15 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "image.h"
+#include "stats.h"
+
 const u4 CLASS_MAGIC = 0xCAFEBABE;
+const u2 IS_PRIVATE = 0x0002;
 const u2 IS_STATIC = 0x0008;
+const u2 IS_NATIVE = 0x0100;
+const u2 IS_INTERFACE = 0x0200;
+const u2 IS_ABSTRACT = 0x0400;
 
 /*
  * Functions for reading unsigned big-endian integers. We can't read directly
@@ -51,23 +58,46 @@ CONSTANT_NameAndType_info *get_method_name_and_type(cp_info *constant_pool, u2 i
     return name_and_type_constant->info;
 }
 
-u2 get_number_of_parameters(const method_t *method) {
+u2 get_descriptor_parameters(const char *descriptor) {
     // Type descriptors will always have the length ( + #params + ) + return type
-    char *end = strchr(method->descriptor, ')');
-    char *start = strchr(method->descriptor, '(');
+    const char *end = strchr(descriptor, ')');
+    const char *start = strchr(descriptor, '(');
 
     u2 params = 0;
 
     for (start++; start < end; start++) {
-        if (start[0] == '[') {
+        // Doubles and longs take two slots, but arrays of them are references
+        u2 slots = start[0] == 'D' || start[0] == 'J' ? 2 : 1;
+        // An array type is its element type prefixed by a [ per dimension
+        while (start[0] == '[') {
             start++;
         }
-        params++;
+        // A class type is L, the class name and a ;
+        if (start[0] == 'L') {
+            start = strchr(start, ';');
+        }
+        params += slots;
     }
 
     return params;
 }
 
+u1 get_return_slots(const char *descriptor) {
+    switch (strchr(descriptor, ')')[1]) {
+        case 'V':
+            return 0;
+        case 'D':
+        case 'J':
+            return 2;
+        default:
+            return 1;
+    }
+}
+
+u2 get_number_of_parameters(const method_t *method) {
+    return method->parameter_count + ((method->access_flags & IS_STATIC) == 0);
+}
+
 method_t *find_method(const char *name, const char *descriptor,
                       const class_file_t *class) {
     for (method_t *method = class->methods; method->name != NULL; method++) {
@@ -90,6 +120,38 @@ method_t *find_method_from_index(u2 index, const class_file_t *class) {
     return find_method(name->info, descriptor->info, class);
 }
 
+void get_member_ref(const class_file_t *class, u2 index, const char **class_name,
+                    const char **name, const char **descriptor) {
+    cp_info *member_constant = get_constant(class->constant_pool, index);
+    assert((member_constant->tag == CONSTANT_Methodref ||
+            member_constant->tag == CONSTANT_InterfaceMethodref ||
+            member_constant->tag == CONSTANT_Fieldref) &&
+           "Expected a MethodRef, InterfaceMethodRef or FieldRef");
+    CONSTANT_FieldOrMethodref_info *member_ref = member_constant->info;
+    *class_name = get_class_name(class, member_ref->class_index);
+    cp_info *name_and_type_constant =
+        get_constant(class->constant_pool, member_ref->name_and_type_index);
+    assert(name_and_type_constant->tag == CONSTANT_NameAndType &&
+           "Expected a NameAndType");
+    CONSTANT_NameAndType_info *name_and_type = name_and_type_constant->info;
+    cp_info *name_constant = get_constant(class->constant_pool, name_and_type->name_index);
+    assert(name_constant->tag == CONSTANT_Utf8 && "Expected a UTF8");
+    *name = name_constant->info;
+    cp_info *descriptor_constant =
+        get_constant(class->constant_pool, name_and_type->descriptor_index);
+    assert(descriptor_constant->tag == CONSTANT_Utf8 && "Expected a UTF8");
+    *descriptor = descriptor_constant->info;
+}
+
+const char *get_class_name(const class_file_t *class, u2 index) {
+    cp_info *class_constant = get_constant(class->constant_pool, index);
+    assert(class_constant->tag == CONSTANT_Class && "Expected a Class");
+    cp_info *name = get_constant(class->constant_pool,
+                                 ((CONSTANT_Class_info *) class_constant->info)->string_index);
+    assert(name->tag == CONSTANT_Utf8 && "Expected a UTF8");
+    return name->info;
+}
+
 class_header_t get_class_header(FILE *class_file) {
     class_header_t header;
     header.magic = read_u4(class_file);
@@ -104,6 +166,7 @@ cp_info *get_constant_pool(FILE *class_file) {
     u2 constant_pool_count = read_u2(class_file) - 1;
     cp_info *constant_pool = malloc(sizeof(cp_info[constant_pool_count + 1]));
     assert(constant_pool != NULL && "Failed to allocate constant pool");
+    stats_add_bytes(MEM_CONSTANT_POOL, sizeof(cp_info[constant_pool_count + 1]));
 
     cp_info *constant = constant_pool;
     while (constant_pool_count > 0) {
@@ -117,29 +180,99 @@ cp_info *get_constant_pool(FILE *class_file) {
                 assert(bytes_read == length && "Failed to read UTF8 constant");
                 info[length] = '\0';
                 constant->info = info;
+                stats_add_bytes(MEM_CONSTANT_POOL, length + 1);
                 break;
             }
 
             case CONSTANT_Integer: {
                 CONSTANT_Integer_info *value = malloc(sizeof(*value));
                 assert(value != NULL && "Failed to allocate integer constant");
+                stats_add_bytes(MEM_CONSTANT_POOL, sizeof(*value));
+                value->bytes = read_u4(class_file);
+                constant->info = value;
+                break;
+            }
+
+            case CONSTANT_Float: {
+                // A float is represented by its bits, like an int
+                CONSTANT_Integer_info *value = malloc(sizeof(*value));
+                assert(value != NULL && "Failed to allocate float constant");
+                stats_add_bytes(MEM_CONSTANT_POOL, sizeof(*value));
                 value->bytes = read_u4(class_file);
                 constant->info = value;
                 break;
             }
 
+            case CONSTANT_Long:
+            case CONSTANT_Double: {
+                CONSTANT_Long_info *value = malloc(sizeof(*value));
+                assert(value != NULL && "Failed to allocate long constant");
+                stats_add_bytes(MEM_CONSTANT_POOL, sizeof(*value));
+                uint64_t high = read_u4(class_file);
+                value->bytes = high << 32 | read_u4(class_file);
+                constant->info = value;
+                // The constant takes up two entries. The unusable second entry
+                // shares the value, so it does not end the constant pool.
+                constant++;
+                constant_pool_count--;
+                constant->tag = CONSTANT_Unusable;
+                constant->info = value;
+                break;
+            }
+
+            case CONSTANT_String: {
+                CONSTANT_String_info *value = malloc(sizeof(*value));
+                assert(value != NULL && "Failed to allocate string constant");
+                stats_add_bytes(MEM_CONSTANT_POOL, sizeof(*value));
+                value->string_index = read_u2(class_file);
+                constant->info = value;
+                break;
+            }
+
+            case CONSTANT_MethodHandle: {
+                CONSTANT_MethodHandle_info *value = malloc(sizeof(*value));
+                assert(value != NULL && "Failed to allocate MethodHandle constant");
+                stats_add_bytes(MEM_CONSTANT_POOL, sizeof(*value));
+                value->reference_kind = read_u1(class_file);
+                value->reference_index = read_u2(class_file);
+                constant->info = value;
+                break;
+            }
+
+            case CONSTANT_MethodType: {
+                CONSTANT_MethodType_info *value = malloc(sizeof(*value));
+                assert(value != NULL && "Failed to allocate MethodType constant");
+                stats_add_bytes(MEM_CONSTANT_POOL, sizeof(*value));
+                value->descriptor_index = read_u2(class_file);
+                constant->info = value;
+                break;
+            }
+
+            case CONSTANT_InvokeDynamic: {
+                CONSTANT_InvokeDynamic_info *value = malloc(sizeof(*value));
+                assert(value != NULL && "Failed to allocate InvokeDynamic constant");
+                stats_add_bytes(MEM_CONSTANT_POOL, sizeof(*value));
+                value->bootstrap_method_attr_index = read_u2(class_file);
+                value->name_and_type_index = read_u2(class_file);
+                constant->info = value;
+                break;
+            }
+
             case CONSTANT_Class: {
                 CONSTANT_Class_info *value = malloc(sizeof(*value));
                 assert(value != NULL && "Failed to allocate class constant");
+                stats_add_bytes(MEM_CONSTANT_POOL, sizeof(*value));
                 value->string_index = read_u2(class_file);
                 constant->info = value;
                 break;
             }
 
             case CONSTANT_Methodref:
+            case CONSTANT_InterfaceMethodref:
             case CONSTANT_Fieldref: {
                 CONSTANT_FieldOrMethodref_info *value = malloc(sizeof(*value));
                 assert(value != NULL && "Failed to allocate FieldRef/MethodRef constant");
+                stats_add_bytes(MEM_CONSTANT_POOL, sizeof(*value));
                 value->class_index = read_u2(class_file);
                 value->name_and_type_index = read_u2(class_file);
                 constant->info = value;
@@ -149,6 +282,7 @@ cp_info *get_constant_pool(FILE *class_file) {
             case CONSTANT_NameAndType: {
                 CONSTANT_NameAndType_info *value = malloc(sizeof(*value));
                 assert(value != NULL && "Failed to allocate NameAndType constant");
+                stats_add_bytes(MEM_CONSTANT_POOL, sizeof(*value));
                 value->name_index = read_u2(class_file);
                 value->descriptor_index = read_u2(class_file);
                 constant->info = value;
@@ -173,16 +307,50 @@ class_info_t get_class_info(FILE *class_file) {
     info.access_flags = read_u2(class_file);
     info.this_class = read_u2(class_file);
     info.super_class = read_u2(class_file);
-    u2 interfaces_count = read_u2(class_file);
-    assert(interfaces_count == 0 && "This VM does not support interfaces.");
-    u2 fields_count = read_u2(class_file);
-    assert(fields_count == 0 && "This VM does not support fields.");
     return info;
 }
 
+const char **get_interfaces(FILE *class_file, const class_file_t *class, u2 *interface_count) {
+    *interface_count = read_u2(class_file);
+    const char **interfaces = malloc(sizeof(char *[*interface_count + 1]));
+    assert(interfaces != NULL && "Failed to allocate interfaces");
+    stats_add_bytes(MEM_CONSTANT_POOL, sizeof(char *[*interface_count + 1]));
+    for (u2 i = 0; i < *interface_count; i++) {
+        interfaces[i] = get_class_name(class, read_u2(class_file));
+    }
+    return interfaces;
+}
+
+field_t *get_fields(FILE *class_file, cp_info *constant_pool, u2 *field_count) {
+    *field_count = read_u2(class_file);
+    field_t *fields = malloc(sizeof(field_t[*field_count + 1]));
+    assert(fields != NULL && "Failed to allocate fields");
+    stats_add_bytes(MEM_CONSTANT_POOL, sizeof(field_t[*field_count + 1]));
+
+    for (u2 i = 0; i < *field_count; i++) {
+        field_t *field = &fields[i];
+        field->access_flags = read_u2(class_file);
+        cp_info *name = get_constant(constant_pool, read_u2(class_file));
+        assert(name->tag == CONSTANT_Utf8 && "Expected a UTF8");
+        field->name = name->info;
+        cp_info *descriptor = get_constant(constant_pool, read_u2(class_file));
+        assert(descriptor->tag == CONSTANT_Utf8 && "Expected a UTF8");
+        field->descriptor = descriptor->info;
+        field->offset = 0;
+        // Skip the field's attributes, e.g. ConstantValue
+        for (u2 attributes = read_u2(class_file); attributes > 0; attributes--) {
+            read_u2(class_file);
+            u4 attribute_length = read_u4(class_file);
+            fseek(class_file, attribute_length, SEEK_CUR);
+        }
+    }
+    return fields;
+}
+
 void read_method_attributes(FILE *class_file, method_info *info, code_t *code,
-                            cp_info *constant_pool) {
+                            cp_info *constant_pool, bool skip_code) {
     bool found_code = false;
+    *code = (code_t){0};
     for (u2 attributes = info->attributes_count; attributes > 0; attributes--) {
         attribute_info ainfo;
         ainfo.attribute_name_index = read_u2(class_file);
@@ -190,7 +358,7 @@ void read_method_attributes(FILE *class_file, method_info *info, code_t *code,
         long attribute_end = ftell(class_file) + ainfo.attribute_length;
         cp_info *type_constant = get_constant(constant_pool, ainfo.attribute_name_index);
         assert(type_constant->tag == CONSTANT_Utf8 && "Expected a UTF8");
-        if (strcmp(type_constant->info, "Code") == 0) {
+        if (strcmp(type_constant->info, "Code") == 0 && !skip_code) {
             assert(!found_code && "Duplicate method code");
             found_code = true;
 
@@ -199,19 +367,36 @@ void read_method_attributes(FILE *class_file, method_info *info, code_t *code,
             code->code_length = read_u4(class_file);
             code->code = malloc(code->code_length);
             assert(code->code != NULL && "Failed to allocate method code");
+            stats_add_bytes(MEM_METHOD_BODIES, code->code_length);
             size_t bytes_read = fread(code->code, 1, code->code_length, class_file);
             assert(bytes_read == code->code_length && "Failed to read method code");
+
+            code->handler_count = read_u2(class_file);
+            code->handlers = malloc(sizeof(exception_handler_t[code->handler_count + 1]));
+            assert(code->handlers != NULL && "Failed to allocate exception table");
+            stats_add_bytes(MEM_METHOD_BODIES, sizeof(exception_handler_t[code->handler_count]));
+            for (u2 i = 0; i < code->handler_count; i++) {
+                exception_handler_t *handler = &code->handlers[i];
+                handler->start_pc = read_u2(class_file);
+                handler->end_pc = read_u2(class_file);
+                handler->handler_pc = read_u2(class_file);
+                handler->catch_type = read_u2(class_file);
+                handler->catch_class = NULL;
+            }
         }
         // Skip the rest of the attribute
         fseek(class_file, attribute_end, SEEK_SET);
     }
-    assert(found_code && "Missing method code");
+    // Native and abstract methods are implemented elsewhere, so they have no code
+    assert((found_code || skip_code || (info->access_flags & (IS_NATIVE | IS_ABSTRACT)) != 0) &&
+           "Missing method code");
 }
 
-method_t *get_methods(FILE *class_file, cp_info *constant_pool) {
+method_t *get_methods(FILE *class_file, const char *class_name, cp_info *constant_pool) {
     u2 method_count = read_u2(class_file);
     method_t *methods = malloc(sizeof(method_t[method_count + 1]));
     assert(methods != NULL && "Failed to allocate methods");
+    stats_add_bytes(MEM_METHOD_BODIES, sizeof(method_t[method_count + 1]));
 
     method_t *method = methods;
     while (method_count > 0) {
@@ -227,15 +412,17 @@ method_t *get_methods(FILE *class_file, cp_info *constant_pool) {
         cp_info *descriptor = get_constant(constant_pool, info.descriptor_index);
         assert(descriptor->tag == CONSTANT_Utf8 && "Expected a UTF8");
         method->descriptor = descriptor->info;
-
-        /* Our JVM can only execute static methods, so ensure all methods are static.
-         * However, javac creates a constructor method <init> we need to ignore. */
-        if (strcmp(method->name, "<init>") != 0) {
-            assert((info.access_flags & IS_STATIC) != 0 &&
-                   "This VM only supports static methods.");
-        }
-
-        read_method_attributes(class_file, &info, &method->code, constant_pool);
+        method->parameter_count = get_descriptor_parameters(method->descriptor);
+        method->access_flags = info.access_flags;
+        method->native = NULL;
+        method->vtable_index = 0;
+        method->selector = 0;
+        method->reachable = false;
+        method->effects = 0;
+
+        // An application image leaves out the code of methods that cannot be called
+        bool stripped = image_method_stripped(class_name, method->name, method->descriptor);
+        read_method_attributes(class_file, &info, &method->code, constant_pool, stripped);
 
         method++;
         method_count--;
@@ -246,6 +433,40 @@ method_t *get_methods(FILE *class_file, cp_info *constant_pool) {
     return methods;
 }
 
+void get_class_attributes(FILE *class_file, class_file_t *class) {
+    class->bootstrap_methods = NULL;
+    class->bootstrap_method_count = 0;
+    for (u2 attributes = read_u2(class_file); attributes > 0; attributes--) {
+        attribute_info ainfo;
+        ainfo.attribute_name_index = read_u2(class_file);
+        ainfo.attribute_length = read_u4(class_file);
+        long attribute_end = ftell(class_file) + ainfo.attribute_length;
+        cp_info *type_constant = get_constant(class->constant_pool, ainfo.attribute_name_index);
+        assert(type_constant->tag == CONSTANT_Utf8 && "Expected a UTF8");
+        if (strcmp(type_constant->info, "BootstrapMethods") == 0) {
+            u2 count = read_u2(class_file);
+            class->bootstrap_methods = malloc(sizeof(bootstrap_method_t[count]));
+            assert(class->bootstrap_methods != NULL && "Failed to allocate bootstrap methods");
+            stats_add_bytes(MEM_CONSTANT_POOL, sizeof(bootstrap_method_t[count]));
+            class->bootstrap_method_count = count;
+            for (u2 i = 0; i < count; i++) {
+                bootstrap_method_t *method = &class->bootstrap_methods[i];
+                method->bootstrap_method_ref = read_u2(class_file);
+                method->num_bootstrap_arguments = read_u2(class_file);
+                method->bootstrap_arguments = malloc(sizeof(u2[method->num_bootstrap_arguments]));
+                assert(method->bootstrap_arguments != NULL &&
+                       "Failed to allocate bootstrap arguments");
+                stats_add_bytes(MEM_CONSTANT_POOL, sizeof(u2[method->num_bootstrap_arguments]));
+                for (u2 arg = 0; arg < method->num_bootstrap_arguments; arg++) {
+                    method->bootstrap_arguments[arg] = read_u2(class_file);
+                }
+            }
+        }
+        // Skip the rest of the attribute
+        fseek(class_file, attribute_end, SEEK_SET);
+    }
+}
+
 class_file_t *get_class(FILE *class_file) {
     class_file_t *class = malloc(sizeof(*class));
     assert(class != NULL && "Failed to allocate class");
@@ -257,25 +478,89 @@ class_file_t *get_class(FILE *class_file) {
     // Read the constant pool
     class->constant_pool = get_constant_pool(class_file);
 
-    /* Read information about the class that was compiled.
-     * We don't need the result, but we need to skip past it. */
-    get_class_info(class_file);
+    // Read information about the class that was compiled
+    class_info_t info = get_class_info(class_file);
+    class->name = get_class_name(class, info.this_class);
+    // Only java/lang/Object has no superclass
+    class->super_name = info.super_class != 0 ? get_class_name(class, info.super_class) : NULL;
+    class->access_flags = info.access_flags;
+    class->interface_names = get_interfaces(class_file, class, &class->interface_count);
+
+    // Read the fields, whose layout is decided by the class loader
+    class->fields = get_fields(class_file, class->constant_pool, &class->field_count);
+
+    // Read the list of methods
+    class->methods = get_methods(class_file, class->name, class->constant_pool);
+    for (method_t *method = class->methods; method->name != NULL; method++) {
+        method->class = class;
+    }
 
-    // Read the list of static methods
-    class->methods = get_methods(class_file, class->constant_pool);
+    // Read the bootstrap methods of invokedynamic instructions
+    get_class_attributes(class_file, class);
+
+    // Methodrefs are resolved by link_class()
+    class->resolved_methods = NULL;
+    class->resolved_natives = NULL;
+    class->resolved_strings = NULL;
+    class->resolved_concats = NULL;
+
+    // The rest is filled in by the class loader
+    class->super_class = NULL;
+    class->id = 0;
+    class->instance_size = 0;
+    class->reference_offsets = NULL;
+    class->reference_count = 0;
+    class->interfaces = NULL;
+    class->vtable = NULL;
+    class->vtable_length = 0;
+    class->itable = NULL;
+    class->itable_mask = 0;
+    class->inline_caches = NULL;
+    class->inline_cache_count = 0;
+    class->array_literals = NULL;
+    class->array_literal_count = 0;
+    class->linked = false;
 
     return class;
 }
 
 void free_class(class_file_t *class) {
     for (cp_info *constant = class->constant_pool; constant->info != NULL; constant++) {
-        free(constant->info);
+        if (class->resolved_concats != NULL) {
+            free(class->resolved_concats[constant - class->constant_pool + 1]);
+        }
+        if (constant->tag != CONSTANT_Unusable) {
+            free(constant->info);
+        }
     }
     free(class->constant_pool);
 
     for (method_t *method = class->methods; method->name != NULL; method++) {
         free(method->code.code);
+        free(method->code.stack_maps);
+        free(method->code.reference_maps);
+        free(method->code.handlers);
+        free(method->native);
     }
     free(class->methods);
+    free(class->fields);
+    free(class->reference_offsets);
+    free(class->interface_names);
+    free(class->interfaces);
+    free(class->vtable);
+    free(class->itable);
+    free(class->inline_caches);
+    for (u2 i = 0; i < class->array_literal_count; i++) {
+        free(class->array_literals[i].values);
+    }
+    free(class->array_literals);
+    for (u2 i = 0; i < class->bootstrap_method_count; i++) {
+        free(class->bootstrap_methods[i].bootstrap_arguments);
+    }
+    free(class->bootstrap_methods);
+    free(class->resolved_methods);
+    free(class->resolved_natives);
+    free(class->resolved_strings);
+    free(class->resolved_concats);
     free(class);
 }
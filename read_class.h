@@ -4,6 +4,21 @@
 #include <stdio.h>
 #include "class_file.h"
 
+/** Method access flags */
+extern const u2 IS_PRIVATE;
+extern const u2 IS_STATIC;
+extern const u2 IS_NATIVE;
+extern const u2 IS_INTERFACE;
+extern const u2 IS_ABSTRACT;
+
+/*
+ * Functions for reading unsigned big-endian integers, as used in class files.
+ * They assert that the end of the file is not reached.
+ */
+u1 read_u1(FILE *class_file);
+u2 read_u2(FILE *class_file);
+u4 read_u4(FILE *class_file);
+
 /**
  * Finds the method with the given name and signature.
  * The descriptor is necessary because Java allows method overloading.
@@ -28,11 +43,49 @@ method_t *find_method(const char *name, const char *descriptor,
 method_t *find_method_from_index(uint16_t index, const class_file_t *class);
 
 /**
- * Gets the number of (integer) parameters a method takes.
+ * Gets the number of slots a method's parameters take,
+ * including `this` for instance methods.
  * Uses the descriptor string of the method to determine its signature.
  */
 uint16_t get_number_of_parameters(const method_t *method);
 
+/**
+ * Counts the slots the parameters in a method descriptor take.
+ * Doubles and longs take two slots; every other type takes one.
+ *
+ * @param descriptor the method descriptor string, e.g. "(I[IDLjava/lang/String;)V"
+ * @return the number of slots, e.g. 5
+ */
+uint16_t get_descriptor_parameters(const char *descriptor);
+
+/**
+ * Gets the number of slots a method's return value takes: 0 for void,
+ * 2 for doubles and longs and 1 otherwise.
+ *
+ * @param descriptor the method descriptor string, e.g. "(I)D"
+ */
+uint8_t get_return_slots(const char *descriptor);
+
+/**
+ * Gets the class, name and descriptor of a Methodref or Fieldref constant.
+ *
+ * @param class the parsed class file
+ * @param index the constant pool index of the Methodref or Fieldref
+ * @param class_name set to the internal name of the member's class
+ * @param name set to the member's name
+ * @param descriptor set to the member's descriptor
+ */
+void get_member_ref(const class_file_t *class, uint16_t index, const char **class_name,
+                    const char **name, const char **descriptor);
+
+/**
+ * Gets the internal name of a class constant, e.g. "java/lang/String".
+ *
+ * @param class the parsed class file
+ * @param index the constant pool index of the Class constant
+ */
+const char *get_class_name(const class_file_t *class, uint16_t index);
+
 /**
  * Reads an entire class file.
  * The end of the parsed methods array is marked by a method with a NULL name.
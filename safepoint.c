@@ -0,0 +1,47 @@
+#include "safepoint.h"
+
+int safepoint_requested = 0;
+int64_t safepoint_budget = INT64_MAX;
+
+/** Requested operations, as a bit set of safepoint_operation_t */
+static int pending_operations = 0;
+static safepoint_handler_t handlers[NUM_SAFEPOINT_OPERATIONS];
+static void *handler_args[NUM_SAFEPOINT_OPERATIONS];
+
+/** Sets `safepoint_requested` if operations are still pending */
+static void update_request(void) {
+    // Clearing the flag first means an operation requested meanwhile sets it again
+    __atomic_store_n(&safepoint_requested, 0, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pending_operations, __ATOMIC_SEQ_CST) != 0) {
+        __atomic_store_n(&safepoint_requested, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+void safepoint_register_operation(safepoint_operation_t operation,
+                                  safepoint_handler_t handler, void *arg) {
+    handlers[operation] = handler;
+    handler_args[operation] = arg;
+}
+
+void safepoint_request_operation(safepoint_operation_t operation) {
+    __atomic_or_fetch(&pending_operations, 1 << operation, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&safepoint_requested, 1, __ATOMIC_SEQ_CST);
+}
+
+void safepoint_reached(frame_t *top) {
+    if (safepoint_budget < 0 && handlers[SAFEPOINT_BUDGET_EXHAUSTED] != NULL) {
+        handlers[SAFEPOINT_BUDGET_EXHAUSTED](top,
+                                             handler_args[SAFEPOINT_BUDGET_EXHAUSTED]);
+    }
+
+    // Run the requested operations on this thread, which is now at a safepoint
+    int operations = __atomic_exchange_n(&pending_operations, 0, __ATOMIC_SEQ_CST);
+    for (safepoint_operation_t operation = 0; operation < NUM_SAFEPOINT_OPERATIONS;
+         operation++) {
+        if ((operations & (1 << operation)) && handlers[operation] != NULL) {
+            handlers[operation](top, handler_args[operation]);
+        }
+    }
+
+    update_request();
+}
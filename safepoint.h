@@ -0,0 +1,92 @@
+#ifndef SAFEPOINT_H
+#define SAFEPOINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "frame.h"
+
+/*
+ * Safepoints are the points where a thread running Java code may stop so the
+ * VM can inspect or change its state: method entries, backward branches and
+ * calls. At a safepoint every frame's pc is up to date and the method's stack
+ * map (see stack_map.h) gives the depth of its operand stack and which of its
+ * slots hold references.
+ *
+ * Threads poll `safepoint_requested` at method entries and backward branches,
+ * which costs a single load and test while nothing is requested. Each poll
+ * also consumes one unit of `safepoint_budget`, which bounds how long a run
+ * can loop or recurse.
+ *
+ * Requested operations run on the thread that reaches the safepoint. Only
+ * one thread runs Java code, so no thread ever waits for others to stop;
+ * stopping every thread at once is left until there are several.
+ */
+
+/** Operations run by threads at safepoints */
+typedef enum {
+    /** Requested asynchronously, e.g. from signal handlers */
+    SAFEPOINT_HEAP_DUMP,
+    SAFEPOINT_DEADLINE,
+    /** Run when `safepoint_budget` runs out */
+    SAFEPOINT_BUDGET_EXHAUSTED,
+    NUM_SAFEPOINT_OPERATIONS
+} safepoint_operation_t;
+
+/**
+ * A function run by a thread at a safepoint.
+ *
+ * @param top the thread's innermost frame
+ * @param arg the argument given when the operation was registered
+ */
+typedef void (*safepoint_handler_t)(frame_t *top, void *arg);
+
+/** Nonzero when threads must stop at their next safepoint poll */
+extern int safepoint_requested;
+
+/**
+ * How many more polls may happen before SAFEPOINT_BUDGET_EXHAUSTED runs.
+ * This is effectively unlimited unless a budget is set.
+ */
+extern int64_t safepoint_budget;
+
+/**
+ * Runs the operations due at a safepoint. Called by safepoint_poll().
+ *
+ * @param top the thread's innermost frame, with its pc up to date
+ */
+void safepoint_reached(frame_t *top);
+
+/**
+ * Polls for a safepoint. If one is requested or the budget has run out,
+ * records `pc` in the frame and runs the operations due.
+ *
+ * @param frame the thread's innermost frame
+ * @param pc the bytecode offset of the polling instruction
+ */
+static inline void safepoint_poll(frame_t *frame, size_t pc) {
+    if (__builtin_expect((--safepoint_budget < 0) |
+                             __atomic_load_n(&safepoint_requested, __ATOMIC_RELAXED),
+                         0)) {
+        frame->pc = pc;
+        safepoint_reached(frame);
+    }
+}
+
+/**
+ * Sets the function that runs a requested operation.
+ *
+ * @param operation the operation
+ * @param handler the function to run at a safepoint of the thread that notices the request
+ * @param arg passed to `handler`
+ */
+void safepoint_register_operation(safepoint_operation_t operation,
+                                  safepoint_handler_t handler, void *arg);
+
+/**
+ * Requests an operation to run at the next safepoint.
+ * This is async-signal-safe, so it can be called from a signal handler.
+ */
+void safepoint_request_operation(safepoint_operation_t operation);
+
+#endif /* SAFEPOINT_H */
@@ -0,0 +1,579 @@
+#include "stack_map.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bytecode.h"
+#include "dispatch.h"
+#include "java_string.h"
+#include "jvm.h"
+#include "native.h"
+#include "read_class.h"
+#include "stats.h"
+
+/** The effect of an instruction on the operand stack */
+typedef struct {
+    /** How many values the instruction pops */
+    u2 pops;
+    /** How many values the instruction pushes */
+    u2 pushes;
+} stack_effect_t;
+
+/**
+ * Determines how an instruction changes the operand stack.
+ *
+ * @return false if TeenyJVM does not support the instruction
+ */
+static bool get_stack_effect(const u1 *code, u4 pc, const class_file_t *class,
+                             stack_effect_t *effect) {
+    u1 instruction = code[pc];
+    switch (instruction) {
+        case i_nop:
+        case i_iinc:
+        case i_goto:
+        case i_return:
+        case i_array_literal:
+        case i_prefetch:
+            *effect = (stack_effect_t){0, 0};
+            return true;
+        // These replace the value on top of the stack, which may change its type
+        case i_ineg:
+        case i_newarray:
+        case i_anewarray:
+        case i_arraylength:
+        case i_getfield_int:
+        case i_getfield_short:
+        case i_getfield_char:
+        case i_getfield_byte:
+        case i_getfield_reference:
+        case i_fneg:
+        case i_i2f:
+        case i_f2i:
+            *effect = (stack_effect_t){1, 1};
+            return true;
+        case i_dneg:
+        case i_daload:
+            *effect = (stack_effect_t){2, 2};
+            return true;
+        case i_aconst_null:
+        case i_iconst_m1:
+        case i_iconst_0:
+        case i_iconst_1:
+        case i_iconst_2:
+        case i_iconst_3:
+        case i_iconst_4:
+        case i_iconst_5:
+        case i_bipush:
+        case i_sipush:
+        case i_ldc:
+        case i_ldc_w:
+        case i_ldc_string:
+        case i_ldc_w_string:
+        case i_new_builder:
+        case i_new_object:
+        case i_iload:
+        case i_iload_0:
+        case i_iload_1:
+        case i_iload_2:
+        case i_iload_3:
+        case i_aload:
+        case i_aload_0:
+        case i_aload_1:
+        case i_aload_2:
+        case i_aload_3:
+        case i_fconst_0:
+        case i_fconst_1:
+        case i_fconst_2:
+        case i_fload:
+        case i_fload_0:
+        case i_fload_1:
+        case i_fload_2:
+        case i_fload_3:
+            *effect = (stack_effect_t){0, 1};
+            return true;
+        case i_dconst_0:
+        case i_dconst_1:
+        case i_ldc2_w:
+        case i_dload:
+        case i_dload_0:
+        case i_dload_1:
+        case i_dload_2:
+        case i_dload_3:
+            *effect = (stack_effect_t){0, 2};
+            return true;
+        case i_i2d:
+        case i_f2d:
+        case i_getfield_double:
+            *effect = (stack_effect_t){1, 2};
+            return true;
+        case i_d2i:
+        case i_d2f:
+            *effect = (stack_effect_t){2, 1};
+            return true;
+        case i_dstore:
+        case i_dstore_0:
+        case i_dstore_1:
+        case i_dstore_2:
+        case i_dstore_3:
+        case i_dreturn:
+        case i_pop2:
+            *effect = (stack_effect_t){2, 0};
+            return true;
+        case i_dadd:
+        case i_dsub:
+        case i_dmul:
+        case i_ddiv:
+        case i_drem:
+            *effect = (stack_effect_t){4, 2};
+            return true;
+        case i_dcmpl:
+        case i_dcmpg:
+            *effect = (stack_effect_t){4, 1};
+            return true;
+        case i_dastore:
+            *effect = (stack_effect_t){4, 0};
+            return true;
+        case i_dup2:
+            *effect = (stack_effect_t){2, 4};
+            return true;
+        case i_pop:
+        case i_istore:
+        case i_fstore:
+        case i_fstore_0:
+        case i_fstore_1:
+        case i_fstore_2:
+        case i_fstore_3:
+        case i_istore_0:
+        case i_istore_1:
+        case i_istore_2:
+        case i_istore_3:
+        case i_astore:
+        case i_astore_0:
+        case i_astore_1:
+        case i_astore_2:
+        case i_astore_3:
+        case i_ifeq:
+        case i_ifne:
+        case i_iflt:
+        case i_ifge:
+        case i_ifgt:
+        case i_ifle:
+        case i_ifnull:
+        case i_ifnonnull:
+        case i_ireturn:
+        case i_freturn:
+        case i_areturn:
+        case i_athrow:
+            *effect = (stack_effect_t){1, 0};
+            return true;
+        case i_iadd:
+        case i_isub:
+        case i_imul:
+        case i_idiv:
+        case i_irem:
+        case i_ishl:
+        case i_ishr:
+        case i_iushr:
+        case i_iand:
+        case i_ior:
+        case i_ixor:
+        case i_iaload:
+        case i_faload:
+        case i_aaload:
+        case i_fadd:
+        case i_fsub:
+        case i_fmul:
+        case i_fdiv:
+        case i_frem:
+        case i_fcmpl:
+        case i_fcmpg:
+            *effect = (stack_effect_t){2, 1};
+            return true;
+        case i_if_icmpeq:
+        case i_if_icmpne:
+        case i_if_icmplt:
+        case i_if_icmpge:
+        case i_if_icmpgt:
+        case i_if_icmple:
+        case i_if_acmpeq:
+        case i_if_acmpne:
+            *effect = (stack_effect_t){2, 0};
+            return true;
+        case i_iastore:
+        case i_fastore:
+        case i_aastore:
+        case i_putfield_double:
+            *effect = (stack_effect_t){3, 0};
+            return true;
+        case i_print_builder:
+        case i_putfield_int:
+        case i_putfield_short:
+        case i_putfield_byte:
+            *effect = (stack_effect_t){2, 0};
+            return true;
+        case i_dup:
+            *effect = (stack_effect_t){1, 2};
+            return true;
+        case i_multianewarray:
+            // Pops the length of each dimension
+            *effect = (stack_effect_t){code[pc + 3], 1};
+            return true;
+        case i_invokestatic:
+        case i_invokespecial: {
+            method_t *callee = class->resolved_methods[operand_index(code, pc)];
+            if (callee == NULL) {
+                return false;
+            }
+            *effect = (stack_effect_t){get_number_of_parameters(callee),
+                                       get_return_slots(callee->descriptor)};
+            return true;
+        }
+        case i_invokevirtual_cached:
+        case i_invokeinterface_cached: {
+            const method_t *callee = class->inline_caches[operand_index(code, pc)].method;
+            *effect = (stack_effect_t){get_number_of_parameters(callee),
+                                       get_return_slots(callee->descriptor)};
+            return true;
+        }
+        case i_invokenative:
+        case i_invokenative_virtual:
+        case i_invokelibrary: {
+            const native_method_t *native = class->resolved_natives[operand_index(code, pc)];
+            *effect = (stack_effect_t){native->arity, native->return_slots};
+            return true;
+        }
+        case i_concat:
+        case i_print_concat: {
+            const concat_recipe_t *recipe = class->resolved_concats[operand_index(code, pc)];
+            // print_concat also pops the stream and pushes nothing
+            *effect = instruction == i_concat
+                          ? (stack_effect_t){recipe->argument_count, 1}
+                          : (stack_effect_t){recipe->argument_count + 1, 0};
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+/** Checks whether an instruction never continues to the next instruction */
+static bool is_return(u1 instruction) {
+    return instruction == i_ireturn || instruction == i_freturn || instruction == i_dreturn ||
+           instruction == i_areturn || instruction == i_return || instruction == i_athrow;
+}
+
+static int compare_stack_maps(const void *a, const void *b) {
+    u4 pc_a = ((const stack_map_t *) a)->pc;
+    u4 pc_b = ((const stack_map_t *) b)->pc;
+    return (pc_a > pc_b) - (pc_a < pc_b);
+}
+
+/** Checks whether a method descriptor's return type is a reference */
+static bool returns_reference(const char *descriptor) {
+    const char *type = strchr(descriptor, ')') + 1;
+    return *type == 'L' || *type == '[';
+}
+
+/**
+ * Checks whether the values an instruction pushes are references.
+ * Loads and dups push the types of the values they copy instead.
+ */
+static bool pushes_reference(const u1 *code, u4 pc, const class_file_t *class) {
+    switch (code[pc]) {
+        case i_aconst_null:
+        case i_aaload:
+        case i_ldc_string:
+        case i_ldc_w_string:
+        case i_new_builder:
+        case i_new_object:
+        case i_newarray:
+        case i_anewarray:
+        case i_multianewarray:
+        case i_concat:
+        case i_getfield_reference:
+            return true;
+        case i_invokestatic:
+        case i_invokespecial:
+            return returns_reference(
+                class->resolved_methods[operand_index(code, pc)]->descriptor);
+        case i_invokevirtual_cached:
+        case i_invokeinterface_cached:
+            return returns_reference(
+                class->inline_caches[operand_index(code, pc)].method->descriptor);
+        case i_invokenative:
+        case i_invokenative_virtual:
+        case i_invokelibrary:
+            return returns_reference(
+                class->resolved_natives[operand_index(code, pc)]->descriptor);
+        default:
+            return false;
+    }
+}
+
+/**
+ * Gets the local variable an instruction loads or stores.
+ *
+ * @return the index of the local variable, or -1 if the instruction is not a load or store
+ */
+static int32_t local_index(const u1 *code, u4 pc) {
+    u1 instruction = code[pc];
+    switch (instruction) {
+        case i_iload:
+        case i_fload:
+        case i_dload:
+        case i_aload:
+        case i_istore:
+        case i_fstore:
+        case i_dstore:
+        case i_astore:
+            return code[pc + 1];
+    }
+    // The loads and stores of local variables 0 to 3 come in groups of 4 by type
+    if (i_iload_0 <= instruction && instruction <= i_aload_3) {
+        return (instruction - i_iload_0) % 4;
+    }
+    if (i_istore_0 <= instruction && instruction <= i_astore_3) {
+        return (instruction - i_istore_0) % 4;
+    }
+    return -1;
+}
+
+/**
+ * Sets which local variables hold references when a method is entered:
+ * `this` and the parameters of reference types.
+ */
+static void entry_types(const method_t *method, bool *locals) {
+    u2 local = 0;
+    if ((method->access_flags & IS_STATIC) == 0) {
+        locals[local++] = true;
+    }
+    for (const char *type = method->descriptor + 1; *type != ')'; type++) {
+        bool is_array = *type == '[';
+        while (*type == '[') {
+            type++;
+        }
+        if (*type == 'L') {
+            type = strchr(type, ';');
+        }
+        locals[local] = is_array || *type == ';';
+        local += !is_array && (*type == 'D' || *type == 'J') ? 2 : 1;
+    }
+}
+
+/**
+ * Computes the types of the slots after an instruction from the types before it.
+ *
+ * @param state the types of the local variables followed by the stack slots,
+ *   which are updated
+ * @param depth the stack depth before the instruction
+ * @return the stack depth after the instruction
+ */
+static int32_t transfer_types(const u1 *code, u4 pc, const class_file_t *class,
+                              const code_t *method_code, stack_effect_t effect, bool *state,
+                              int32_t depth) {
+    bool *locals = state;
+    bool *stack = &state[method_code->max_locals];
+    u1 instruction = code[pc];
+    depth -= effect.pops;
+    int32_t local = local_index(code, pc);
+    if (local >= 0 && effect.pops == 0) {
+        // Loads copy their local variable's type; aload is the only one that can be a reference
+        stack[depth] = locals[local];
+    }
+    else if (local >= 0) {
+        // Stores pass their value's type on, while a double takes two int slots
+        locals[local] = stack[depth];
+        if (effect.pops == 2) {
+            locals[local + 1] = false;
+        }
+    }
+    else if (instruction == i_dup) {
+        stack[depth + 1] = stack[depth];
+    }
+    else if (instruction == i_dup2) {
+        stack[depth + 2] = stack[depth];
+        stack[depth + 3] = stack[depth + 1];
+    }
+    else {
+        bool reference = pushes_reference(code, pc, class);
+        for (u2 i = 0; i < effect.pushes; i++) {
+            stack[depth + i] = reference;
+        }
+    }
+    depth += effect.pushes;
+    assert(0 <= depth && depth <= method_code->max_stack && "Stack depth exceeds max_stack");
+    // Popped slots no longer hold anything
+    memset(&stack[depth], false, sizeof(bool[method_code->max_stack - depth]));
+    return depth;
+}
+
+/**
+ * Merges the state flowing into an instruction along one path with the state
+ * from the other paths. A slot only holds a reference if it does on every path.
+ *
+ * @return whether the instruction's state changed, so it must be visited again
+ */
+static bool merge_types(int32_t *depths, bool *types, size_t slots, u4 pc, int32_t depth,
+                        const bool *state) {
+    bool *merged = &types[pc * slots];
+    if (depths[pc] < 0) {
+        depths[pc] = depth;
+        memcpy(merged, state, sizeof(bool[slots]));
+        return true;
+    }
+    assert(depths[pc] == depth && "Inconsistent operand stack depth");
+    bool changed = false;
+    for (size_t i = 0; i < slots; i++) {
+        if (merged[i] && !state[i]) {
+            merged[i] = false;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+/**
+ * Computes a method's stack maps by following every path through its code,
+ * tracking the stack depth and which slots hold references before each instruction.
+ * Instructions are visited again until the types of their slots stop changing.
+ *
+ * @return false if the method uses an unsupported instruction
+ */
+static bool compute_method_stack_maps(method_t *method, const class_file_t *class) {
+    code_t *code = &method->code;
+    size_t slots = code->max_locals + code->max_stack;
+    // The stack depth before each instruction, or -1 if not reached yet
+    int32_t *depths = malloc(sizeof(int32_t[code->code_length + 1]));
+    // Whether each local variable and stack slot holds a reference before each instruction
+    bool *types = calloc(code->code_length * slots + 1, sizeof(bool));
+    bool *state = calloc(slots + 1, sizeof(bool));
+    u4 *worklist = malloc(sizeof(u4[code->code_length + 1]));
+    bool *queued = calloc(code->code_length + 1, sizeof(bool));
+    assert(depths != NULL && types != NULL && state != NULL && worklist != NULL &&
+           queued != NULL && "Failed to allocate stack map state");
+    memset(depths, 0xFF, sizeof(int32_t[code->code_length + 1]));
+    size_t pending = 0;
+
+    entry_types(method, state);
+    merge_types(depths, types, slots, 0, 0, state);
+    worklist[pending++] = 0;
+    queued[0] = true;
+
+    bool supported = true;
+    while (pending > 0 && supported) {
+        u4 pc = worklist[--pending];
+        queued[pc] = false;
+        int32_t depth = depths[pc];
+        u1 instruction = code->code[pc];
+        stack_effect_t effect;
+        supported = get_stack_effect(code->code, pc, class, &effect);
+        if (!supported) {
+            break;
+        }
+        assert(depth >= effect.pops && "Operand stack underflow");
+
+        // Exception handlers start with the local variables of any instruction
+        // they cover and just the exception on the stack
+        for (u2 i = 0; i < code->handler_count; i++) {
+            const exception_handler_t *handler = &code->handlers[i];
+            if (handler->start_pc <= pc && pc < handler->end_pc) {
+                memcpy(state, &types[pc * slots], sizeof(bool[slots]));
+                memset(&state[code->max_locals], false, sizeof(bool[code->max_stack]));
+                state[code->max_locals] = true;
+                if (merge_types(depths, types, slots, handler->handler_pc, 1, state) &&
+                    !queued[handler->handler_pc]) {
+                    queued[handler->handler_pc] = true;
+                    worklist[pending++] = handler->handler_pc;
+                }
+            }
+        }
+
+        // Successors are the branch target and/or the next instruction
+        u4 successors[2];
+        size_t successor_count = 0;
+        if (is_branch(instruction)) {
+            successors[successor_count++] = pc + branch_offset(code->code, pc);
+        }
+        if (instruction != i_goto && !is_return(instruction)) {
+            successors[successor_count++] = pc + instruction_length(code->code, pc);
+        }
+
+        memcpy(state, &types[pc * slots], sizeof(bool[slots]));
+        depth = transfer_types(code->code, pc, class, code, effect, state, depth);
+        for (size_t i = 0; i < successor_count; i++) {
+            u4 successor = successors[i];
+            assert(successor < code->code_length && "Control flows off the end of the code");
+            if (merge_types(depths, types, slots, successor, depth, state) &&
+                !queued[successor]) {
+                queued[successor] = true;
+                worklist[pending++] = successor;
+            }
+        }
+    }
+
+    // The safepoints are method entry, backward branches and calls. Their
+    // stack maps leave out the values they pop, e.g. the arguments of a call.
+    if (supported) {
+        size_t map_bytes = reference_map_bytes(code);
+        code->stack_maps = malloc(sizeof(stack_map_t[code->code_length + 1]));
+        code->reference_maps = calloc(code->code_length + 1, map_bytes);
+        assert(code->stack_maps != NULL && code->reference_maps != NULL &&
+               "Failed to allocate stack maps");
+        code->stack_map_count = 0;
+        for (u4 pc = 0; pc < code->code_length; pc += instruction_length(code->code, pc)) {
+            u1 instruction = code->code[pc];
+            bool safepoint =
+                pc == 0 || instruction == i_invokestatic || instruction == i_invokespecial ||
+                instruction == i_invokevirtual_cached ||
+                instruction == i_invokeinterface_cached || instruction == i_invokenative ||
+                instruction == i_invokenative_virtual || instruction == i_invokelibrary ||
+                (is_branch(instruction) && branch_offset(code->code, pc) <= 0);
+            if (depths[pc] < 0 || !safepoint) {
+                continue;
+            }
+            stack_effect_t effect;
+            get_stack_effect(code->code, pc, class, &effect);
+            u1 *references = &code->reference_maps[code->stack_map_count * map_bytes];
+            u2 stack_depth = depths[pc] - effect.pops;
+            for (size_t slot = 0; slot < code->max_locals + stack_depth; slot++) {
+                references[slot / 8] |= types[pc * slots + slot] << (slot % 8);
+            }
+            code->stack_maps[code->stack_map_count++] =
+                (stack_map_t){.pc = pc, .stack_depth = stack_depth, .references = references};
+        }
+        // Only a few instructions are safepoints, so the maps are shrunk to fit
+        code->stack_maps =
+            realloc(code->stack_maps, sizeof(stack_map_t[code->stack_map_count]));
+        code->reference_maps = realloc(code->reference_maps, code->stack_map_count * map_bytes);
+        assert(code->stack_maps != NULL && code->reference_maps != NULL &&
+               "Failed to allocate stack maps");
+        for (u2 i = 0; i < code->stack_map_count; i++) {
+            code->stack_maps[i].references = &code->reference_maps[i * map_bytes];
+        }
+        stats_add_bytes(MEM_STACK_MAPS,
+                        code->stack_map_count * (sizeof(stack_map_t) + map_bytes));
+    }
+
+    free(queued);
+    free(worklist);
+    free(state);
+    free(types);
+    free(depths);
+    return supported;
+}
+
+void compute_stack_maps(class_file_t *class) {
+    for (method_t *method = class->methods; method->name != NULL; method++) {
+        if (method->code.code_length > 0) {
+            compute_method_stack_maps(method, class);
+        }
+    }
+}
+
+const stack_map_t *find_stack_map(const code_t *code, u4 pc) {
+    stack_map_t key = {.pc = pc};
+    return bsearch(&key, code->stack_maps, code->stack_map_count, sizeof(stack_map_t),
+                   compare_stack_maps);
+}
@@ -0,0 +1,50 @@
+#ifndef STACK_MAP_H
+#define STACK_MAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "class_file.h"
+
+/**
+ * Computes the stack maps of every method in a class: the operand stack
+ * depth at each safepoint (method entry, backward branches and calls) and
+ * which local variables and stack slots hold references there, which lets
+ * frames stopped at a safepoint be walked precisely. References are told
+ * apart from ints by following the types of values through the code.
+ * Methods using instructions TeenyJVM cannot execute get no stack maps.
+ *
+ * @param class the parsed class file
+ */
+void compute_stack_maps(class_file_t *class);
+
+/**
+ * Finds the stack map for a safepoint.
+ *
+ * @param code the code of the method
+ * @param pc the bytecode offset of the safepoint
+ * @return the stack map, or NULL if `pc` is not a safepoint
+ */
+const stack_map_t *find_stack_map(const code_t *code, u4 pc);
+
+/**
+ * Gets the number of bytes of each reference bitmap of a method's stack maps,
+ * which is at least 1
+ */
+static inline size_t reference_map_bytes(const code_t *code) {
+    return (code->max_locals + code->max_stack) / 8 + 1;
+}
+
+/**
+ * Checks whether a slot of a frame stopped at a safepoint holds a reference.
+ * A reference may also be null; other slots hold ints, floats, doubles or
+ * values that are no longer used.
+ *
+ * @param stack_map the stack map of the safepoint
+ * @param slot a local variable index, or max_locals + the index of an operand stack slot
+ */
+static inline bool stack_map_is_reference(const stack_map_t *stack_map, size_t slot) {
+    return (stack_map->references[slot / 8] >> (slot % 8) & 1) != 0;
+}
+
+#endif /* STACK_MAP_H */
@@ -0,0 +1,93 @@
+#include "stats.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <time.h>
+
+bool stats_enabled = false;
+size_t stats_bytes[NUM_SUBSYSTEMS];
+size_t stats_stripped_methods;
+size_t stats_stripped_bytes;
+uint64_t stats_dispatches[NUM_DISPATCHES];
+
+/** Total nanoseconds spent in each phase */
+static uint64_t phase_ns[NUM_PHASES];
+/** When each phase was last entered */
+static uint64_t phase_start_ns[NUM_PHASES];
+
+static const char *const PHASE_NAMES[NUM_PHASES] = {
+    [PHASE_PARSE] = "parse",
+    [PHASE_LINK] = "link",
+    [PHASE_ANALYZE] = "analyze",
+    [PHASE_METHOD_LOOKUP] = "method lookup",
+    [PHASE_EXECUTE] = "execute",
+    [PHASE_OUTPUT_FLUSH] = "output flush",
+    [PHASE_FREE] = "free",
+};
+
+static const char *const SUBSYSTEM_NAMES[NUM_SUBSYSTEMS] = {
+    [MEM_CONSTANT_POOL] = "constant pool",
+    [MEM_METHOD_BODIES] = "method bodies",
+    [MEM_HEAP_ARRAYS] = "heap arrays",
+    [MEM_HANDLE_TABLE] = "handle table",
+    [MEM_CODE_CACHE] = "code cache",
+    [MEM_STACK_MAPS] = "stack maps",
+};
+
+static const char *const DISPATCH_NAMES[NUM_DISPATCHES] = {
+    [DISPATCH_MONOMORPHIC_HIT] = "monomorphic hit",
+    [DISPATCH_POLYMORPHIC_HIT] = "polymorphic hit",
+    [DISPATCH_MISS] = "miss",
+    [DISPATCH_MEGAMORPHIC] = "megamorphic",
+};
+
+static uint64_t now_ns(void) {
+    struct timespec time;
+    int error = clock_gettime(CLOCK_MONOTONIC, &time);
+    assert(error == 0 && "Failed to read monotonic clock");
+    return (uint64_t) time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+void stats_phase_begin(stats_phase_t phase) {
+    if (stats_enabled) {
+        phase_start_ns[phase] = now_ns();
+    }
+}
+
+void stats_phase_end(stats_phase_t phase) {
+    if (stats_enabled) {
+        phase_ns[phase] += now_ns() - phase_start_ns[phase];
+    }
+}
+
+void stats_print(FILE *out) {
+    uint64_t total_ns = 0;
+    fprintf(out, "%-16s %12s\n", "phase", "time (ms)");
+    for (stats_phase_t phase = 0; phase < NUM_PHASES; phase++) {
+        fprintf(out, "%-16s %12.3f\n", PHASE_NAMES[phase], phase_ns[phase] / 1e6);
+        total_ns += phase_ns[phase];
+    }
+    fprintf(out, "%-16s %12.3f\n", "total", total_ns / 1e6);
+
+    size_t total_bytes = 0;
+    fprintf(out, "%-16s %12s\n", "subsystem", "bytes");
+    for (stats_subsystem_t subsystem = 0; subsystem < NUM_SUBSYSTEMS; subsystem++) {
+        fprintf(out, "%-16s %12zu\n", SUBSYSTEM_NAMES[subsystem], stats_bytes[subsystem]);
+        total_bytes += stats_bytes[subsystem];
+    }
+    fprintf(out, "%-16s %12zu\n", "total", total_bytes);
+    fprintf(out, "%-16s %12zu\n", "stripped methods", stats_stripped_methods);
+    fprintf(out, "%-16s %12zu\n", "stripped bytes", stats_stripped_bytes);
+
+    uint64_t total_calls = 0;
+    fprintf(out, "%-16s %12s\n", "virtual call", "count");
+    for (stats_dispatch_t outcome = 0; outcome < NUM_DISPATCHES; outcome++) {
+        fprintf(out, "%-16s %12" PRIu64 "\n", DISPATCH_NAMES[outcome],
+                stats_dispatches[outcome]);
+        total_calls += stats_dispatches[outcome];
+    }
+    uint64_t hits =
+        stats_dispatches[DISPATCH_MONOMORPHIC_HIT] + stats_dispatches[DISPATCH_POLYMORPHIC_HIT];
+    fprintf(out, "%-16s %11.1f%%\n", "cache hit rate",
+            total_calls > 0 ? 100.0 * hits / total_calls : 0.0);
+}
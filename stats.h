@@ -0,0 +1,110 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * The phases of a VM run that are timed when -Xstats is given.
+ * Add new phases before NUM_PHASES and give them a name in stats.c.
+ */
+typedef enum {
+    PHASE_PARSE,
+    PHASE_LINK,
+    PHASE_ANALYZE,
+    PHASE_METHOD_LOOKUP,
+    PHASE_EXECUTE,
+    PHASE_OUTPUT_FLUSH,
+    PHASE_FREE,
+    NUM_PHASES
+} stats_phase_t;
+
+/**
+ * The subsystems whose allocations are counted when -Xstats is given.
+ * Add new subsystems before NUM_SUBSYSTEMS and give them a name in stats.c.
+ */
+typedef enum {
+    MEM_CONSTANT_POOL,
+    MEM_METHOD_BODIES,
+    MEM_HEAP_ARRAYS,
+    MEM_HANDLE_TABLE,
+    MEM_CODE_CACHE,
+    MEM_STACK_MAPS,
+    NUM_SUBSYSTEMS
+} stats_subsystem_t;
+
+/**
+ * The outcomes of virtual calls through inline caches (see dispatch.h).
+ * Add new outcomes before NUM_DISPATCHES and give them a name in stats.c.
+ */
+typedef enum {
+    /** The receiver's class was the first one cached at the call site */
+    DISPATCH_MONOMORPHIC_HIT,
+    /** The receiver's class was another one cached at the call site */
+    DISPATCH_POLYMORPHIC_HIT,
+    /** The receiver's class was added to the call site's cache */
+    DISPATCH_MISS,
+    /** The call site's cache was full, so the vtable was used */
+    DISPATCH_MEGAMORPHIC,
+    NUM_DISPATCHES
+} stats_dispatch_t;
+
+/** Whether statistics should be printed when the VM exits. */
+extern bool stats_enabled;
+
+/**
+ * Starts the monotonic timer for a phase.
+ * A phase may be entered several times; its durations are summed.
+ */
+void stats_phase_begin(stats_phase_t phase);
+
+/**
+ * Stops the timer for a phase started by stats_phase_begin().
+ */
+void stats_phase_end(stats_phase_t phase);
+
+/** The number of bytes allocated by each subsystem */
+extern size_t stats_bytes[NUM_SUBSYSTEMS];
+
+/**
+ * Records that a subsystem allocated some bytes.
+ * This is only an addition, so it is cheap enough to call unconditionally.
+ */
+static inline void stats_add_bytes(stats_subsystem_t subsystem, size_t bytes) {
+    stats_bytes[subsystem] += bytes;
+}
+
+/** The number of methods found unreachable, and the bytes of code freed for them */
+extern size_t stats_stripped_methods;
+extern size_t stats_stripped_bytes;
+
+/**
+ * Records that the code of an unreachable method was freed.
+ */
+static inline void stats_strip_method(size_t bytes) {
+    stats_stripped_methods++;
+    stats_stripped_bytes += bytes;
+}
+
+/** The number of virtual calls with each outcome */
+extern uint64_t stats_dispatches[NUM_DISPATCHES];
+
+/**
+ * Records the outcome of a virtual call. Like stats_add_bytes(),
+ * this is cheap enough to call unconditionally.
+ */
+static inline void stats_count_dispatch(stats_dispatch_t outcome) {
+    stats_dispatches[outcome]++;
+}
+
+/**
+ * Prints the phase timings, the per-subsystem byte counts, the code
+ * stripped from unreachable methods and the outcomes of virtual calls.
+ *
+ * @param out the stream to print to, normally stderr
+ */
+void stats_print(FILE *out);
+
+#endif /* STATS_H */
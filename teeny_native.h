@@ -0,0 +1,29 @@
+#ifndef TEENY_NATIVE_H
+#define TEENY_NATIVE_H
+
+/*
+ * The interface for native methods in shared libraries given to the VM with
+ * -Xnativelib. A Java method declared `native static` in class C is bound to
+ * the library function named C_method (with / and $ in C replaced by _),
+ * which must have the type teeny_native_t.
+ *
+ * Each argument is one teeny_arg_t. int, boolean, char, byte and short
+ * arguments are passed in `i`. int[] arguments are passed in `elements` as a
+ * pointer to the array's storage in the VM heap (NULL for a null array), so
+ * the function can read and write the elements without any copying.
+ * The array's length is stored just before its first element, in elements[-1].
+ */
+
+#include <stdint.h>
+
+typedef union {
+    int32_t i;
+    int32_t *elements;
+} teeny_arg_t;
+
+/**
+ * A native method. The return value is ignored for void methods.
+ */
+typedef int32_t (*teeny_native_t)(const teeny_arg_t *args);
+
+#endif /* TEENY_NATIVE_H */
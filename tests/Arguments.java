@@ -0,0 +1,45 @@
+public class Arguments {
+    static int parseOr(String s, int fallback) {
+        try {
+            return Integer.parseInt(s);
+        } catch (NumberFormatException e) {
+            System.out.println(e.getMessage());
+            return fallback;
+        }
+    }
+
+    static int sum(String[] values) {
+        int total = 0;
+        for (int i = 0; i < values.length; i++) {
+            total += parseOr(values[i], 0);
+        }
+        return total;
+    }
+
+    public static void main(String[] args) {
+        // make test passes no arguments
+        System.out.println(args.length);
+        System.out.println(sum(args));
+        for (int i = 0; i < args.length; i++) {
+            System.out.println(args[i]);
+        }
+
+        String[] valid = {"0", "7", "-45", "+12", "0012", "2147483647", "-2147483648"};
+        for (int i = 0; i < valid.length; i++) {
+            System.out.println(Integer.parseInt(valid[i]));
+        }
+        System.out.println(sum(valid));
+
+        String[] invalid = {"", "-", "+", "12a", " 1", "1.5", "2147483648", "-2147483649"};
+        for (int i = 0; i < invalid.length; i++) {
+            System.out.println(parseOr(invalid[i], -1));
+        }
+        System.out.println(sum(invalid));
+
+        try {
+            System.out.println(Integer.parseInt("99999999999"));
+        } catch (IllegalArgumentException e) {
+            System.out.println("caught as IllegalArgumentException");
+        }
+    }
+}
@@ -0,0 +1,90 @@
+public class ArrayLiterals {
+    static int sum(int[] values) {
+        int total = 0;
+        for (int i = 0; i < values.length; i++) {
+            total += values[i];
+        }
+        return total;
+    }
+
+    static void print(int[] values) {
+        for (int i = 0; i < values.length; i++) {
+            System.out.println(values[i]);
+        }
+    }
+
+    static int[] choose(boolean flag, int middle) {
+        // Only the elements before the branch are constant
+        return new int[] {1, 2, flag ? 3 : 4, 5, middle, -6};
+    }
+
+    public static void main(String[] args) {
+        int[] small = {5, 1, 6, 2, 3, 4};
+        print(small);
+        int[] negative = {-1, -128, -129, -32768, -32769, 0};
+        print(negative);
+
+        int[] large = {
+            -1000, 910, 817, 724, 631, 538, 445, 352, 259, 166, 73, -20,
+            -113, -206, -299, -392, -485, 123456789, -671, -764, -857, -950, 960, 867,
+            774, 681, 588, 495, 402, 309, 216, 123, 30, -63, -156, -249,
+            -342, -435, -528, -621, -714, -807, -900, -993, 917, 824, 731, 638,
+            545, 452, 359, 266, 173, 80, -13, -106, -199, -292, -385, -478,
+            -571, -664, -757, -850, -2147483648, 967, 874, 781, 688, 595, 502, 409,
+            316, 223, 130, 37, -56, -149, -242, -335, -428, -521, -614, -707,
+            -800, -893, -986, 924, 831, 738, 645, 552, 459, 366, 273, 180,
+            87, -6, -99, 2147483647, -285, -378, -471, -564, -657, -750, -843, -936,
+            974, 881, 788, 695, 602, 509, 416, 323, 230, 137, 44, -49
+        };
+        System.out.println(large.length);
+        System.out.println(sum(large));
+        System.out.println(large[17]);
+        System.out.println(large[64]);
+        System.out.println(large[99]);
+        System.out.println(large[119]);
+
+        print(choose(true, 10));
+        print(choose(false, 20));
+        boolean flag = args.length == 0;
+        int[] mixed = {1, 2, flag ? 3 : 4, 5};
+        print(mixed);
+
+        // Each execution of a literal creates a new array
+        int total = 0;
+        for (int i = 0; i < 5; i++) {
+            int[] fresh = {10, 20, 30};
+            total += sum(fresh);
+            fresh[i % 3] = 1000;
+            total += sum(fresh);
+        }
+        System.out.println(total);
+
+        float[] floats = {0f, 1f, 2f, 0.5f, -3.25f, 1e10f};
+        for (int i = 0; i < floats.length; i++) {
+            System.out.println(floats[i]);
+        }
+        double[] doubles = {0, 1, 2.5, -1e300, 0.1, 4};
+        double dsum = 0;
+        for (int i = 0; i < doubles.length; i++) {
+            System.out.println(doubles[i]);
+            dsum += doubles[i];
+        }
+        System.out.println(dsum);
+
+        int[][] nested = {{1, 2}, {3, 4, 5}, {}};
+        System.out.println(nested.length);
+        System.out.println(sum(nested[1]));
+        System.out.println(nested[2].length);
+        String[] words = {"one", "two", "three"};
+        System.out.println(words[2]);
+
+        int[] guarded = {7, 8, 9};
+        try {
+            int[] inside = {11, 12, 13};
+            System.out.println(inside[guarded.length]);
+        } catch (ArrayIndexOutOfBoundsException e) {
+            System.out.println(e.getMessage());
+        }
+        System.out.println(sum(guarded));
+    }
+}
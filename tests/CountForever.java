@@ -0,0 +1,7 @@
+public class CountForever {
+    public static void main(String[] args) {
+        for (int i = 0; ; i++) {
+            System.out.println(i);
+        }
+    }
+}
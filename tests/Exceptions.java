@@ -0,0 +1,183 @@
+public class Exceptions {
+    static class Failure extends Exception {
+        int code;
+
+        Failure(String message, int code) {
+            super(message);
+            this.code = code;
+        }
+    }
+
+    static class Conflict extends IllegalStateException {
+        Conflict(String message) {
+            super(message);
+        }
+    }
+
+    static class Described extends RuntimeException {
+        Described(String message) {
+            super(message);
+        }
+
+        public String getMessage() {
+            return "described";
+        }
+    }
+
+    static class Wrapped extends RuntimeException {
+        Wrapped(String message) {
+            super(message);
+        }
+
+        public String getMessage() {
+            return "wrapped " + super.getMessage();
+        }
+    }
+
+    static int divide(int a, int b) {
+        return a / b;
+    }
+
+    static int safeDivide(int a, int b) {
+        try {
+            return divide(a, b);
+        } catch (ArithmeticException e) {
+            return 0;
+        }
+    }
+
+    static int descend(int depth) throws Failure {
+        if (depth == 0) {
+            throw new Failure("bottom", 7);
+        }
+        try {
+            return descend(depth - 1) + 1;
+        } finally {
+            System.out.println(depth);
+        }
+    }
+
+    static int returnThroughFinally(int x) {
+        try {
+            if (x > 0) {
+                return x * 2;
+            }
+        } finally {
+            System.out.println("finally");
+        }
+        return -1;
+    }
+
+    static int rethrow(int[] values, int index) {
+        try {
+            return values[index];
+        } catch (ArrayIndexOutOfBoundsException e) {
+            throw new Conflict(e.getMessage());
+        }
+    }
+
+    public static void main(String[] args) {
+        // Propagation through several frames, running each frame's finally
+        try {
+            descend(3);
+            System.out.println("unreachable");
+        } catch (Failure e) {
+            System.out.println(e.getMessage());
+            System.out.println(e.code);
+        }
+
+        System.out.println(returnThroughFinally(5));
+        System.out.println(returnThroughFinally(-5));
+
+        int[] values = {4, 5, 6};
+        try {
+            System.out.println(rethrow(values, 1));
+            System.out.println(rethrow(values, 3));
+            System.out.println("unreachable");
+        } catch (IllegalStateException e) {
+            System.out.println(e.getMessage());
+        }
+
+        int total = 0;
+        for (int i = -3; i <= 3; i++) {
+            total = total * 3 + safeDivide(100, i);
+        }
+        System.out.println(total);
+
+        // Handlers are chosen by class, in order, on every iteration
+        int caught = 0;
+        for (int i = 0; i < 20; i++) {
+            try {
+                if (i % 3 == 0) {
+                    throw new Conflict("three");
+                }
+                if (i % 5 == 0) {
+                    throw new Failure("five", i);
+                }
+                caught += 1;
+            } catch (Failure e) {
+                caught += e.code * 100;
+            } catch (RuntimeException e) {
+                caught += 1000;
+            } finally {
+                caught += 10000;
+            }
+        }
+        System.out.println(caught);
+
+        for (int i = 0; i < 3; i++) {
+            try {
+                if (i == 0) {
+                    System.out.println(divide(1, 0));
+                }
+                if (i == 1) {
+                    System.out.println(values[-1]);
+                }
+                System.out.println("none");
+            } catch (ArithmeticException | ArrayIndexOutOfBoundsException e) {
+                System.out.println(e.getMessage());
+            }
+        }
+
+        try {
+            try {
+                throw new Conflict("inner");
+            } finally {
+                System.out.println("inner finally");
+            }
+        } catch (Conflict e) {
+            System.out.println(e.getMessage());
+        }
+
+        // getMessage() dispatches to overrides, also through a Throwable
+        Throwable[] thrown = {new Described("unused"), new Wrapped("cause"), new Conflict("plain")};
+        for (int i = 0; i < thrown.length; i++) {
+            System.out.println(thrown[i].getMessage());
+        }
+        try {
+            throw new Wrapped("thrown");
+        } catch (RuntimeException e) {
+            System.out.println(e.getMessage());
+        }
+
+        // Exceptions thrown by the VM itself
+        int[] missing = null;
+        try {
+            System.out.println(missing.length);
+        } catch (NullPointerException e) {
+            System.out.println("null array");
+        }
+        Throwable none = null;
+        try {
+            System.out.println(none.getMessage());
+        } catch (NullPointerException e) {
+            System.out.println("null throwable");
+        }
+        try {
+            int[] negative = new int[args.length - 1];
+            System.out.println(negative.length);
+        } catch (NegativeArraySizeException e) {
+            System.out.println(e.getMessage());
+        }
+    }
+}
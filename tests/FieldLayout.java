@@ -0,0 +1,96 @@
+public class FieldLayout {
+    static class Flag {
+        boolean set;
+    }
+
+    static class Sample extends Flag {
+        byte tag;
+        char mark;
+        double weight;
+        short level;
+        int count;
+        float ratio;
+        Sample next;
+        String name;
+    }
+
+    static class Extended extends Sample {
+        byte extra;
+        double more;
+    }
+
+    static class Point {
+        int x;
+        int y;
+
+        Point(int x, int y) {
+            this.x = x;
+            this.y = y;
+        }
+    }
+
+    public static void main(String[] args) {
+        Sample a = new Sample();
+        printSample(a);
+
+        a.set = true;
+        a.tag = -7;
+        a.mark = 'Q';
+        a.weight = 0.25;
+        a.level = -300;
+        a.count = 100000;
+        a.ratio = 1.5f;
+        a.name = "first";
+        Sample b = new Sample();
+        b.tag = 127;
+        b.mark = 'z';
+        b.weight = -2.5;
+        b.level = 32767;
+        b.count = -1;
+        b.name = "second";
+        a.next = b;
+        printSample(a);
+        printSample(a.next);
+
+        a.count += a.next.count;
+        a.weight *= 4;
+        System.out.println(a.count);
+        System.out.println(a.weight);
+
+        Extended e = new Extended();
+        e.set = true;
+        e.tag = -128;
+        e.mark = 'e';
+        e.weight = 3.75;
+        e.level = -32768;
+        e.count = 2147483647;
+        e.ratio = -0.5f;
+        e.next = a;
+        e.name = "extended";
+        e.extra = 99;
+        e.more = 1e-3;
+        printSample(e);
+        System.out.println(e.extra);
+        System.out.println(e.more);
+        System.out.println(e.next.next.name);
+
+        int sum = 0;
+        for (int i = 0; i < 10; i++) {
+            Point p = new Point(i, i * i);
+            sum += p.x + p.y;
+        }
+        System.out.println(sum);
+    }
+
+    public static void printSample(Sample s) {
+        System.out.println(s.set);
+        System.out.println(s.tag);
+        System.out.println((int) s.mark);
+        System.out.println(s.weight);
+        System.out.println(s.level);
+        System.out.println(s.count);
+        System.out.println(s.ratio);
+        System.out.println(s.next == null);
+        System.out.println(s.name);
+    }
+}
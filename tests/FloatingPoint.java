@@ -0,0 +1,112 @@
+public class FloatingPoint {
+    static double hypot(double a, double b) {
+        return Math.sqrt(a * a + b * b);
+    }
+
+    static double polynomial(double x) {
+        return ((2.5 * x - 1.0) * x + 0.25) * x - 3.0;
+    }
+
+    static float average(float[] values) {
+        float sum = 0;
+        for (int i = 0; i < values.length; i++) {
+            sum += values[i];
+        }
+        return sum / values.length;
+    }
+
+    public static void main(String[] args) {
+        double a = 0.1;
+        double b = 0.2;
+        double one = 1;
+        double zero = 0;
+        System.out.println(a + b);
+        System.out.println(a * 3);
+        System.out.println(b - a);
+        System.out.println(-a);
+        System.out.println(one / 3);
+        System.out.println(a / 100);
+        System.out.println(a / 1000);
+        System.out.println(-zero);
+        System.out.println(one / zero);
+        System.out.println(-one / zero);
+        System.out.println(zero / zero);
+
+        double big = 1e7;
+        System.out.println(big);
+        System.out.println(big - 1);
+        System.out.println(big * 12.345678);
+        System.out.println(big * big * big * big * big * big * big);
+        System.out.println(big * big * big * big * big * big * 1e300);
+        double tiny = 1e-300;
+        System.out.println(tiny / big / 1000);
+        System.out.println(tiny * tiny);
+
+        System.out.println(hypot(3, 4));
+        System.out.println(hypot(1, 1));
+        System.out.println(Math.abs(-2.75));
+        System.out.println(Math.abs(zero - a));
+        System.out.println(polynomial(1.5));
+        System.out.println(polynomial(-0.25));
+
+        float f = 1.1f;
+        System.out.println(f);
+        System.out.println(f * 3);
+        System.out.println(f / 3);
+        System.out.println(-f);
+        System.out.println((double) f);
+        System.out.println((float) a);
+        System.out.println((float) (big * big * big * big * big * big));
+        float fsum = 0;
+        for (int i = 0; i < 1000; i++) {
+            fsum += 0.1f;
+        }
+        System.out.println(fsum);
+        float[] values = {1.5f, 2.25f, -0.75f, 4f};
+        System.out.println(average(values));
+
+        // Conversions between ints and floating point
+        int n = 7;
+        System.out.println(n / 2.0);
+        System.out.println(n * 0.5f);
+        System.out.println((int) (a * 39.9));
+        System.out.println((int) (-a * 25));
+        System.out.println((int) (big * big));
+        System.out.println((int) (-big * big));
+        System.out.println((int) (zero / zero));
+        System.out.println((int) (f * 10));
+        System.out.println((double) Integer.MIN_VALUE * n);
+
+        // Comparisons, including with NaN
+        double nan = zero / zero;
+        System.out.println(a < b);
+        System.out.println(a >= b);
+        System.out.println(a * 2 == b);
+        System.out.println(a * 3 == 0.3);
+        System.out.println(nan == nan);
+        System.out.println(nan != nan);
+        System.out.println(nan < one);
+        System.out.println(nan > one);
+        System.out.println(-zero == zero);
+        float fnan = (float) nan;
+        System.out.println(fnan < f);
+        System.out.println(fnan >= f);
+        System.out.println(f > 1);
+        System.out.println(f <= 1.1f);
+
+        System.out.println(7.5 * one % 2);
+        System.out.println(-7.5 * one % 2);
+        System.out.println(f % 0.5f);
+
+        double[] series = new double[10];
+        for (int i = 0; i < series.length; i++) {
+            series[i] = one / (i + 1);
+        }
+        double harmonic = 0;
+        for (int i = 0; i < series.length; i++) {
+            harmonic += series[i];
+        }
+        System.out.println(harmonic);
+        System.out.println(series[2]);
+    }
+}
@@ -0,0 +1,126 @@
+public class InterfaceDispatch {
+    interface Named {
+        int id();
+
+        default int tag() {
+            return id() + 1000;
+        }
+    }
+
+    interface Measured {
+        int size();
+    }
+
+    interface Shape extends Named {
+        int area();
+    }
+
+    static class Square implements Shape, Measured {
+        int side;
+
+        Square(int side) {
+            this.side = side;
+        }
+
+        public int area() {
+            return side * side;
+        }
+
+        public int id() {
+            return 1;
+        }
+
+        public int size() {
+            return 4 * side;
+        }
+    }
+
+    static class Rectangle implements Shape {
+        public int area() {
+            return 12;
+        }
+
+        public int id() {
+            return 2;
+        }
+
+        public int tag() {
+            return 5;
+        }
+    }
+
+    // Implements Shape without implementing area()
+    static abstract class Base implements Shape {
+        public int id() {
+            return 3;
+        }
+    }
+
+    static class Circle extends Base implements Measured {
+        public int area() {
+            return 300;
+        }
+
+        public int size() {
+            return 60;
+        }
+    }
+
+    static class Counter implements Measured, Named {
+        int count;
+
+        public int size() {
+            count++;
+            return count;
+        }
+
+        public int id() {
+            return 40 + count;
+        }
+    }
+
+    static Shape pick(int i) {
+        if (i == 0) {
+            return new Square(3);
+        }
+        if (i == 1) {
+            return new Rectangle();
+        }
+        return new Circle();
+    }
+
+    static int sumSizes(Measured[] items) {
+        int sum = 0;
+        for (int i = 0; i < items.length; i++) {
+            sum += items[i].size();
+        }
+        return sum;
+    }
+
+    public static void main(String[] args) {
+        int sum = 0;
+        for (int i = 0; i < 30; i++) {
+            Shape shape = pick(i % 3);
+            sum += shape.area();
+            sum += shape.tag();
+            sum += shape.id();
+        }
+        System.out.println(sum);
+
+        Square square = new Square(4);
+        System.out.println(square.tag());
+        Named named = square;
+        System.out.println(named.tag());
+
+        // Classes implementing the same interface at different positions
+        Counter counter = new Counter();
+        Measured[] items = {new Square(2), counter, new Circle(), counter, new Square(5)};
+        System.out.println(sumSizes(items));
+        System.out.println(sumSizes(items));
+        Named[] names = {square, counter, new Circle(), new Rectangle()};
+        for (int i = 0; i < names.length; i++) {
+            System.out.println(names[i].id());
+            System.out.println(names[i].tag());
+        }
+    }
+}
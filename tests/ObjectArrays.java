@@ -0,0 +1,120 @@
+public class ObjectArrays {
+    static class Node {
+        int value;
+        Node next;
+
+        Node(int value, Node next) {
+            this.value = value;
+            this.next = next;
+        }
+    }
+
+    static int sum(int[][] grid) {
+        int total = 0;
+        for (int i = 0; i < grid.length; i++) {
+            for (int j = 0; j < grid[i].length; j++) {
+                total += grid[i][j];
+            }
+        }
+        return total;
+    }
+
+    public static void main(String[] args) {
+        String[] words = new String[4];
+        words[0] = "alpha";
+        words[2] = "gamma";
+        for (int i = 0; i < words.length; i++) {
+            if (words[i] == null) {
+                System.out.println("null");
+            } else {
+                System.out.println(words[i]);
+            }
+        }
+
+        Node[] nodes = new Node[5];
+        for (int i = 0; i < nodes.length; i++) {
+            nodes[i] = new Node(i * i, i > 0 ? nodes[i - 1] : null);
+        }
+        int total = 0;
+        for (Node node = nodes[4]; node != null; node = node.next) {
+            total += node.value;
+        }
+        System.out.println(total);
+        nodes[2] = null;
+        System.out.println(nodes[3].next.next.value);
+
+        int[][] grid = new int[3][4];
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 4; j++) {
+                grid[i][j] = i * 10 + j;
+            }
+        }
+        System.out.println(sum(grid));
+        System.out.println(grid.length);
+        System.out.println(grid[1].length);
+        grid[1] = new int[] {7, 8};
+        System.out.println(sum(grid));
+        System.out.println(grid[2][3]);
+
+        int[][] ragged = new int[4][];
+        System.out.println(ragged[2] == null);
+        for (int i = 0; i < ragged.length; i++) {
+            ragged[i] = new int[i + 1];
+            for (int j = 0; j <= i; j++) {
+                ragged[i][j] = i + j;
+            }
+        }
+        System.out.println(sum(ragged));
+
+        int[][][] cube = new int[2][3][4];
+        cube[1][2][3] = 5;
+        cube[0][0][0] = 1;
+        int elements = 0;
+        int cubeSum = 0;
+        for (int i = 0; i < cube.length; i++) {
+            for (int j = 0; j < cube[i].length; j++) {
+                elements += cube[i][j].length;
+                cubeSum += sum(cube[i]);
+            }
+        }
+        System.out.println(elements);
+        System.out.println(cubeSum);
+        int[][][] partial = new int[2][3][];
+        System.out.println(partial[1][2] == null);
+
+        double[][] matrix = new double[2][2];
+        matrix[0][0] = 1.5;
+        matrix[1][1] = 2.25;
+        System.out.println(matrix[0][0] + matrix[1][1] + matrix[0][1]);
+
+        String[][] table = new String[2][3];
+        table[1][2] = "corner";
+        System.out.println(table[1][2]);
+        System.out.println(table[0][0] == null);
+
+        Object[] objects = {"text", nodes[0], grid};
+        System.out.println(objects.length);
+        System.out.println(objects[1] == nodes[0]);
+        System.out.println(objects[2] == nodes[0]);
+
+        int[][] empty = new int[0][5];
+        System.out.println(empty.length);
+        try {
+            int[][] negative = new int[2][-3];
+            System.out.println(negative.length);
+        } catch (NegativeArraySizeException e) {
+            System.out.println(e.getMessage());
+        }
+        try {
+            System.out.println(words[4]);
+        } catch (ArrayIndexOutOfBoundsException e) {
+            System.out.println(e.getMessage());
+        }
+        Node[] holes = new Node[2];
+        try {
+            System.out.println(holes[1].value);
+        } catch (NullPointerException e) {
+            System.out.println("null element");
+        }
+    }
+}
@@ -0,0 +1,51 @@
+import java.util.InputMismatchException;
+import teeny.Stdin;
+
+public class ReadInput {
+    public static void main(String[] args) {
+        // Ints separated by any whitespace, up to the ends of the int range
+        int count = Stdin.readInt();
+        for (int i = 0; i < count; i++) {
+            System.out.println(Stdin.readInt());
+        }
+
+        // Tokens that are not ints, or are out of range, are skipped
+        for (int i = 0; i < 6; i++) {
+            try {
+                System.out.println(Stdin.readInt());
+            } catch (InputMismatchException e) {
+                System.out.println("mismatch");
+            }
+        }
+
+        int[] values = new int[4];
+        System.out.println(Stdin.readInts(values));
+        for (int i = 0; i < values.length; i++) {
+            System.out.println(values[i]);
+        }
+        try {
+            System.out.println(Stdin.readInts(values));
+        } catch (InputMismatchException e) {
+            System.out.println("mismatch");
+        }
+        try {
+            System.out.println(Stdin.readInts(null));
+        } catch (NullPointerException e) {
+            System.out.println("null ints");
+        }
+        try {
+            System.out.println(Stdin.readLine(null));
+        } catch (NullPointerException e) {
+            System.out.println("null line");
+        }
+
+        // The rest of the last int's line, then lines split at the array's size
+        char[] line = new char[8];
+        int length = Stdin.readLine(line);
+        while (length >= 0) {
+            System.out.println(length);
+            length = Stdin.readLine(line);
+        }
+        System.out.println(Stdin.readInt());
+    }
+}
@@ -0,0 +1,21 @@
+public class SieveBenchmark {
+    public static void main(String[] args) {
+        // count the primes below 10^8, striding through a 400 MB array
+        int num = 100000000;
+
+        int[] composite = new int[num];
+        int count = 0;
+        for (int i = 2; i < num; i++) {
+            if (composite[i] == 0) {
+                count++;
+                // i * i would overflow for large i
+                if (i <= num / i) {
+                    for (int j = i * i; j < num; j = j + i) {
+                        composite[j] = 1;
+                    }
+                }
+            }
+        }
+        System.out.println(count);
+    }
+}
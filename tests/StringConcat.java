@@ -0,0 +1,80 @@
+public class StringConcat {
+    static String describe(String name, int value, boolean flag, char mark) {
+        return name + "=" + value + " (" + flag + ", " + mark + ")";
+    }
+
+    static String join(int[] values) {
+        StringBuilder builder = new StringBuilder("[");
+        for (int i = 0; i < values.length; i++) {
+            if (i > 0) {
+                builder.append(", ");
+            }
+            builder.append(values[i]);
+        }
+        return builder.append(']').toString();
+    }
+
+    public static void main(String[] args) {
+        int x = 42;
+        int y = -300;
+        System.out.println("x=" + x + ", y=" + y);
+        System.out.println(x + y + " is the sum, not " + x + y);
+        System.out.println(describe("count", 0, true, 'c'));
+        System.out.println(describe("min", Integer.MIN_VALUE, false, '-'));
+        System.out.println(describe("max", Integer.MAX_VALUE, x > y, 'M'));
+
+        String missing = null;
+        System.out.println("value: " + missing);
+        System.out.println(missing + missing);
+        String empty = "";
+        System.out.println(empty + empty + "|");
+        System.out.println('a' + "" + 'b');
+
+        // Concatenation with two-byte chars
+        String euro = "\u20ac" + x;
+        System.out.println(euro.length());
+        System.out.println((int) euro.charAt(0));
+        System.out.println(euro.charAt(1));
+        char accent = '\u00e9';
+        String mixed = "caf" + accent + "!";
+        System.out.println(mixed.length());
+        System.out.println((int) mixed.charAt(3));
+
+        String numbers = "";
+        for (int i = 0; i < 200; i++) {
+            numbers = numbers + i + ",";
+        }
+        System.out.println(numbers.length());
+        System.out.println(numbers.charAt(numbers.length() - 2));
+        String repeated = "";
+        for (int i = 0; i < 10; i++) {
+            repeated += "ab";
+        }
+        System.out.println(repeated);
+
+        System.out.println(join(new int[] {3, -1, 4, 1, -5}));
+        System.out.println(join(new int[0]));
+        StringBuilder builder = new StringBuilder();
+        for (int i = 0; i < 20; i++) {
+            builder.append(i).append(',');
+        }
+        String built = builder.toString();
+        System.out.println(built);
+        System.out.println(built.length());
+        builder.append(true).append("end");
+        System.out.println(builder.toString());
+        System.out.println(built.length());
+        System.out.println(new StringBuilder().toString().length());
+        StringBuilder none = null;
+        try {
+            none.append(1);
+        } catch (NullPointerException e) {
+            System.out.println("null append");
+        }
+        try {
+            System.out.println(none.toString());
+        } catch (NullPointerException e) {
+            System.out.println("null toString");
+        }
+    }
+}
@@ -0,0 +1,78 @@
+public class Strings {
+    static class Other {
+        static String greeting() {
+            return "hello";
+        }
+    }
+
+    static String greeting() {
+        return "hello";
+    }
+
+    static int count(String s, char c) {
+        int count = 0;
+        for (int i = 0; i < s.length(); i++) {
+            if (s.charAt(i) == c) {
+                count++;
+            }
+        }
+        return count;
+    }
+
+    public static void main(String[] args) {
+        String hello = "Hello, world";
+        System.out.println(hello);
+        System.out.println(hello.length());
+        System.out.println(hello.charAt(7));
+        System.out.println(count(hello, 'o'));
+        System.out.print("no newline");
+        System.out.println(", then a newline");
+        System.out.println("tab\tand \"quotes\" and \\");
+        System.out.println("");
+        System.out.println("".length());
+        String missing = null;
+        System.out.println(missing);
+
+        // Strings that do not fit in Latin-1 are stored with two bytes per char
+        String latin = "caf\u00e9";
+        System.out.println(latin.length());
+        System.out.println((int) latin.charAt(3));
+        String wide = "\u20ac and \ud834\udd1e";
+        System.out.println(wide.length());
+        for (int i = 0; i < wide.length(); i++) {
+            System.out.println((int) wide.charAt(i));
+        }
+        System.out.println(count(wide, ' '));
+
+        // Equal constants are the same object, even across classes
+        System.out.println(hello == "Hello, world");
+        System.out.println(greeting() == Other.greeting());
+        System.out.println(greeting() == "hello");
+        System.out.println(greeting() == hello);
+        int same = 0;
+        for (int i = 0; i < 100; i++) {
+            if (greeting() == "hello") {
+                same++;
+            }
+        }
+        System.out.println(same);
+        for (int i = 0; i < 3; i++) {
+            System.out.println("loop");
+        }
+        try {
+            System.out.println(hello.charAt(hello.length()));
+        } catch (IndexOutOfBoundsException e) {
+            System.out.println("out of bounds");
+        }
+        try {
+            System.out.println(missing.length());
+        } catch (NullPointerException e) {
+            System.out.println("null length");
+        }
+        try {
+            System.out.println(count(missing, 'x'));
+        } catch (NullPointerException e) {
+            System.out.println("null count");
+        }
+    }
+}
@@ -0,0 +1,197 @@
+public class Unrolling {
+    static int sumTo(int n) {
+        int sum = 0;
+        for (int i = 0; i < n; i++) {
+            sum += i * i + 1;
+        }
+        return sum;
+    }
+
+    // Each iteration depends on the previous one, so any reordering shows
+    static int stepTwo(int start, int limit) {
+        int sum = 0;
+        for (int i = start; i < limit; i += 2) {
+            sum = sum * 3 + i;
+        }
+        return sum;
+    }
+
+    static int stepThree(int limit) {
+        int sum = 0;
+        for (int i = 1; i < limit; i += 3) {
+            sum = sum * 5 - i;
+        }
+        return sum;
+    }
+
+    // The step is a local, so the loop checks that it is positive before unrolling
+    static int stepBy(int start, int limit, int step) {
+        int sum = 0;
+        for (int i = start; i < limit; i += step) {
+            sum = sum * 3 + i;
+        }
+        return sum;
+    }
+
+    static int countPrimes(int n) {
+        int[] composite = new int[n];
+        int count = 0;
+        for (int i = 2; i < n; i++) {
+            if (composite[i] == 0) {
+                count++;
+                for (int j = i * i; j < n; j += i) {
+                    composite[j] = 1;
+                }
+            }
+        }
+        return count;
+    }
+
+    static int hash(int[] values) {
+        int hash = 0;
+        for (int i = 0; i < values.length; i++) {
+            hash = hash * 31 + values[i];
+        }
+        return hash;
+    }
+
+    static int skipMultiplesOfThree(int n) {
+        int sum = 0;
+        for (int i = 0; i < n; i++) {
+            if (i % 3 == 0) {
+                continue;
+            }
+            sum = sum * 2 + i;
+        }
+        return sum;
+    }
+
+    static int countDown(int n) {
+        int sum = 0;
+        for (int i = n; i > 0; i--) {
+            sum = sum * 7 + i;
+        }
+        return sum;
+    }
+
+    static int countDownByThree(int n) {
+        int sum = 0;
+        for (int i = n; i >= 0; i -= 3) {
+            sum = sum * 11 + i;
+        }
+        return sum;
+    }
+
+    static int shrinkingLimit(int n) {
+        int sum = 0;
+        for (int i = 0; i < n; i++) {
+            sum += i;
+            if (i == 2) {
+                n = 4;
+            }
+        }
+        return sum;
+    }
+
+    static void fill(int[] values, int n) {
+        for (int i = 0; i < n; i++) {
+            values[i] = i * 2 + 1;
+        }
+    }
+
+    public static void main(String[] args) {
+        // Trip counts around an unroll factor of 4, only known when running
+        int[] counts = {0, 1, 2, 3, 4, 5, 7, 8, 9, 16, 17};
+        for (int c = 0; c < counts.length; c++) {
+            int n = counts[c];
+            System.out.println(n);
+            System.out.println(sumTo(n));
+            System.out.println(stepTwo(0, n));
+            System.out.println(stepTwo(-3, n));
+            System.out.println(stepThree(n));
+            System.out.println(stepBy(0, n, 1));
+            System.out.println(stepBy(-2, n, 3));
+            System.out.println(stepBy(1, n, n));
+            System.out.println(hash(new int[n]));
+            int[] values = new int[n];
+            fill(values, n);
+            System.out.println(hash(values));
+            System.out.println(skipMultiplesOfThree(n));
+            System.out.println(countDown(n));
+            System.out.println(countDownByThree(n));
+            System.out.println(shrinkingLimit(n));
+        }
+
+        // Trip counts known when linking
+        int sum = 0;
+        for (int i = 0; i < 0; i++) {
+            sum = sum * 3 + i;
+        }
+        System.out.println(sum);
+        for (int i = 0; i < 1; i++) {
+            sum = sum * 3 + i + 1;
+        }
+        System.out.println(sum);
+        for (int i = 0; i < 3; i++) {
+            sum = sum * 3 + i;
+        }
+        System.out.println(sum);
+        for (int i = 5; i < 9; i++) {
+            sum = sum * 3 + i;
+        }
+        System.out.println(sum);
+        for (int i = -2; i < 3; i++) {
+            sum = sum * 3 + i;
+        }
+        System.out.println(sum);
+        for (int i = 0; i < 9; i += 2) {
+            sum = sum * 3 + i;
+        }
+        System.out.println(sum);
+        for (int i = 10; i < 5; i++) {
+            sum = sum * 3 + i;
+        }
+        System.out.println(sum);
+
+        // A limit too large for sipush is loaded with ldc
+        sum = 0;
+        for (int i = 0; i < 100000; i++) {
+            sum += i;
+        }
+        System.out.println(sum);
+        System.out.println(countPrimes(100));
+        System.out.println(countPrimes(1000));
+
+        // A step that is not positive runs until the counter wraps around
+        System.out.println(stepBy(Integer.MIN_VALUE + 2, Integer.MIN_VALUE + 10, -1));
+        System.out.println(stepBy(Integer.MIN_VALUE, 1, 1 << 29));
+
+        // Counters at the ends of the int range
+        int count = 0;
+        for (int i = Integer.MIN_VALUE; i < Integer.MIN_VALUE + 5; i++) {
+            count = count * 3 + (i - Integer.MIN_VALUE);
+        }
+        System.out.println(count);
+        count = 0;
+        for (int i = Integer.MAX_VALUE - 6; i < Integer.MAX_VALUE; i++) {
+            count = count * 3 + (Integer.MAX_VALUE - i);
+        }
+        System.out.println(count);
+        int high = Integer.MAX_VALUE - 1;
+        count = 0;
+        for (int i = high - 16; i < high; i += 4) {
+            count = count * 3 + (high - i);
+        }
+        System.out.println(count);
+
+        // An exception partway through leaves the earlier iterations' stores
+        int[] partial = new int[6];
+        try {
+            fill(partial, 9);
+        } catch (ArrayIndexOutOfBoundsException e) {
+            System.out.println(e.getMessage());
+        }
+        System.out.println(hash(partial));
+        System.out.println(partial[5]);
+    }
+}
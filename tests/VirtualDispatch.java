@@ -0,0 +1,159 @@
+public class VirtualDispatch {
+    static abstract class Shape {
+        abstract int area();
+
+        int sides() {
+            return 0;
+        }
+
+        int describe() {
+            return area() * 10 + sides();
+        }
+    }
+
+    static class Square extends Shape {
+        int side;
+
+        Square(int side) {
+            this.side = side;
+        }
+
+        int area() {
+            return side * side;
+        }
+
+        int sides() {
+            return 4;
+        }
+    }
+
+    static class Rectangle extends Square {
+        int other;
+
+        Rectangle(int side, int other) {
+            super(side);
+            this.other = other;
+        }
+
+        int area() {
+            return side * other;
+        }
+
+        int describe() {
+            return super.describe() + 1000;
+        }
+    }
+
+    static class Triangle extends Shape {
+        int base;
+        int height;
+
+        Triangle(int base, int height) {
+            this.base = base;
+            this.height = height;
+        }
+
+        int area() {
+            return base * height / 2;
+        }
+
+        int sides() {
+            return 3;
+        }
+    }
+
+    static class Circle extends Shape {
+        int radius;
+
+        Circle(int radius) {
+            this.radius = radius;
+        }
+
+        int area() {
+            return 3 * radius * radius;
+        }
+    }
+
+    static class Hexagon extends Shape {
+        int side;
+
+        Hexagon(int side) {
+            this.side = side;
+        }
+
+        int area() {
+            return 26 * side * side / 10;
+        }
+
+        int sides() {
+            return 6;
+        }
+    }
+
+    static Shape pick(int i) {
+        if (i == 0) {
+            return new Square(3);
+        }
+        if (i == 1) {
+            return new Rectangle(2, 5);
+        }
+        if (i == 2) {
+            return new Triangle(4, 7);
+        }
+        if (i == 3) {
+            return new Circle(2);
+        }
+        if (i == 4) {
+            return new Hexagon(5);
+        }
+        return new Square(i);
+    }
+
+    // One call site seeing `kinds` receiver classes in turn
+    static int sumAreas(int kinds, int count) {
+        int sum = 0;
+        for (int i = 0; i < count; i++) {
+            sum += pick(i % kinds).area();
+        }
+        return sum;
+    }
+
+    static int sumDescriptions(Shape[] shapes, int rounds) {
+        int sum = 0;
+        for (int round = 0; round < rounds; round++) {
+            for (int i = 0; i < shapes.length; i++) {
+                sum += shapes[i].describe();
+            }
+        }
+        return sum;
+    }
+
+    public static void main(String[] args) {
+        // Monomorphic, polymorphic and megamorphic call sites
+        System.out.println(sumAreas(1, 50));
+        System.out.println(sumAreas(2, 50));
+        System.out.println(sumAreas(4, 60));
+        System.out.println(sumAreas(5, 60));
+        System.out.println(sumAreas(8, 80));
+
+        // A site that only ever sees one class, then a new one
+        Shape[] same = {new Square(1), new Square(2), new Square(3)};
+        System.out.println(sumDescriptions(same, 10));
+        same[1] = new Circle(3);
+        System.out.println(sumDescriptions(same, 10));
+
+        Shape[] all = {pick(0), pick(1), pick(2), pick(3), pick(4), pick(6), pick(7)};
+        System.out.println(sumDescriptions(all, 5));
+
+        // Inherited and overridden methods
+        for (int i = 0; i < all.length; i++) {
+            System.out.println(all[i].area());
+            System.out.println(all[i].sides());
+            System.out.println(all[i].describe());
+        }
+        Square square = new Rectangle(3, 4);
+        System.out.println(square.area());
+        System.out.println(square.sides());
+        System.out.println(square.describe());
+    }
+}
@@ -0,0 +1,27 @@
+#!/bin/bash
+# Checks that the output of a VM killed by SIGTERM or SIGINT is flushed once
+# and in order with -Xasyncoutput. The reader only starts after the signal,
+# so the writer thread is stuck with buffers in flight.
+#
+# Usage: tests/signal_output.sh <jvm> <class printing 0, 1, 2, ... forever>
+
+jvm=$1
+class=$2
+output=$(mktemp)
+pid_file=$(mktemp)
+trap 'rm -f "$output" "$pid_file"' EXIT
+
+for signal in TERM INT; do
+    bash -c 'echo $$ > "$0"; exec "$@"' "$pid_file" "$jvm" -Xasyncoutput "$class" |
+        (sleep 1.5; cat > "$output") &
+    pipeline=$!
+    sleep 0.5
+    kill -$signal "$(cat "$pid_file")"
+    wait $pipeline
+    lines=$(wc -l < "$output")
+    if ! awk 'NR - 1 != $0 { exit 1 }' "$output" || [ "$lines" -lt 1000 ]; then
+        echo "FAILED test signal output with SIG$signal: $lines lines"
+        exit 1
+    fi
+done
+echo PASSED test signal output.
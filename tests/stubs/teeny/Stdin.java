@@ -0,0 +1,11 @@
+package teeny;
+
+// Declares the natives the VM implements, so that tests using them compile.
+// The VM reads no class file for teeny.Stdin.
+public class Stdin {
+    public static native int readInt();
+
+    public static native int readInts(int[] values);
+
+    public static native int readLine(char[] line);
+}
@@ -0,0 +1,468 @@
+#include "unroll.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bytecode.h"
+#include "jvm.h"
+#include "stats.h"
+
+/** The most copies of a loop's body that are made */
+#define MAX_UNROLL_FACTOR 4
+/** The most bytes that the copies of a loop's body may occupy together */
+#define MAX_UNROLLED_BYTES 64
+
+bool unroll_log_enabled = false;
+
+/** A counted loop, described by the offsets of its parts in the original bytecode */
+typedef struct {
+    /** The iload of the counter, the target of the backward goto */
+    u4 head;
+    /** The first instruction after the counter's iload, which loads the limit */
+    u4 limit;
+    /** The if_icmpge that leaves the loop */
+    u4 condition;
+    /** The first instruction of the body */
+    u4 body;
+    /** The iinc of the counter, or the iload of the counter that adds the step to it */
+    u4 increment;
+    /** The backward goto */
+    u4 back_branch;
+    /** The instruction after the loop, where the if_icmpge jumps */
+    u4 exit;
+    /** The local variable of the counter */
+    u2 counter;
+    /** The local variable that holds the limit or the array whose length it is, if any */
+    int32_t limit_local;
+    /** The amount the counter is incremented by each iteration, if it is a constant */
+    int8_t step;
+    /** The local variable that holds the step, or -1 if the step is a constant */
+    int32_t step_local;
+} counted_loop_t;
+
+/**
+ * Reads the value pushed by an iconst_<n>, bipush, sipush or ldc of an int.
+ *
+ * @return the length of the instruction, or 0 if it does not push a constant int
+ */
+static u4 pushed_int(const class_file_t *class, const u1 *code, u4 pc, int32_t *value) {
+    if (i_iconst_m1 <= code[pc] && code[pc] <= i_iconst_5) {
+        *value = code[pc] - i_iconst_0;
+        return 1;
+    }
+    if (code[pc] == i_bipush) {
+        *value = (int8_t) code[pc + 1];
+        return 2;
+    }
+    if (code[pc] == i_sipush) {
+        *value = (int16_t) operand_index(code, pc);
+        return 3;
+    }
+    if (code[pc] == i_ldc || code[pc] == i_ldc_w) {
+        u2 index = code[pc] == i_ldc ? code[pc + 1] : operand_index(code, pc);
+        const cp_info *constant = &class->constant_pool[index - 1];
+        if (constant->tag != CONSTANT_Integer) {
+            return 0;
+        }
+        *value = ((const CONSTANT_Integer_info *) constant->info)->bytes;
+        return code[pc] == i_ldc ? 2 : 3;
+    }
+    return 0;
+}
+
+/**
+ * Finds the instruction before another one.
+ *
+ * @return the offset of the previous instruction, or `pc` if it is the first one
+ */
+static u4 previous_instruction(const u1 *code, u4 pc) {
+    u4 previous = pc;
+    for (u4 prev_pc = 0; prev_pc < pc; prev_pc += instruction_length(code, prev_pc)) {
+        previous = prev_pc;
+    }
+    return previous;
+}
+
+/**
+ * Matches the increment of a counted loop's counter by a local variable,
+ * `i += s`, which javac compiles to iload i; iload s; iadd; istore i.
+ *
+ * @return whether the instructions before the backward branch are such an increment
+ */
+static bool match_local_step(const u1 *bytecode, counted_loop_t *loop) {
+    u4 store = previous_instruction(bytecode, loop->back_branch);
+    u4 add = previous_instruction(bytecode, store);
+    u4 step_load = previous_instruction(bytecode, add);
+    loop->increment = previous_instruction(bytecode, step_load);
+    u2 stored, step, counter;
+    if (loop->increment < loop->body ||
+        load_index(bytecode, store, i_istore, i_istore_0, &stored) == 0 ||
+        stored != loop->counter || bytecode[add] != i_iadd ||
+        load_index(bytecode, step_load, i_iload, i_iload_0, &step) == 0 ||
+        step == loop->counter ||
+        load_index(bytecode, loop->increment, i_iload, i_iload_0, &counter) == 0 ||
+        counter != loop->counter) {
+        return false;
+    }
+    loop->step_local = step;
+    return true;
+}
+
+/**
+ * Matches the head of a javac counted loop at the target of a backward goto.
+ *
+ * @return NULL if the loop is a counted loop, or else why it is not one
+ */
+static const char *match_counted_loop(const class_file_t *class, const code_t *code,
+                                      u4 back_branch, counted_loop_t *loop) {
+    const u1 *bytecode = code->code;
+    loop->back_branch = back_branch;
+    loop->exit = back_branch + 3;
+    loop->head = back_branch + branch_offset(bytecode, back_branch);
+    u4 length = load_index(bytecode, loop->head, i_iload, i_iload_0, &loop->counter);
+    if (length == 0) {
+        return "condition does not load an int counter";
+    }
+    loop->limit = loop->head + length;
+
+    int32_t constant;
+    u2 local;
+    loop->limit_local = -1;
+    if (pushed_int(class, bytecode, loop->limit, &constant) != 0) {
+        loop->condition = loop->limit + pushed_int(class, bytecode, loop->limit, &constant);
+    }
+    else if ((length = load_index(bytecode, loop->limit, i_iload, i_iload_0, &local)) != 0) {
+        loop->limit_local = local;
+        loop->condition = loop->limit + length;
+    }
+    else if ((length = load_index(bytecode, loop->limit, i_aload, i_aload_0, &local)) != 0 &&
+             bytecode[loop->limit + length] == i_arraylength) {
+        loop->limit_local = local;
+        loop->condition = loop->limit + length + 1;
+    }
+    else {
+        return "limit is not a constant, local or array length";
+    }
+    if (bytecode[loop->condition] != i_if_icmpge ||
+        loop->condition + branch_offset(bytecode, loop->condition) != loop->exit) {
+        return "condition is not counter < limit";
+    }
+    loop->body = loop->condition + 3;
+
+    loop->step_local = -1;
+    if (match_local_step(bytecode, loop)) {
+        // Whether the step is positive is checked when the loop runs
+        return NULL;
+    }
+    loop->increment = back_branch - 3;
+    if (loop->increment < loop->body || bytecode[loop->increment] != i_iinc ||
+        bytecode[loop->increment + 1] != loop->counter) {
+        return "counter is not incremented before the backward branch";
+    }
+    loop->step = (int8_t) bytecode[loop->increment + 2];
+    if (loop->step <= 0) {
+        return "counter does not count up";
+    }
+    return NULL;
+}
+
+/**
+ * Checks that a counted loop's body leaves the counter and limit alone and that
+ * its control flow and exception handlers survive copying the body.
+ *
+ * @return NULL if the loop can be unrolled, or else why it cannot
+ */
+static const char *check_loop_body(const code_t *code, const counted_loop_t *loop) {
+    const u1 *bytecode = code->code;
+    for (u4 pc = 0; pc < code->code_length; pc += instruction_length(bytecode, pc)) {
+        bool in_body = loop->body <= pc && pc < loop->increment;
+        if (in_body && writes_local(bytecode, pc, loop->counter)) {
+            return "body writes the counter";
+        }
+        if (in_body && loop->limit_local >= 0 &&
+            writes_local(bytecode, pc, (u2) loop->limit_local)) {
+            return "body writes the limit";
+        }
+        if (in_body && loop->step_local >= 0 &&
+            writes_local(bytecode, pc, (u2) loop->step_local)) {
+            return "body writes the step";
+        }
+        if (!is_branch(bytecode[pc]) || pc == loop->back_branch || pc == loop->condition) {
+            continue;
+        }
+        u4 target = pc + branch_offset(bytecode, pc);
+        if (in_body) {
+            // Each copy of the body keeps its branches within itself, e.g. a continue
+            // to its iinc, but a nested loop would be copied whole
+            if (target <= pc && target > loop->head) {
+                return "body has a nested loop";
+            }
+            if ((loop->head < target && target < loop->body) || target == loop->back_branch) {
+                return "body branches into the loop control";
+            }
+        }
+        else if (loop->head < target && target < loop->exit) {
+            return "loop is entered other than at its head";
+        }
+    }
+    for (u2 i = 0; i < code->handler_count; i++) {
+        const exception_handler_t *handler = &code->handlers[i];
+        bool outside = handler->end_pc <= loop->head || handler->start_pc >= loop->exit;
+        bool covers = handler->start_pc <= loop->head && handler->end_pc >= loop->exit;
+        if (!outside && !covers) {
+            return "an exception handler covers part of the loop";
+        }
+        if (loop->head < handler->handler_pc && handler->handler_pc < loop->exit) {
+            return "an exception handler is in the loop";
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Computes a counted loop's trip count when the counter is initialized to a constant
+ * just before the loop and the limit and step are constants,
+ * e.g. `for (int i = 0; i < 10; i++)`.
+ *
+ * @return the number of iterations, or -1 if it is not known when linking
+ */
+static int64_t known_trip_count(const class_file_t *class, const code_t *code,
+                                const counted_loop_t *loop) {
+    const u1 *bytecode = code->code;
+    int32_t start, limit;
+    if (loop->step_local >= 0 || pushed_int(class, bytecode, loop->limit, &limit) == 0) {
+        return -1;
+    }
+    u4 store = previous_instruction(bytecode, loop->head);
+    u4 push = previous_instruction(bytecode, store);
+    u2 stored;
+    if (store == loop->head ||
+        load_index(bytecode, store, i_istore, i_istore_0, &stored) == 0 ||
+        stored != loop->counter || pushed_int(class, bytecode, push, &start) == 0 ||
+        push + pushed_int(class, bytecode, push, &start) != store) {
+        return -1;
+    }
+    // The head must only be reached from the initialization and the loop itself
+    for (u4 pc = 0; pc < code->code_length; pc += instruction_length(bytecode, pc)) {
+        if (is_branch(bytecode[pc]) && pc + branch_offset(bytecode, pc) == loop->head &&
+            pc != loop->back_branch && !(loop->body <= pc && pc < loop->increment)) {
+            return -1;
+        }
+    }
+    if (limit <= start) {
+        return 0;
+    }
+    return ((int64_t) limit - start + loop->step - 1) / loop->step;
+}
+
+/**
+ * Chooses how many copies of a loop's body to make: as many as fit in
+ * MAX_UNROLLED_BYTES, but no more than a known trip count.
+ *
+ * @return the factor, where 1 means the loop is not unrolled
+ */
+static u4 choose_factor(const counted_loop_t *loop, int64_t trip_count) {
+    u4 body_bytes = loop->back_branch - loop->body;
+    u4 factor = MAX_UNROLL_FACTOR;
+    while (factor > 1 && factor * body_bytes > MAX_UNROLLED_BYTES) {
+        factor /= 2;
+    }
+    while (factor > 1 && trip_count >= 0 && trip_count < factor) {
+        factor /= 2;
+    }
+    return factor;
+}
+
+/** Maps an offset in the original bytecode outside the loop to the unrolled bytecode */
+static u4 relocate(const counted_loop_t *loop, u4 pc, int32_t growth) {
+    return pc <= loop->head ? pc : pc + growth;
+}
+
+/**
+ * Copies a range of the original bytecode, relocating its branches.
+ * Branches into the body go to the copy of the body that starts at `body_copy`.
+ *
+ * @return false if a relocated branch offset does not fit in 16 bits
+ */
+static bool copy_code(u1 *new_code, u4 new_pc, const u1 *code, u4 start, u4 end,
+                      const counted_loop_t *loop, int32_t growth, u4 body_copy) {
+    memcpy(new_code + new_pc, code + start, end - start);
+    for (u4 pc = start; pc < end; pc += instruction_length(code, pc)) {
+        if (!is_branch(code[pc])) {
+            continue;
+        }
+        u4 target = pc + branch_offset(code, pc);
+        u4 new_target = loop->body <= target && target < loop->back_branch
+                            ? body_copy + (target - loop->body)
+                            : relocate(loop, target, growth);
+        int32_t offset = (int32_t) new_target - (int32_t)(new_pc + pc - start);
+        if (offset < INT16_MIN || offset > INT16_MAX) {
+            return false;
+        }
+        new_code[new_pc + pc - start + 1] = (u1)((u2) offset >> 8);
+        new_code[new_pc + pc - start + 2] = (u1) offset;
+    }
+    return true;
+}
+
+/** Writes a branch instruction */
+static void write_branch(u1 *new_code, u4 pc, u1 opcode, u4 target) {
+    int16_t offset = (int16_t)((int32_t) target - (int32_t) pc);
+    new_code[pc] = opcode;
+    new_code[pc + 1] = (u1)((u2) offset >> 8);
+    new_code[pc + 2] = (u1) offset;
+}
+
+/** Writes an iload of a local variable, returning the instruction's length */
+static u4 write_iload(u1 *new_code, u4 pc, u2 local) {
+    if (local <= 3) {
+        new_code[pc] = i_iload_0 + local;
+        return 1;
+    }
+    new_code[pc] = i_iload;
+    new_code[pc + 1] = (u1) local;
+    return 2;
+}
+
+/**
+ * Rewrites a method's bytecode to unroll a counted loop (see unroll_loops()).
+ *
+ * @return false if the unrolled bytecode would be too long for the branches
+ *         and exception table, in which case the method is unchanged
+ */
+static bool unroll_loop(code_t *code, const counted_loop_t *loop, u4 factor) {
+    const u1 *bytecode = code->code;
+    u4 copy_bytes = loop->back_branch - loop->body;
+    u4 guard_bytes = (loop->condition - loop->limit) + (loop->limit - loop->head) + 1;
+    if (loop->step_local < 0) {
+        // sipush and if_icmplt
+        guard_bytes += 3 + 3;
+    }
+    else {
+        // iconst_1, isub, iconst_<n>, idiv, then an iload and branch twice
+        guard_bytes += 4 + 2 * ((loop->step_local > 3 ? 2 : 1) + 3);
+    }
+    int32_t growth = (int32_t)(guard_bytes + factor * copy_bytes + 3);
+    u4 new_length = code->code_length + growth;
+    if (new_length > UINT16_MAX) {
+        return false;
+    }
+    u1 *new_code = malloc(new_length);
+    assert(new_code != NULL && "Failed to allocate unrolled bytecode");
+
+    // The code before the loop and the loop's condition stay where they are
+    bool fits = copy_code(new_code, 0, bytecode, 0, loop->body, loop, growth, 0);
+    u4 pc = loop->body;
+
+    // The guard jumps to the single iteration when fewer than `factor` remain
+    u4 single = pc + guard_bytes + factor * copy_bytes + 3;
+    memcpy(new_code + pc, bytecode + loop->limit, loop->condition - loop->limit);
+    pc += loop->condition - loop->limit;
+    memcpy(new_code + pc, bytecode + loop->head, loop->limit - loop->head);
+    pc += loop->limit - loop->head;
+    new_code[pc++] = i_isub;
+    if (loop->step_local < 0) {
+        u2 remaining = (u2)((factor - 1) * loop->step + 1);
+        new_code[pc++] = i_sipush;
+        new_code[pc++] = (u1)(remaining >> 8);
+        new_code[pc++] = (u1) remaining;
+        write_branch(new_code, pc, i_if_icmplt, single);
+        pc += 3;
+    }
+    else {
+        // (factor - 1) * s < n - i, divided by factor - 1 so it cannot overflow.
+        // A step that is not positive only runs one iteration at a time.
+        new_code[pc++] = i_iconst_1;
+        new_code[pc++] = i_isub;
+        new_code[pc++] = i_iconst_0 + (factor - 1);
+        new_code[pc++] = i_idiv;
+        pc += write_iload(new_code, pc, (u2) loop->step_local);
+        write_branch(new_code, pc, i_if_icmplt, single);
+        pc += 3;
+        pc += write_iload(new_code, pc, (u2) loop->step_local);
+        write_branch(new_code, pc, i_ifle, single);
+        pc += 3;
+    }
+
+    for (u4 copy = 0; copy < factor; copy++) {
+        fits &= copy_code(new_code, pc, bytecode, loop->body, loop->back_branch, loop,
+                          growth, pc);
+        pc += copy_bytes;
+    }
+    write_branch(new_code, pc, i_goto, loop->head);
+    pc += 3;
+
+    // The original body and goto run the remaining iterations one at a time
+    assert(pc == single);
+    fits &= copy_code(new_code, pc, bytecode, loop->body, code->code_length, loop, growth, pc);
+    if (!fits) {
+        free(new_code);
+        return false;
+    }
+
+    for (u2 i = 0; i < code->handler_count; i++) {
+        exception_handler_t *handler = &code->handlers[i];
+        handler->start_pc = relocate(loop, handler->start_pc, growth);
+        handler->end_pc = relocate(loop, handler->end_pc, growth);
+        handler->handler_pc = relocate(loop, handler->handler_pc, growth);
+    }
+    free(code->code);
+    code->code = new_code;
+    code->code_length = new_length;
+    stats_add_bytes(MEM_METHOD_BODIES, growth);
+    return true;
+}
+
+void unroll_loops(const class_file_t *class, method_t *method) {
+    code_t *code = &method->code;
+    if (code->code == NULL || !can_relocate(code)) {
+        return;
+    }
+    for (u4 pc = 0; pc < code->code_length; pc += instruction_length(code->code, pc)) {
+        if (code->code[pc] != i_goto || branch_offset(code->code, pc) >= 0) {
+            continue;
+        }
+        counted_loop_t loop;
+        u4 code_length = code->code_length;
+        const char *reason = match_counted_loop(class, code, pc, &loop);
+        if (reason == NULL) {
+            reason = check_loop_body(code, &loop);
+        }
+        u4 factor = 1;
+        int64_t trip_count = -1;
+        if (reason == NULL) {
+            trip_count = known_trip_count(class, code, &loop);
+            factor = choose_factor(&loop, trip_count);
+            if (factor == 1) {
+                reason = trip_count >= 0 && trip_count < 2 ? "too few iterations"
+                                                           : "body is too large";
+            }
+        }
+        if (reason == NULL && !unroll_loop(code, &loop, factor)) {
+            reason = "unrolled code would be too long";
+        }
+        if (unroll_log_enabled) {
+            fprintf(stderr, "%s.%s%s loop at pc %u: ", class->name, method->name,
+                    method->descriptor, loop.head);
+            if (reason == NULL) {
+                fprintf(stderr, "unrolled by %u, body of %u bytes", factor,
+                        loop.back_branch - loop.body);
+                if (trip_count >= 0) {
+                    fprintf(stderr, ", %lld iterations", (long long) trip_count);
+                }
+                fprintf(stderr, "\n");
+            }
+            else {
+                fprintf(stderr, "not unrolled, %s\n", reason);
+            }
+        }
+        if (reason == NULL) {
+            // Continue after the single-iteration copy of the loop, whose goto has
+            // moved by the growth of the code
+            pc = loop.back_branch + (code->code_length - code_length);
+        }
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef UNROLL_H
+#define UNROLL_H
+
+#include <stdbool.h>
+
+#include "class_file.h"
+
+/** Whether each counted loop's unroll decision is printed to stderr (-Xlogunroll) */
+extern bool unroll_log_enabled;
+
+/**
+ * Unrolls the small counted loops of a method, so their loop control runs
+ * once per several iterations. A counted loop is one that javac compiles from
+ * `for (...; i < n; i += c)` where the body writes neither i nor n. The step c
+ * is a constant or a local that the body does not write, whose increment is
+ * iload i; iload c; iadd; istore i instead of the iinc below:
+ *
+ *     head: iload i; <load n>; if_icmpge exit
+ *           body; iinc i c; goto head
+ *     exit:
+ *
+ * The loop becomes a guard that at least `factor` iterations remain, then
+ * `factor` copies of the body and increment, with the original body as the
+ * remainder loop for the last iterations:
+ *
+ *     head: iload i; <load n>; if_icmpge exit
+ *           <load n>; iload i; isub; sipush (factor - 1) * c + 1; if_icmplt single
+ *           body; iinc i c; ...; body; iinc i c; goto head
+ *     single: body; iinc i c; goto head
+ *     exit:
+ *
+ * With a local step, the guard instead checks (n - i - 1) / (factor - 1) >= c
+ * and c > 0, so it cannot overflow.
+ *
+ * This must run after quickening, which may fuse instructions across a
+ * loop, and before stack maps are computed.
+ *
+ * @param class the class declaring the method, for logging
+ * @param method the method whose bytecode to rewrite
+ */
+void unroll_loops(const class_file_t *class, method_t *method);
+
+#endif /* UNROLL_H */